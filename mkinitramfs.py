@@ -0,0 +1,62 @@
+import sys
+import os
+
+# Must match INITRAMFS_SECTORS in src/boot/boot.asm
+MAX_SIZE = 256 * 512
+PAGE_SIZE = 4096
+
+S_IFREG = 0o100000
+
+def align(value, boundary):
+    return (value + boundary - 1) & ~(boundary - 1)
+
+def header(ino, mode, filesize, namesize):
+    fields = [ino, mode, 0, 0, 1, 0, filesize, 0, 0, 0, 0, namesize, 0]
+    return b"070701" + b"".join(b"%08X" % f for f in fields)
+
+def build(out_path, entries):
+    archive = bytearray()
+    ino = 1
+    for file_path, name in entries + [(None, "TRAILER!!!")]:
+        data = b""
+        mode = 0
+        if file_path:
+            with open(file_path, "rb") as src:
+                data = src.read()
+            mode = S_IFREG | 0o555
+
+        encoded = name.encode() + b"\0"
+        namesize = len(encoded)
+        if file_path:
+            # Pad the name with NULs so the file data starts on a page
+            # boundary; the kernel then serves it straight from the archive
+            data_start = align(len(archive) + 110 + namesize, PAGE_SIZE)
+            namesize = data_start - len(archive) - 110
+
+        archive += header(ino, mode, len(data), namesize)
+        archive += encoded.ljust(namesize, b"\0")
+        archive += b"\0" * (align(len(archive), 4) - len(archive))
+        archive += data
+        archive += b"\0" * (align(len(archive), 4) - len(archive))
+        ino += 1
+
+    if len(archive) > MAX_SIZE:
+        print("initramfs: archive is %d bytes, boot loader reserves %d" % (len(archive), MAX_SIZE))
+        sys.exit(1)
+
+    with open(out_path, "wb") as f:
+        f.write(archive)
+
+    print("Built %s: %d files, %d bytes" % (out_path, len(entries), len(archive)))
+
+if __name__ == "__main__":
+    if len(sys.argv) < 2:
+        print("Usage: python3 mkinitramfs.py <archive> [file[:name] ...]")
+        sys.exit(1)
+
+    entries = []
+    for arg in sys.argv[2:]:
+        file_path, _, name = arg.partition(":")
+        entries.append((file_path, name or os.path.basename(file_path)))
+
+    build(sys.argv[1], entries)
@@ -0,0 +1,80 @@
+[BITS 32]
+
+section .text
+global _start
+
+SYS_EXIT equ 0
+SYS_WRITE equ 1
+SYS_SLEEP equ 6
+SYS_GETPID equ 7
+ROUNDS equ 50
+
+; Count up in an x87 register and in all four lanes of an SSE register,
+; sleeping between steps so other tasks get the FPU, and check the counts
+; survive. Run two copies at once to see each keep its own registers.
+_start:
+    mov eax, SYS_GETPID
+    int 0x80
+    mov edi, eax            ; The count both registers should hold
+
+    push edi
+    fild dword [esp]        ; st0 = pid
+    movd xmm0, edi
+    pshufd xmm0, xmm0, 0    ; xmm0 = pid in every lane
+    mov dword [esp], 1
+    movd xmm1, [esp]
+    pshufd xmm1, xmm1, 0    ; xmm1 = 1 in every lane
+    add esp, 4
+
+    mov esi, ROUNDS
+.round:
+    fld1
+    faddp st1, st0
+    paddd xmm0, xmm1
+    inc edi
+
+    mov eax, SYS_SLEEP
+    mov ebx, 10
+    int 0x80
+
+    ; Every lane and st0 must match edi
+    sub esp, 4
+    fist dword [esp]
+    cmp [esp], edi
+    jne .lost
+    mov ecx, 4
+.lane:
+    movd eax, xmm0
+    cmp eax, edi
+    jne .lost
+    pshufd xmm0, xmm0, 0x39 ; Rotate the next lane down
+    loop .lane
+    add esp, 4
+
+    dec esi
+    jnz .round
+
+    mov ecx, passed
+    mov edx, passed_len
+    xor esi, esi
+    jmp .exit
+
+.lost:
+    add esp, 4
+    mov ecx, failed
+    mov edx, failed_len
+    mov esi, 1
+
+.exit:
+    mov eax, SYS_WRITE
+    xor ebx, ebx
+    int 0x80
+
+    mov eax, SYS_EXIT
+    mov ebx, esi
+    int 0x80
+
+passed: db "fputest: registers kept", 10
+passed_len equ $ - passed
+failed: db "fputest: registers lost", 10
+failed_len equ $ - failed
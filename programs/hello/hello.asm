@@ -0,0 +1,19 @@
+[BITS 32]
+
+section .text
+global _start
+
+; Print a line through the system call gate, then hand the CPU back
+_start:
+    mov eax, 1              ; SYS_WRITE
+    mov ebx, 0              ; Console
+    mov ecx, message
+    mov edx, message_len
+    int 0x80
+
+    mov eax, 0              ; SYS_EXIT
+    mov ebx, 0
+    int 0x80
+
+message: db "Hello from ring 3", 10
+message_len equ $ - message
@@ -0,0 +1,121 @@
+[BITS 32]
+
+section .text
+global _start
+
+SYS_EXIT equ 0
+SYS_WRITE equ 1
+SYS_GETPID equ 7
+ROUNDS equ 100000
+
+; Time a null system call (getpid) through the int 0x80 gate and through
+; SYSENTER, and print what each costs on average in TSC cycles
+_start:
+    mov ecx, gate_label
+    mov edx, gate_label_len
+    call print
+
+    rdtsc
+    push edx
+    push eax
+    mov esi, ROUNDS
+.gate_loop:
+    mov eax, SYS_GETPID
+    int 0x80
+    dec esi
+    jnz .gate_loop
+    call report
+
+    mov ecx, fast_label
+    mov edx, fast_label_len
+    call print
+
+    ; SEP in CPUID leaf 1 says whether there is a SYSENTER
+    mov eax, 1
+    cpuid
+    test edx, 1 << 11
+    jz .no_fast
+
+    rdtsc
+    push edx
+    push eax
+    mov esi, ROUNDS
+.fast_loop:
+    mov eax, SYS_GETPID
+    push ebp
+    push dword .fast_return
+    mov ebp, esp
+    sysenter
+.fast_return:
+    dec esi
+    jnz .fast_loop
+    call report
+    jmp .exit
+
+.no_fast:
+    mov ecx, missing
+    mov edx, missing_len
+    call print
+
+.exit:
+    mov eax, SYS_EXIT
+    xor ebx, ebx
+    int 0x80
+
+; Print the cycles per round since the TSC value the caller pushed
+report:
+    rdtsc
+    sub eax, [esp+4]
+    sbb edx, [esp+8]
+
+    ; 64 by 32 bit division in two steps, so the quotient can't overflow
+    mov ecx, ROUNDS
+    mov ebx, eax
+    mov eax, edx
+    xor edx, edx
+    div ecx
+    mov eax, ebx
+    div ecx
+
+    call print_number
+    mov ecx, cycles
+    mov edx, cycles_len
+    call print
+    ret 8
+
+; Print eax in decimal
+print_number:
+    sub esp, 12
+    lea edi, [esp+12]
+    mov ecx, 10
+.digit:
+    xor edx, edx
+    div ecx
+    add dl, '0'
+    dec edi
+    mov [edi], dl
+    test eax, eax
+    jnz .digit
+
+    lea edx, [esp+12]
+    sub edx, edi
+    mov ecx, edi
+    call print
+    add esp, 12
+    ret
+
+; Write edx bytes at ecx to the console
+print:
+    mov eax, SYS_WRITE
+    xor ebx, ebx
+    int 0x80
+    ret
+
+gate_label: db "int 0x80: "
+gate_label_len equ $ - gate_label
+fast_label: db "sysenter: "
+fast_label_len equ $ - fast_label
+cycles: db " cycles per call", 10
+cycles_len equ $ - cycles
+missing: db "not supported", 10
+missing_len equ $ - missing
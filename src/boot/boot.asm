@@ -2,28 +2,51 @@
 ; Simple "Hello World" bootloader that runs in 16-bit real mode
 
 [BITS 16]           ; Tell NASM we're in 16-bit real mode
-[ORG 0x7C00]
+[ORG 0x0600]        ; We run from 0x0600 once relocated (see start)
 KERNEL_OFFSET equ 0x1000 ; Memory offset to which we will load our kernel
+KERNEL_SECTORS equ 512   ; Sectors reserved for the kernel image (256KB)
+INITRAMFS_OFFSET equ 0x48000 ; Must match INITRAMFS_ADDRESS in src/fs/initramfs.h
+INITRAMFS_SECTORS equ 256    ; 128KB, between the kernel and its stack
+BIOS_LOAD_ADDRESS equ 0x7C00
 
 start:
     ; BOOTLOADER START
-    mov [boot_drive], dl ; Save boot drive
-
-    ; Initialize segment registers
+    ; The kernel image loaded at 0x1000 is larger than the 27KB gap below
+    ; 0x7C00, so copy ourselves down to 0x0600 before loading it
+    cli
     xor ax, ax
     mov ds, ax
     mov es, ax
+    mov si, BIOS_LOAD_ADDRESS
+    mov di, start
+    mov cx, 256
+    cld
+    rep movsw
+    jmp 0x0000:relocated
+
+relocated:
+    mov [boot_drive], dl ; Save boot drive
+
+    ; Stack just below 0x90000, clear of the kernel load area
+    mov ax, 0x8000
     mov ss, ax
-    mov sp, 0x7C00
+    mov sp, 0xFFF0
+    sti
 
     ; Print hello message
     mov si, msg_real_mode
     call print_string
 
     ; Load Kernel
-    mov bx, KERNEL_OFFSET ; Read from disk and store in 0x1000
-    mov dh, 50 ; Load 50 sectors (plenty of space)
-    mov dl, [boot_drive]
+    mov bx, KERNEL_OFFSET >> 4
+    mov eax, 1
+    mov cx, KERNEL_SECTORS / DISK_CHUNK_SECTORS
+    call disk_load
+
+    ; Load the initramfs archive the Makefile places after the kernel
+    mov bx, INITRAMFS_OFFSET >> 4
+    mov eax, 1 + KERNEL_SECTORS
+    mov cx, INITRAMFS_SECTORS / DISK_CHUNK_SECTORS
     call disk_load
 
     ; Enable A20 Line
@@ -1,18 +1,29 @@
-; load DH sectors to ES:BX from drive DL
+DISK_CHUNK_SECTORS equ 64 ; 32KB per read so each chunk stays inside one segment
+
+; load CX chunks of DISK_CHUNK_SECTORS sectors starting at LBA EAX to
+; segment BX from drive [boot_drive] using the INT 13h extensions
 disk_load:
-    push dx         ; Store DX on stack so later we can recall how many sectors were requested to be read , even if it is altered in the meantime
-    mov ah, 0x02    ; BIOS read sector function
-    mov al, dh      ; Read DH sectors
-    mov ch, 0x00    ; Select cylinder 0
-    mov dh, 0x00    ; Select head 0
-    mov cl, 0x02    ; Start reading from second sector (i.e. after the boot sector)
+    pusha
+    mov [dap_segment], bx
+    mov [dap_lba], eax
+
+.loop:
+    push cx
+    mov word [dap_count], DISK_CHUNK_SECTORS ; BIOS overwrites this with the count read
+    mov word [dap_offset], 0
+    mov si, dap
+    mov ah, 0x42    ; BIOS extended read function
+    mov dl, [boot_drive]
     int 0x13        ; BIOS interrupt
-    
+    pop cx
+
     jc disk_error   ; Jump if error (i.e. carry flag set)
 
-    pop dx          ; Restore DX from the stack
-    cmp dh, al      ; if AL (sectors read) != DH (sectors expected)
-    jne disk_error  ; display error message
+    add word [dap_segment], (DISK_CHUNK_SECTORS * 512) >> 4
+    add dword [dap_lba], DISK_CHUNK_SECTORS
+    loop .loop
+
+    popa
     ret
 
 disk_error:
@@ -20,4 +31,18 @@ disk_error:
     call print_string
     jmp $
 
+; Disk address packet for INT 13h AH=42h
+dap:
+    db 0x10         ; Size of packet
+    db 0            ; Reserved
+dap_count:
+    dw 0            ; Number of sectors to transfer
+dap_offset:
+    dw 0            ; Destination offset
+dap_segment:
+    dw 0            ; Destination segment
+dap_lba:
+    dd 0            ; Starting LBA (low 32 bits)
+    dd 0            ; Starting LBA (high 32 bits)
+
 msg_disk_error: db 'Disk Load Error', 0
@@ -0,0 +1,53 @@
+#ifndef CPU_H
+#define CPU_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+// CPUID leaf 1 EDX feature bits
+#define CPU_FEATURE_FPU (1 << 0)
+#define CPU_FEATURE_TSC (1 << 4)
+#define CPU_FEATURE_SEP (1 << 11) // SYSENTER/SYSEXIT
+#define CPU_FEATURE_FXSR (1 << 24) // FXSAVE/FXRSTOR
+#define CPU_FEATURE_SSE (1 << 25)
+
+// Where SYSENTER goes: code segment (stack segment is the next one),
+// stack and entry point
+#define CPU_MSR_SYSENTER_CS 0x174
+#define CPU_MSR_SYSENTER_ESP 0x175
+#define CPU_MSR_SYSENTER_EIP 0x176
+
+static inline uint32_t cpu_features() {
+    uint32_t eax = 1, ebx, ecx, edx;
+    __asm__ __volatile__("cpuid" : "+a"(eax), "=b"(ebx), "=c"(ecx), "=d"(edx));
+    return edx;
+}
+
+static inline void cpu_write_msr(uint32_t msr, uint64_t value) {
+    __asm__ __volatile__("wrmsr" : : "c"(msr), "a"((uint32_t)value), "d"((uint32_t)(value >> 32)));
+}
+
+static inline uint64_t rdtsc() {
+    uint32_t lo, hi;
+    __asm__ __volatile__("rdtsc" : "=a"(lo), "=d"(hi));
+    return ((uint64_t)hi << 32) | lo;
+}
+
+// Disable interrupts, returning EFLAGS from before so they can be restored
+static inline uint32_t interrupts_save() {
+    uint32_t flags;
+    __asm__ __volatile__("pushf; pop %0; cli" : "=r"(flags) : : "memory");
+    return flags;
+}
+
+static inline void interrupts_restore(uint32_t flags) {
+    __asm__ __volatile__("push %0; popf" : : "r"(flags) : "memory", "cc");
+}
+
+static inline bool interrupts_enabled() {
+    uint32_t flags;
+    __asm__ __volatile__("pushf; pop %0" : "=r"(flags));
+    return flags & 0x200;
+}
+
+#endif
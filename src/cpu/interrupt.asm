@@ -129,3 +129,45 @@ IRQ 12, 44
 IRQ 13, 45
 IRQ 14, 46
 IRQ 15, 47
+
+; System calls. The number doesn't fit a sign-extended byte push.
+[global isr128]
+isr128:
+    cli
+    push byte 0
+    push dword 128
+    jmp isr_common_stub
+
+; SYSENTER lands here on the task's kernel stack with interrupts off and
+; whatever data segments the caller had loaded, which may be null, so the
+; kernel ones are loaded as in isr_common_stub. ebp points at the user
+; stack: the return address, then the caller's ebp. Lay out a registers_t
+; so the calls are shared with the gate, and leave by SYSEXIT with the
+; eip and esp the handler filled in and the user data segment back in
+; place. ecx and edx don't survive the call.
+[extern syscall_fast_handler]
+[global syscall_fast_entry]
+syscall_fast_entry:
+    sub esp, 20         ; eip, cs, eflags, useresp, ss
+    push byte 0
+    push dword 128
+    pusha
+    push dword 0x23     ; ds, as SYSEXIT returns with it
+    mov ax, 0x10
+    mov ds, ax
+    mov es, ax
+    mov fs, ax
+    mov gs, ax
+    push esp
+    call syscall_fast_handler
+    add esp, 8
+    mov ax, 0x23        ; User Data (0x20 | 3)
+    mov ds, ax
+    mov es, ax
+    mov fs, ax
+    mov gs, ax
+    popa
+    mov edx, [esp+8]    ; eip
+    mov ecx, [esp+20]   ; useresp
+    sti                 ; Takes effect after SYSEXIT
+    sysexit
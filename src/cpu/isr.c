@@ -7,6 +7,9 @@
 
 isr_t interrupt_handlers[256];
 
+// Interrupts taken per IRQ line, for procfs
+static uint32_t irq_counts[16];
+
 void register_interrupt_handler(uint8_t n, isr_t handler) {
     interrupt_handlers[n] = handler;
 }
@@ -62,6 +65,7 @@ extern void irq12();
 extern void irq13();
 extern void irq14();
 extern void irq15();
+extern void isr128();
 
 #define IRQ0 32
 #define IRQ1 33
@@ -125,8 +129,8 @@ void isr_install() {
     port_byte_out(0xA1, 0x02);
     port_byte_out(0x21, 0x01);
     port_byte_out(0xA1, 0x01);
-    port_byte_out(0x21, 0xFD); // Unmask IRQ0 (Timer) and IRQ1 (Keyboard)
-    port_byte_out(0xA1, 0xFF); 
+    port_byte_out(0x21, 0xF8); // Unmask IRQ0 (Timer), IRQ1 (Keyboard) and IRQ2 (Cascade)
+    port_byte_out(0xA1, 0xBF); // Unmask IRQ14 (Primary ATA)
 
     // Install IRQs
     set_idt_gate(32, (uint32_t)irq0, flags);
@@ -146,6 +150,9 @@ void isr_install() {
     set_idt_gate(46, (uint32_t)irq14, flags);
     set_idt_gate(47, (uint32_t)irq15, flags);
 
+    // The system call gate is the one ring 3 may raise itself
+    set_idt_gate(128, (uint32_t)isr128, IDT_PRESENT | IDT_DPL_3 | IDT_TYPE_INTERRUPT_GATE_32);
+
     set_idt(); // Load IDT
 }
 
@@ -172,7 +179,7 @@ char *exception_messages[] = {
     "Coprocessor Fault",
     "Alignment Check",
     "Machine Check",
-    "Reserved",
+    "SIMD Floating-Point Exception",
     "Reserved",
     "Reserved",
     "Reserved",
@@ -188,27 +195,38 @@ char *exception_messages[] = {
     "Reserved"
 };
 
-void isr_handler(registers_t *r) {
-    if (r->int_no < 32) {
-        serial_print("received internal interrupt: ");
-        serial_print(exception_messages[r->int_no]);
-        serial_print("\n");
-        
-        if (r->int_no == 14) { // Page Fault
-            uint32_t faulting_address;
-            __asm__ __volatile__("mov %%cr2, %0" : "=r" (faulting_address));
-            serial_print("Faulting address: 0x");
-            for (int i = 0; i < 8; i++) {
-                uint8_t nibble = (faulting_address >> (28 - i * 4)) & 0xF;
-                serial_putc(nibble < 10 ? nibble + '0' : nibble - 10 + 'A');
-            }
-            serial_print("\n");
+const char* isr_exception_name(uint32_t int_no) {
+    return int_no < 32 ? exception_messages[int_no] : "Unknown Interrupt";
+}
+
+// Report an exception nobody could handle and stop
+void isr_fatal(registers_t *r) {
+    serial_print("received internal interrupt: ");
+    serial_print(exception_messages[r->int_no]);
+    serial_print("\n");
+    
+    if (r->int_no == 14) { // Page Fault
+        uint32_t faulting_address;
+        __asm__ __volatile__("mov %%cr2, %0" : "=r" (faulting_address));
+        serial_print("Faulting address: 0x");
+        for (int i = 0; i < 8; i++) {
+            uint8_t nibble = (faulting_address >> (28 - i * 4)) & 0xF;
+            serial_putc(nibble < 10 ? nibble + '0' : nibble - 10 + 'A');
         }
+        serial_print("\n");
+    }
+
+    print_string("received interrupt: ");
+    print_string(exception_messages[r->int_no]);
+    print_string("\n");
+    __asm__("cli; hlt"); // Halt on exception
+}
 
-        print_string("received interrupt: ");
-        print_string(exception_messages[r->int_no]);
-        print_string("\n");
-        __asm__("cli; hlt"); // Halt on exception
+void isr_handler(registers_t *r) {
+    // Exceptions with a handler (page faults for lazy mappings) are its
+    // to resolve; it calls isr_fatal if it can't
+    if (r->int_no < 32 && interrupt_handlers[r->int_no] == 0) {
+        isr_fatal(r);
     }
 
     if (interrupt_handlers[r->int_no] != 0) {
@@ -218,6 +236,8 @@ void isr_handler(registers_t *r) {
 }
 
 void irq_handler(registers_t *r) {
+    irq_counts[(r->int_no - 32) & 15]++;
+
     // Send EOI to PICs
     if (r->int_no >= 40) port_byte_out(0xA0, 0x20); // Slave
     port_byte_out(0x20, 0x20); // Master
@@ -227,3 +247,7 @@ void irq_handler(registers_t *r) {
         handler(r);
     }
 }
+
+uint32_t isr_get_irq_count(uint8_t irq) {
+    return irq < 16 ? irq_counts[irq] : 0;
+}
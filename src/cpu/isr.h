@@ -16,6 +16,9 @@ void register_interrupt_handler(uint8_t n, isr_t handler);
 
 void isr_install();
 void isr_handler(registers_t *regs);
+void isr_fatal(registers_t *regs);
+const char* isr_exception_name(uint32_t int_no);
+uint32_t isr_get_irq_count(uint8_t irq);
 void irq_handler(registers_t *regs);
 
 #endif
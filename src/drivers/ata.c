@@ -1,6 +1,18 @@
 #include "ata.h"
 #include "ports.h"
 #include "serial.h"
+#include "timer.h"
+#include "clocksource.h"
+#include "../cpu/isr.h"
+#include "../cpu/cpu.h"
+#include "../task/task.h"
+#include "../task/lock.h"
+
+// Signalled by IRQ14 when the drive has a sector ready or has finished
+static struct completion ata_irq;
+
+// One command on the channel at a time
+static struct mutex ata_mutex;
 
 static uint8_t ata_get_status() {
     return port_byte_in(ATA_PRIMARY_STATUS);
@@ -13,22 +25,44 @@ static void ata_io_wait() {
     port_byte_in(ATA_PRIMARY_STATUS);
 }
 
-static int ata_wait_for(uint8_t mask, uint8_t value, int timeout) {
-    while (timeout--) {
+static int ata_wait_for(uint8_t mask, uint8_t value, uint32_t timeout_ms) {
+    uint64_t deadline = ktime_get_ns() + (uint64_t)timeout_ms * NSEC_PER_MSEC;
+    while (1) {
         uint8_t status = ata_get_status();
         if ((status & mask) == value) return 0;
         if (status & ATA_STATUS_ERR) return -1;
+        if (ktime_get_ns() >= deadline) return -2; // Timeout
         ata_io_wait();
     }
-    return -2; // Timeout
 }
 
-static void ata_wait_bsy() {
-    while (ata_get_status() & ATA_STATUS_BSY);
+static void ata_irq_handler(registers_t* regs) {
+    ata_get_status(); // Reading the status acknowledges the interrupt
+    complete(&ata_irq);
+}
+
+void ata_init() {
+    completion_init(&ata_irq);
+    mutex_init(&ata_mutex);
+    register_interrupt_handler(46, ata_irq_handler);
+    port_byte_out(ATA_PRIMARY_CONTROL, 0x00); // nIEN clear, interrupts on
+}
+
+// Arm before whatever makes the drive interrupt next
+static void ata_arm() {
+    ata_irq.done = false;
+}
+
+// Sleep until the drive interrupts. Where sleeping isn't possible (boot,
+// fault handlers) or the interrupt never comes, the status polling that
+// follows does the waiting instead.
+static void ata_wait_irq() {
+    if (!interrupts_enabled() || !task_current()) return;
+    wait_for_completion_timeout(&ata_irq, timer_ms_to_ticks(ATA_IRQ_TIMEOUT_MS));
 }
 
 int ata_identify() {
-    ata_wait_bsy();
+    if (ata_wait_for(ATA_STATUS_BSY, 0, ATA_POLL_TIMEOUT_MS) < 0) return -5;
     port_byte_out(ATA_PRIMARY_DRIVE_SEL, 0xA0); // Master
     ata_io_wait();
     port_byte_out(ATA_PRIMARY_SEC_COUNT, 0);
@@ -40,13 +74,13 @@ int ata_identify() {
 
     if (ata_get_status() == 0) return -1;
 
-    if (ata_wait_for(ATA_STATUS_BSY, 0, 10000) < 0) return -3;
+    if (ata_wait_for(ATA_STATUS_BSY, 0, ATA_POLL_TIMEOUT_MS) < 0) return -3;
     
     uint8_t mid = port_byte_in(ATA_PRIMARY_LBA_MID);
     uint8_t high = port_byte_in(ATA_PRIMARY_LBA_HIGH);
     if (mid != 0 || high != 0) return -2;
 
-    if (ata_wait_for(ATA_STATUS_DRQ, ATA_STATUS_DRQ, 10000) < 0) return -4;
+    if (ata_wait_for(ATA_STATUS_DRQ, ATA_STATUS_DRQ, ATA_POLL_TIMEOUT_MS) < 0) return -4;
 
     for (int i = 0; i < 256; i++) {
         port_word_in(ATA_PRIMARY_DATA);
@@ -55,49 +89,113 @@ int ata_identify() {
     return 0;
 }
 
-int ata_read_sector(int drive, uint32_t lba, uint16_t* buffer) {
-    ata_wait_bsy();
-
+static void ata_select(int drive, uint32_t lba, uint8_t count) {
     uint8_t drive_bit = (drive == 0) ? 0x00 : 0x10;
     port_byte_out(ATA_PRIMARY_DRIVE_SEL, 0xE0 | drive_bit | ((lba >> 24) & 0x0F));
-    port_byte_out(ATA_PRIMARY_SEC_COUNT, 1);
+    port_byte_out(ATA_PRIMARY_SEC_COUNT, count);
     port_byte_out(ATA_PRIMARY_LBA_LOW, (uint8_t)lba);
     port_byte_out(ATA_PRIMARY_LBA_MID, (uint8_t)(lba >> 8));
     port_byte_out(ATA_PRIMARY_LBA_HIGH, (uint8_t)(lba >> 16));
-    port_byte_out(ATA_PRIMARY_COMMAND, ATA_CMD_READ_PIO);
-    ata_io_wait();
+}
 
-    if (ata_wait_for(ATA_STATUS_BSY, 0, 10000) < 0) return -1;
-    if (ata_wait_for(ATA_STATUS_DRQ, ATA_STATUS_DRQ, 10000) < 0) return -2;
+int ata_read_sectors(int drive, uint32_t lba, uint32_t count, uint16_t* buffer) {
+    int res = 0;
+    mutex_lock(&ata_mutex);
+    while (count > 0) {
+        // A sector count of 0 means 256 sectors
+        uint32_t batch = count > ATA_MAX_SECTORS_PER_CMD ? ATA_MAX_SECTORS_PER_CMD : count;
+
+        // A drive still busy from before, or no drive at all (a floating
+        // bus reads 0xFF), fails the request rather than hanging here
+        if (ata_wait_for(ATA_STATUS_BSY, 0, ATA_POLL_TIMEOUT_MS) < 0) {
+            res = -3;
+            goto out;
+        }
+        ata_select(drive, lba, (uint8_t)batch);
+        ata_arm();
+        port_byte_out(ATA_PRIMARY_COMMAND, ATA_CMD_READ_PIO);
+        ata_io_wait();
 
-    for (int i = 0; i < 256; i++) {
-        buffer[i] = port_word_in(ATA_PRIMARY_DATA);
+        for (uint32_t s = 0; s < batch; s++) {
+            ata_wait_irq();
+            if (ata_wait_for(ATA_STATUS_BSY, 0, ATA_POLL_TIMEOUT_MS) < 0) {
+                res = -1;
+                goto out;
+            }
+            if (ata_wait_for(ATA_STATUS_DRQ, ATA_STATUS_DRQ, ATA_POLL_TIMEOUT_MS) < 0) {
+                res = -2;
+                goto out;
+            }
+
+            // The next sector's interrupt comes once this one is read
+            ata_arm();
+            for (int i = 0; i < 256; i++) {
+                *buffer++ = port_word_in(ATA_PRIMARY_DATA);
+            }
+        }
+
+        lba += batch;
+        count -= batch;
     }
 
-    return 0;
+out:
+    mutex_unlock(&ata_mutex);
+    return res;
 }
 
-int ata_write_sector(int drive, uint32_t lba, uint16_t* buffer) {
-    ata_wait_bsy();
-
-    uint8_t drive_bit = (drive == 0) ? 0x00 : 0x10;
-    port_byte_out(ATA_PRIMARY_DRIVE_SEL, 0xE0 | drive_bit | ((lba >> 24) & 0x0F));
-    port_byte_out(ATA_PRIMARY_SEC_COUNT, 1);
-    port_byte_out(ATA_PRIMARY_LBA_LOW, (uint8_t)lba);
-    port_byte_out(ATA_PRIMARY_LBA_MID, (uint8_t)(lba >> 8));
-    port_byte_out(ATA_PRIMARY_LBA_HIGH, (uint8_t)(lba >> 16));
-    port_byte_out(ATA_PRIMARY_COMMAND, ATA_CMD_WRITE_PIO);
-    ata_io_wait();
-
-    if (ata_wait_for(ATA_STATUS_BSY, 0, 10000) < 0) return -1;
-    if (ata_wait_for(ATA_STATUS_DRQ, ATA_STATUS_DRQ, 10000) < 0) return -2;
+int ata_write_sectors(int drive, uint32_t lba, uint32_t count, const uint16_t* buffer) {
+    int res = 0;
+    mutex_lock(&ata_mutex);
+    while (count > 0) {
+        uint32_t batch = count > ATA_MAX_SECTORS_PER_CMD ? ATA_MAX_SECTORS_PER_CMD : count;
+
+        if (ata_wait_for(ATA_STATUS_BSY, 0, ATA_POLL_TIMEOUT_MS) < 0) {
+            res = -3;
+            goto out;
+        }
+        ata_select(drive, lba, (uint8_t)batch);
+        port_byte_out(ATA_PRIMARY_COMMAND, ATA_CMD_WRITE_PIO);
+        ata_io_wait();
 
-    for (int i = 0; i < 256; i++) {
-        port_word_out(ATA_PRIMARY_DATA, buffer[i]);
+        for (uint32_t s = 0; s < batch; s++) {
+            if (ata_wait_for(ATA_STATUS_BSY, 0, ATA_POLL_TIMEOUT_MS) < 0) {
+                res = -1;
+                goto out;
+            }
+            if (ata_wait_for(ATA_STATUS_DRQ, ATA_STATUS_DRQ, ATA_POLL_TIMEOUT_MS) < 0) {
+                res = -2;
+                goto out;
+            }
+
+            // The drive interrupts once it has taken the sector
+            ata_arm();
+            for (int i = 0; i < 256; i++) {
+                port_word_out(ATA_PRIMARY_DATA, *buffer++);
+            }
+            ata_wait_irq();
+        }
+
+        ata_arm();
+        port_byte_out(ATA_PRIMARY_COMMAND, ATA_CMD_CACHE_FLUSH);
+        ata_wait_irq();
+        if (ata_wait_for(ATA_STATUS_BSY, 0, ATA_FLUSH_TIMEOUT_MS) < 0 || (ata_get_status() & ATA_STATUS_ERR)) {
+            res = -4;
+            goto out;
+        }
+
+        lba += batch;
+        count -= batch;
     }
 
-    port_byte_out(ATA_PRIMARY_COMMAND, 0xE7); // Cache flush
-    ata_wait_bsy();
+out:
+    mutex_unlock(&ata_mutex);
+    return res;
+}
 
-    return 0;
+int ata_read_sector(int drive, uint32_t lba, uint16_t* buffer) {
+    return ata_read_sectors(drive, lba, 1, buffer);
+}
+
+int ata_write_sector(int drive, uint32_t lba, uint16_t* buffer) {
+    return ata_write_sectors(drive, lba, 1, buffer);
 }
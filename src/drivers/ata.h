@@ -12,17 +12,33 @@
 #define ATA_PRIMARY_DRIVE_SEL    0x1F6
 #define ATA_PRIMARY_COMMAND      0x1F7
 #define ATA_PRIMARY_STATUS       0x1F7
+#define ATA_PRIMARY_CONTROL      0x3F6
 
 #define ATA_CMD_READ_PIO         0x20
 #define ATA_CMD_WRITE_PIO        0x30
+#define ATA_CMD_CACHE_FLUSH      0xE7
 
 #define ATA_STATUS_BSY  0x80
 #define ATA_STATUS_RDY  0x40
 #define ATA_STATUS_DRQ  0x08
 #define ATA_STATUS_ERR  0x01
 
+#define ATA_MAX_SECTORS_PER_CMD 256
+
+// How long a submitter sleeps for an interrupt before polling instead
+#define ATA_IRQ_TIMEOUT_MS 500
+
+// How long the status register is polled before a command gives up
+#define ATA_POLL_TIMEOUT_MS 500
+
+// A cache flush may write out a lot; it gets longer
+#define ATA_FLUSH_TIMEOUT_MS 5000
+
+void ata_init();
 int ata_identify();
 int ata_read_sector(int drive, uint32_t lba, uint16_t* buffer);
 int ata_write_sector(int drive, uint32_t lba, uint16_t* buffer);
+int ata_read_sectors(int drive, uint32_t lba, uint32_t count, uint16_t* buffer);
+int ata_write_sectors(int drive, uint32_t lba, uint32_t count, const uint16_t* buffer);
 
 #endif
@@ -0,0 +1,219 @@
+#include "clocksource.h"
+#include "ports.h"
+#include "timer.h"
+#include "../cpu/cpu.h"
+#include "../string/string.h"
+#include <stddef.h>
+#include <stdbool.h>
+
+// PIT channel 2, gated through the keyboard controller's port B. Only
+// used here, so channel 0 keeps ticking undisturbed.
+#define PIT_CHANNEL2 0x42
+#define PIT_COMMAND 0x43
+#define PIT_PORT_B 0x61
+#define PIT_PORT_B_GATE2 0x01
+#define PIT_PORT_B_SPEAKER 0x02
+#define PIT_PORT_B_OUT2 0x20
+
+// Channel 2, low byte then high byte, mode 0 (OUT goes high at zero)
+#define PIT_MODE_ONE_SHOT 0xB0
+
+// Gives up on a reference that never gets there
+#define CLOCKSOURCE_MAX_POLLS 0x1000000
+
+// Where the ACPI root pointer may be
+#define ACPI_EBDA_POINTER 0x40E
+#define ACPI_BIOS_START 0xE0000
+#define ACPI_BIOS_END 0x100000
+
+#define HPET_CAPABILITIES_PERIOD 0x04 // High half: femtoseconds per count
+#define HPET_CONFIG 0x10
+#define HPET_CONFIG_ENABLE 0x01
+#define HPET_COUNTER 0xF0
+#define HPET_MAX_PERIOD_FS 100000000 // The spec's slowest, 10 MHz
+
+#define FEMTOSEC_PER_SEC 1000000000000000ULL
+
+// ns = cycles * mult >> shift
+#define CLOCKSOURCE_SHIFT 22
+
+struct acpi_rsdp {
+    char signature[8];
+    uint8_t checksum;
+    char oem_id[6];
+    uint8_t revision;
+    uint32_t rsdt_address;
+} __attribute__((packed));
+
+struct acpi_header {
+    char signature[4];
+    uint32_t length;
+    uint8_t revision;
+    uint8_t checksum;
+    char oem_id[6];
+    char oem_table_id[8];
+    uint32_t oem_revision;
+    uint32_t creator_id;
+    uint32_t creator_revision;
+} __attribute__((packed));
+
+struct acpi_hpet {
+    struct acpi_header header;
+    uint32_t event_timer_block_id;
+    uint8_t address_space;
+    uint8_t register_bit_width;
+    uint8_t register_bit_offset;
+    uint8_t reserved;
+    uint64_t address;
+} __attribute__((packed));
+
+static uint64_t clocksource_base;
+static uint32_t clocksource_mult;
+static uint32_t clocksource_tsc_khz;
+static const char* clocksource_reference = "none";
+
+uint64_t clocksource_div(uint64_t dividend, uint32_t divisor) {
+    uint32_t high = dividend >> 32;
+    uint32_t low = dividend;
+    uint32_t quotient_high = high / divisor;
+    uint32_t remainder = high % divisor;
+    uint32_t quotient_low;
+
+    // The remainder is below the divisor, so this divl can't overflow
+    __asm__("divl %4" : "=a"(quotient_low), "=d"(remainder) : "a"(low), "d"(remainder), "rm"(divisor));
+    return ((uint64_t)quotient_high << 32) | quotient_low;
+}
+
+static bool acpi_checksum(const void* table, uint32_t length) {
+    const uint8_t* bytes = table;
+    uint8_t sum = 0;
+    for (uint32_t i = 0; i < length; i++) {
+        sum += bytes[i];
+    }
+    return sum == 0;
+}
+
+static struct acpi_rsdp* acpi_scan(uint32_t start, uint32_t end) {
+    for (uint32_t addr = start; addr < end; addr += 16) {
+        struct acpi_rsdp* rsdp = (struct acpi_rsdp*)addr;
+        if (memcmp(rsdp->signature, "RSD PTR ", 8) == 0 && acpi_checksum(rsdp, sizeof(struct acpi_rsdp))) {
+            return rsdp;
+        }
+    }
+    return NULL;
+}
+
+// The HPET registers, if the firmware describes an HPET
+static volatile uint8_t* hpet_find() {
+    uint32_t ebda = (uint32_t)*(uint16_t*)ACPI_EBDA_POINTER << 4;
+    struct acpi_rsdp* rsdp = ebda ? acpi_scan(ebda, ebda + 1024) : NULL;
+    if (!rsdp) rsdp = acpi_scan(ACPI_BIOS_START, ACPI_BIOS_END);
+    if (!rsdp) return NULL;
+
+    struct acpi_header* rsdt = (struct acpi_header*)rsdp->rsdt_address;
+    if (!rsdt || memcmp(rsdt->signature, "RSDT", 4) != 0 || !acpi_checksum(rsdt, rsdt->length)) return NULL;
+
+    uint32_t* entries = (uint32_t*)(rsdt + 1);
+    uint32_t count = (rsdt->length - sizeof(struct acpi_header)) / 4;
+    for (uint32_t i = 0; i < count; i++) {
+        struct acpi_hpet* hpet = (struct acpi_hpet*)entries[i];
+        if (memcmp(hpet->header.signature, "HPET", 4) != 0) continue;
+
+        // Memory space only, and below 4GB
+        if (hpet->address_space != 0 || (hpet->address >> 32)) return NULL;
+        return (volatile uint8_t*)(uint32_t)hpet->address;
+    }
+    return NULL;
+}
+
+// TSC cycles per second, counted over CLOCKSOURCE_CALIBRATE_MS of the
+// HPET; 0 if it doesn't look usable
+static uint64_t clocksource_calibrate_hpet(volatile uint8_t* hpet) {
+    uint32_t period = *(volatile uint32_t*)(hpet + HPET_CAPABILITIES_PERIOD);
+    if (period == 0 || period > HPET_MAX_PERIOD_FS) return 0;
+
+    uint64_t hz = clocksource_div(FEMTOSEC_PER_SEC, period);
+    if (hz >> 32) return 0;
+
+    volatile uint32_t* config = (volatile uint32_t*)(hpet + HPET_CONFIG);
+    volatile uint32_t* counter = (volatile uint32_t*)(hpet + HPET_COUNTER);
+    *config |= HPET_CONFIG_ENABLE;
+
+    // Only the low half of the counter, which may be all there is;
+    // differences survive it wrapping
+    uint32_t target = (uint32_t)hz / 1000 * CLOCKSOURCE_CALIBRATE_MS;
+    uint32_t start = *counter;
+    uint64_t tsc_start = rdtsc();
+    uint32_t elapsed;
+    uint32_t polls = 0;
+    while ((elapsed = *counter - start) < target) {
+        if (++polls == CLOCKSOURCE_MAX_POLLS) return 0;
+    }
+    uint64_t cycles = rdtsc() - tsc_start;
+
+    return clocksource_div(cycles * hz, elapsed);
+}
+
+// The same against a one-shot count on PIT channel 2
+static uint64_t clocksource_calibrate_pit() {
+    uint32_t latch = TIMER_PIT_FREQUENCY / 1000 * CLOCKSOURCE_CALIBRATE_MS;
+
+    uint8_t port_b = port_byte_in(PIT_PORT_B);
+    port_byte_out(PIT_PORT_B, (port_b & ~PIT_PORT_B_SPEAKER) | PIT_PORT_B_GATE2);
+    port_byte_out(PIT_COMMAND, PIT_MODE_ONE_SHOT);
+    port_byte_out(PIT_CHANNEL2, latch & 0xFF);
+    port_byte_out(PIT_CHANNEL2, (latch >> 8) & 0xFF);
+
+    uint64_t tsc_start = rdtsc();
+    uint32_t polls = 0;
+    while (!(port_byte_in(PIT_PORT_B) & PIT_PORT_B_OUT2)) {
+        if (++polls == CLOCKSOURCE_MAX_POLLS) break;
+    }
+    uint64_t cycles = rdtsc() - tsc_start;
+    port_byte_out(PIT_PORT_B, port_b);
+
+    if (polls == CLOCKSOURCE_MAX_POLLS) return 0;
+    return clocksource_div(cycles * TIMER_PIT_FREQUENCY, latch);
+}
+
+void clocksource_init() {
+    uint64_t tsc_hz = 0;
+    volatile uint8_t* hpet = hpet_find();
+    if (hpet && (tsc_hz = clocksource_calibrate_hpet(hpet))) {
+        clocksource_reference = "hpet";
+    } else if ((tsc_hz = clocksource_calibrate_pit())) {
+        clocksource_reference = "pit";
+    } else {
+        // Nothing to measure against; a guess keeps timeouts finite
+        tsc_hz = 1000000000;
+        clocksource_reference = "none";
+    }
+
+    clocksource_tsc_khz = clocksource_div(tsc_hz, 1000);
+    clocksource_mult = clocksource_div((uint64_t)NSEC_PER_MSEC << CLOCKSOURCE_SHIFT, clocksource_tsc_khz);
+    clocksource_base = rdtsc();
+}
+
+// Split so the products stay within 64 bits for any realistic uptime
+uint64_t clocksource_cycles_to_ns(uint64_t cycles) {
+    uint32_t high = cycles >> 32;
+    uint32_t low = cycles;
+    return (((uint64_t)high * clocksource_mult) << (32 - CLOCKSOURCE_SHIFT)) +
+           (((uint64_t)low * clocksource_mult) >> CLOCKSOURCE_SHIFT);
+}
+
+uint64_t ktime_get_ns() {
+    return clocksource_cycles_to_ns(rdtsc() - clocksource_base);
+}
+
+uint32_t ktime_get_ms() {
+    return clocksource_div(ktime_get_ns(), NSEC_PER_MSEC);
+}
+
+uint32_t clocksource_get_tsc_khz() {
+    return clocksource_tsc_khz;
+}
+
+const char* clocksource_get_reference() {
+    return clocksource_reference;
+}
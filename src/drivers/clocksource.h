@@ -0,0 +1,30 @@
+#ifndef CLOCKSOURCE_H
+#define CLOCKSOURCE_H
+
+#include <stdint.h>
+
+// Time is read from the TSC, whose rate is measured once at boot against
+// the HPET where the firmware reports one and the PIT otherwise
+#define CLOCKSOURCE_CALIBRATE_MS 50
+
+#define NSEC_PER_USEC 1000
+#define NSEC_PER_MSEC 1000000
+#define NSEC_PER_SEC 1000000000
+#define USEC_PER_SEC 1000000
+
+// Run before paging is enabled: the ACPI tables and the HPET are read
+// where they physically are
+void clocksource_init();
+
+// Nanoseconds since clocksource_init; never goes backwards
+uint64_t ktime_get_ns();
+uint32_t ktime_get_ms();
+
+uint64_t clocksource_cycles_to_ns(uint64_t cycles);
+uint32_t clocksource_get_tsc_khz();
+const char* clocksource_get_reference();
+
+// 64 by 32 bit division, which there is no libgcc for
+uint64_t clocksource_div(uint64_t dividend, uint32_t divisor);
+
+#endif
@@ -0,0 +1,69 @@
+#include "disk.h"
+#include "ata.h"
+#include "../string/string.h"
+#include <stddef.h>
+
+static struct disk* disks[MAX_DISKS];
+static struct disk ata_disks[2];
+
+static int disk_ata_read(struct disk* disk, uint32_t lba, uint32_t count, void* buf) {
+    return ata_read_sectors(disk->unit, lba, count, (uint16_t*)buf);
+}
+
+static int disk_ata_write(struct disk* disk, uint32_t lba, uint32_t count, const void* buf) {
+    return ata_write_sectors(disk->unit, lba, count, (const uint16_t*)buf);
+}
+
+void disk_init() {
+    memset(disks, 0, sizeof(disks));
+    memset(ata_disks, 0, sizeof(ata_disks));
+    ata_init();
+
+    // Primary channel master and slave are always drives 0 and 1
+    for (int i = 0; i < 2; i++) {
+        ata_disks[i].type = DISK_TYPE_ATA;
+        ata_disks[i].sector_size = DISK_SECTOR_SIZE;
+        ata_disks[i].unit = i;
+        ata_disks[i].read = disk_ata_read;
+        ata_disks[i].write = disk_ata_write;
+        disk_register(&ata_disks[i]);
+    }
+}
+
+int disk_register(struct disk* disk) {
+    for (int i = 0; i < MAX_DISKS; i++) {
+        if (disks[i] == NULL) {
+            disk->id = i;
+            disks[i] = disk;
+            return i;
+        }
+    }
+    return -1;
+}
+
+struct disk* disk_get(int index) {
+    if (index < 0 || index >= MAX_DISKS) return NULL;
+    return disks[index];
+}
+
+int disk_read_sectors(struct disk* disk, uint32_t lba, uint32_t count, void* buf) {
+    if (!disk || !disk->read) return -1;
+    if (count == 0) return 0;
+
+    int res = disk->read(disk, lba, count, buf);
+    disk->stats.reads++;
+    disk->stats.read_sectors += count;
+    if (res != 0) disk->stats.errors++;
+    return res;
+}
+
+int disk_write_sectors(struct disk* disk, uint32_t lba, uint32_t count, const void* buf) {
+    if (!disk || !disk->write) return -1;
+    if (count == 0) return 0;
+
+    int res = disk->write(disk, lba, count, buf);
+    disk->stats.writes++;
+    disk->stats.write_sectors += count;
+    if (res != 0) disk->stats.errors++;
+    return res;
+}
@@ -0,0 +1,50 @@
+#ifndef DISK_H
+#define DISK_H
+
+#include <stdint.h>
+
+#define DISK_SECTOR_SIZE 512
+#define MAX_DISKS 8
+
+typedef unsigned int DISK_TYPE;
+#define DISK_TYPE_ATA 0
+#define DISK_TYPE_RAID0 1
+#define DISK_TYPE_TMPFS 2
+#define DISK_TYPE_INITRAMFS 3
+#define DISK_TYPE_PROCFS 4
+
+struct disk;
+
+// Request counts, kept by disk_read_sectors and disk_write_sectors
+struct disk_stats {
+    uint32_t reads;
+    uint32_t read_sectors;
+    uint32_t writes;
+    uint32_t write_sectors;
+    uint32_t errors;
+};
+
+typedef int (*DISK_READ_FUNCTION)(struct disk* disk, uint32_t lba, uint32_t count, void* buf);
+typedef int (*DISK_WRITE_FUNCTION)(struct disk* disk, uint32_t lba, uint32_t count, const void* buf);
+
+struct disk {
+    int id;
+    DISK_TYPE type;
+    uint32_t sector_size;
+    // Driver specific unit (ATA drive select bit for DISK_TYPE_ATA)
+    int unit;
+    DISK_READ_FUNCTION read;
+    DISK_WRITE_FUNCTION write;
+    // Driver private data (e.g. struct raid0)
+    void* private;
+    void* fs_private;
+    struct disk_stats stats;
+};
+
+void disk_init();
+int disk_register(struct disk* disk);
+struct disk* disk_get(int index);
+int disk_read_sectors(struct disk* disk, uint32_t lba, uint32_t count, void* buf);
+int disk_write_sectors(struct disk* disk, uint32_t lba, uint32_t count, const void* buf);
+
+#endif
@@ -1,13 +1,16 @@
 #include "disk_stream.h"
-#include "ata.h"
+#include "disk.h"
 #include "../memory/heap/kheap.h"
 #include <stddef.h>
 
 struct disk_stream* diskstream_new(int disk_id)
 {
+    struct disk* disk = disk_get(disk_id);
+    if (!disk) return NULL;
+
     struct disk_stream* stream = kmalloc(sizeof(struct disk_stream));
     stream->pos = 0;
-    stream->disk_id = disk_id;
+    stream->disk = disk;
     return stream;
 }
 
@@ -17,17 +20,34 @@ int diskstream_seek(struct disk_stream* stream, uint32_t pos)
     return 0;
 }
 
-int diskstream_read(struct disk_stream* stream, void* out, uint32_t total)
+// Positional access keeps no state between calls, so any number of callers
+// can share a disk without stepping on each other's position
+int diskstream_pread(struct disk* disk, void* out, uint32_t total, uint32_t pos)
 {
-    uint32_t sector = stream->pos / 512;
-    uint32_t offset = stream->pos % 512;
+    uint32_t sector = pos / 512;
+    uint32_t offset = pos % 512;
     char* out_ptr = (char*)out;
     uint32_t total_to_read = total;
 
     while(total_to_read > 0)
     {
+        // Whole sectors go straight into the caller's buffer as one transfer
+        if (offset == 0 && total_to_read >= 512)
+        {
+            uint32_t count = total_to_read / 512;
+            if (disk_read_sectors(disk, sector, count, out_ptr) != 0)
+            {
+                return -1;
+            }
+
+            out_ptr += count * 512;
+            total_to_read -= count * 512;
+            sector += count;
+            continue;
+        }
+
         uint16_t buffer[256];
-        if (ata_read_sector(stream->disk_id, sector, buffer) != 0)
+        if (disk_read_sectors(disk, sector, 1, buffer) != 0)
         {
             return -1;
         }
@@ -48,6 +68,82 @@ int diskstream_read(struct disk_stream* stream, void* out, uint32_t total)
         offset = 0;
     }
 
+    return 0;
+}
+
+int diskstream_pwrite(struct disk* disk, const void* in, uint32_t total, uint32_t pos)
+{
+    uint32_t sector = pos / 512;
+    uint32_t offset = pos % 512;
+    const char* in_ptr = (const char*)in;
+    uint32_t total_to_write = total;
+
+    while(total_to_write > 0)
+    {
+        // Whole sectors are written straight from the caller's buffer
+        if (offset == 0 && total_to_write >= 512)
+        {
+            uint32_t count = total_to_write / 512;
+            if (disk_write_sectors(disk, sector, count, in_ptr) != 0)
+            {
+                return -1;
+            }
+
+            in_ptr += count * 512;
+            total_to_write -= count * 512;
+            sector += count;
+            continue;
+        }
+
+        // Partial sector: read-modify-write
+        uint16_t buffer[256];
+        if (disk_read_sectors(disk, sector, 1, buffer) != 0)
+        {
+            return -1;
+        }
+
+        uint32_t total_written_this_time = 512 - offset;
+        if (total_written_this_time > total_to_write)
+        {
+            total_written_this_time = total_to_write;
+        }
+
+        for (uint32_t i = 0; i < total_written_this_time; i++)
+        {
+            ((char*)buffer)[offset + i] = *in_ptr++;
+        }
+
+        if (disk_write_sectors(disk, sector, 1, buffer) != 0)
+        {
+            return -1;
+        }
+
+        total_to_write -= total_written_this_time;
+        sector++;
+        offset = 0;
+    }
+
+    return 0;
+}
+
+int diskstream_read(struct disk_stream* stream, void* out, uint32_t total)
+{
+    if (diskstream_pread(stream->disk, out, total, stream->pos) != 0)
+    {
+        return -1;
+    }
+
+    stream->pos += total;
+    return 0;
+}
+
+int diskstream_write(struct disk_stream* stream, const void* in, uint32_t total)
+{
+    if (diskstream_pwrite(stream->disk, in, total, stream->pos) != 0)
+    {
+        return -1;
+    }
+
     stream->pos += total;
     return 0;
 }
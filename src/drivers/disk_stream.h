@@ -3,15 +3,22 @@
 
 #include <stdint.h>
 #include <stddef.h>
+#include "disk.h"
 
+// Sequential access through a private position. Shared state should use
+// diskstream_pread/diskstream_pwrite instead.
 struct disk_stream {
     uint32_t pos;
-    int disk_id;
+    struct disk* disk;
 };
 
 struct disk_stream* diskstream_new(int disk_id);
 int diskstream_seek(struct disk_stream* stream, uint32_t pos);
 int diskstream_read(struct disk_stream* stream, void* out, uint32_t total);
+int diskstream_write(struct disk_stream* stream, const void* in, uint32_t total);
 void diskstream_close(struct disk_stream* stream);
 
+int diskstream_pread(struct disk* disk, void* out, uint32_t total, uint32_t pos);
+int diskstream_pwrite(struct disk* disk, const void* in, uint32_t total, uint32_t pos);
+
 #endif
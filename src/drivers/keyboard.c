@@ -3,6 +3,9 @@
 #include "ports.h"
 #include "screen.h"
 #include "../string/string.h"
+#include "../task/wait.h"
+#include "../task/task.h"
+#include "../cpu/cpu.h"
 
 #define BUFFER_SIZE 256
 static char keyboard_buffer[BUFFER_SIZE];
@@ -10,6 +13,12 @@ static int buffer_head = 0;
 static int buffer_tail = 0;
 static bool shift_active = false;
 
+// Readers asleep in keyboard_getc
+static struct wait_queue keyboard_readers;
+
+// Foreground task, or NULL when the console is the shell's
+static struct task* keyboard_owner = NULL;
+
 static const char scancode_ascii[] = {
     0,  27, '1', '2', '3', '4', '5', '6', '7', '8', '9', '0', '-', '=', '\b',
     '\t', 'q', 'w', 'e', 'r', 't', 'y', 'u', 'i', 'o', 'p', '[', ']', '\n',
@@ -34,6 +43,7 @@ static const char scancode_ascii_shift[] = {
 
 void keyboard_init() {
     ps2_init();
+    wait_queue_init(&keyboard_readers);
     register_interrupt_handler(33, keyboard_handler);
 }
 
@@ -55,23 +65,34 @@ void keyboard_handler(registers_t *regs) {
 
         if (scancode < sizeof(scancode_ascii)) {
             char c = shift_active ? scancode_ascii_shift[scancode] : scancode_ascii[scancode];
-            if (c != 0) {
-                // Add to buffer
-                int next = (buffer_head + 1) % BUFFER_SIZE;
-                if (next != buffer_tail) {
-                    keyboard_buffer[buffer_head] = c;
-                    buffer_head = next;
-                }
-            }
+            keyboard_push(c);
         }
     }
 }
 
+void keyboard_set_owner(struct task* task) {
+    uint32_t flags = interrupts_save();
+    keyboard_owner = task;
+    wait_wake_all(&keyboard_readers);
+    interrupts_restore(flags);
+}
+
+void keyboard_release(struct task* task) {
+    if (keyboard_owner == task) keyboard_set_owner(NULL);
+}
+
+bool keyboard_is_owner(struct task* task) {
+    return keyboard_owner == task;
+}
+
 char keyboard_getc() {
-    while (buffer_head == buffer_tail) {
-        // Wait for key press (Busy wait for now in this simple kernel)
-        __asm__ __volatile__("hlt");
+    // Sleep until a key arrives and the console is ours; the check and the
+    // sleep happen with interrupts off so the wakeup can't come in between
+    __asm__ __volatile__("cli");
+    while (buffer_head == buffer_tail || (keyboard_owner && keyboard_owner != task_current())) {
+        wait_sleep(&keyboard_readers);
     }
+    __asm__ __volatile__("sti");
     
     char c = keyboard_buffer[buffer_tail];
     buffer_tail = (buffer_tail + 1) % BUFFER_SIZE;
@@ -84,5 +105,6 @@ void keyboard_push(char c) {
     if (next != buffer_tail) {
         keyboard_buffer[buffer_head] = c;
         buffer_head = next;
+        wait_wake_all(&keyboard_readers);
     }
 }
@@ -3,6 +3,7 @@
 
 #include "../cpu/types.h"
 #include "../cpu/isr.h"
+#include <stdbool.h>
 
 #define KEY_DELETE 0x7F
 #define LSHIFT 0x2A
@@ -13,4 +14,11 @@ void keyboard_handler(registers_t *regs);
 char keyboard_getc();
 void keyboard_push(char c);
 
+// The console has one reader at a time: the task given it here, or the
+// shell while no task has it. Freeing the task hands it back.
+struct task;
+void keyboard_set_owner(struct task* task);
+void keyboard_release(struct task* task);
+bool keyboard_is_owner(struct task* task);
+
 #endif
@@ -0,0 +1,84 @@
+#include "raid0.h"
+#include "../memory/heap/kheap.h"
+#include "../string/string.h"
+#include <stddef.h>
+
+static int raid0_transfer(struct raid0* raid, uint32_t lba, uint32_t count, char* buf, int write) {
+    uint32_t n = raid->member_count;
+    uint32_t first_chunk = lba >> raid->chunk_shift;
+    uint32_t last_chunk = (lba + count - 1) >> raid->chunk_shift;
+
+    // The chunks a request touches on one member are consecutive on that
+    // member, so walk member by member and keep each member's commands back
+    // to back instead of bouncing between drives on every chunk.
+    for (uint32_t m = 0; m < n; m++) {
+        struct raid0_member* member = &raid->members[m];
+        uint32_t chunk = first_chunk + (m + n - (first_chunk % n)) % n;
+
+        for (; chunk <= last_chunk; chunk += n) {
+            uint32_t chunk_lba = chunk << raid->chunk_shift;
+            uint32_t start = chunk_lba > lba ? chunk_lba : lba;
+            uint32_t end = chunk_lba + raid->chunk_sectors;
+            if (end > lba + count) end = lba + count;
+
+            uint32_t member_lba = member->start_lba + ((chunk / n) << raid->chunk_shift) + (start - chunk_lba);
+            char* ptr = buf + (start - lba) * DISK_SECTOR_SIZE;
+
+            int res = write ? disk_write_sectors(member->disk, member_lba, end - start, ptr)
+                            : disk_read_sectors(member->disk, member_lba, end - start, ptr);
+            if (res != 0) return res;
+        }
+    }
+
+    return 0;
+}
+
+static int raid0_read(struct disk* disk, uint32_t lba, uint32_t count, void* buf) {
+    return raid0_transfer(disk->private, lba, count, buf, 0);
+}
+
+static int raid0_write(struct disk* disk, uint32_t lba, uint32_t count, const void* buf) {
+    return raid0_transfer(disk->private, lba, count, (char*)buf, 1);
+}
+
+int raid0_init(struct raid0* raid, struct raid0_member* members, int count, uint32_t chunk_sectors) {
+    if (count <= 0 || count > RAID0_MAX_MEMBERS) return -1;
+
+    // Chunk size must be a power of two so LBAs split with shifts
+    if (chunk_sectors == 0 || (chunk_sectors & (chunk_sectors - 1)) != 0) return -2;
+
+    for (int i = 0; i < count; i++) {
+        if (!members[i].disk || !members[i].disk->read) return -3;
+        if (members[i].disk->sector_size != DISK_SECTOR_SIZE) return -4;
+    }
+
+    memset(raid, 0, sizeof(struct raid0));
+    raid->chunk_sectors = chunk_sectors;
+    while ((1U << raid->chunk_shift) < chunk_sectors) raid->chunk_shift++;
+    raid->member_count = count;
+    memcpy(raid->members, members, sizeof(struct raid0_member) * count);
+
+    raid->disk.type = DISK_TYPE_RAID0;
+    raid->disk.sector_size = DISK_SECTOR_SIZE;
+    raid->disk.read = raid0_read;
+    raid->disk.write = raid0_write;
+    raid->disk.private = raid;
+    return 0;
+}
+
+struct disk* raid0_create(struct raid0_member* members, int count, uint32_t chunk_sectors) {
+    struct raid0* raid = kmalloc(sizeof(struct raid0));
+    if (!raid) return NULL;
+
+    if (raid0_init(raid, members, count, chunk_sectors) != 0) {
+        kfree(raid);
+        return NULL;
+    }
+
+    if (disk_register(&raid->disk) < 0) {
+        kfree(raid);
+        return NULL;
+    }
+
+    return &raid->disk;
+}
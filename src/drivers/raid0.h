@@ -0,0 +1,26 @@
+#ifndef RAID0_H
+#define RAID0_H
+
+#include <stdint.h>
+#include "disk.h"
+
+#define RAID0_MAX_MEMBERS 8
+
+struct raid0_member {
+    struct disk* disk;
+    // First sector of the member's slice of the array
+    uint32_t start_lba;
+};
+
+struct raid0 {
+    struct disk disk;
+    uint32_t chunk_sectors;
+    uint32_t chunk_shift;
+    int member_count;
+    struct raid0_member members[RAID0_MAX_MEMBERS];
+};
+
+int raid0_init(struct raid0* raid, struct raid0_member* members, int count, uint32_t chunk_sectors);
+struct disk* raid0_create(struct raid0_member* members, int count, uint32_t chunk_sectors);
+
+#endif
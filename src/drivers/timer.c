@@ -0,0 +1,50 @@
+#include "timer.h"
+#include "ports.h"
+#include "../cpu/isr.h"
+#include "../task/task.h"
+
+#define PIT_CHANNEL0 0x40
+#define PIT_COMMAND 0x43
+
+// Channel 0, low byte then high byte, mode 3 (square wave)
+#define PIT_MODE_SQUARE_WAVE 0x36
+
+static volatile uint32_t timer_ticks = 0;
+static uint32_t timer_hz = 0;
+
+static void timer_irq(registers_t* regs) {
+    timer_ticks++;
+    task_tick(regs);
+}
+
+void timer_init(uint32_t hz) {
+    register_interrupt_handler(32, timer_irq);
+    timer_set_frequency(hz);
+}
+
+int timer_set_frequency(uint32_t hz) {
+    if (hz < TIMER_MIN_HZ || hz > TIMER_MAX_HZ) return -1;
+
+    uint32_t divisor = TIMER_PIT_FREQUENCY / hz;
+    uint32_t flags;
+    __asm__ __volatile__("pushf; pop %0; cli" : "=r"(flags) : : "memory");
+    port_byte_out(PIT_COMMAND, PIT_MODE_SQUARE_WAVE);
+    port_byte_out(PIT_CHANNEL0, divisor & 0xFF);
+    port_byte_out(PIT_CHANNEL0, (divisor >> 8) & 0xFF);
+    timer_hz = hz;
+    __asm__ __volatile__("push %0; popf" : : "r"(flags) : "memory", "cc");
+    return 0;
+}
+
+uint32_t timer_get_frequency() {
+    return timer_hz;
+}
+
+uint32_t timer_get_ticks() {
+    return timer_ticks;
+}
+
+// Rounded up, so a short wait still lasts a tick
+uint32_t timer_ms_to_ticks(uint32_t ms) {
+    return ms / 1000 * timer_hz + ((ms % 1000) * timer_hz + 999) / 1000;
+}
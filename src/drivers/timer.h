@@ -0,0 +1,20 @@
+#ifndef TIMER_H
+#define TIMER_H
+
+#include <stdint.h>
+
+// The PIT's input clock; rates are derived by dividing it down
+#define TIMER_PIT_FREQUENCY 1193182
+
+// Tick rate at boot. The 16-bit divisor bounds what can be asked for.
+#define TIMER_HZ 100
+#define TIMER_MIN_HZ 19
+#define TIMER_MAX_HZ 10000
+
+void timer_init(uint32_t hz);
+int timer_set_frequency(uint32_t hz);
+uint32_t timer_get_frequency();
+uint32_t timer_get_ticks();
+uint32_t timer_ms_to_ticks(uint32_t ms);
+
+#endif
@@ -0,0 +1,191 @@
+#include "dcache.h"
+#include "../string/string.h"
+#include "../task/lock.h"
+#include <stddef.h>
+
+static struct dcache_entry entries[DCACHE_ENTRIES];
+static struct dcache_entry* buckets[DCACHE_BUCKETS];
+
+// Most recently used at the head, eviction from the tail
+static struct dcache_entry* lru_head = NULL;
+static struct dcache_entry* lru_tail = NULL;
+
+static struct dcache_stats stats;
+
+// Filesystems look names up under shared locks, so lookups from several
+// tasks can land here at once
+static struct spinlock lock;
+
+static uint32_t dcache_hash(int disk_id, uint32_t parent, const uint8_t* name) {
+    // FNV-1a
+    uint32_t hash = 2166136261U;
+    for (int i = 0; i < DCACHE_NAME_LEN; i++) {
+        hash = (hash ^ name[i]) * 16777619U;
+    }
+    hash = (hash ^ parent) * 16777619U;
+    hash = (hash ^ (uint32_t)disk_id) * 16777619U;
+    return hash % DCACHE_BUCKETS;
+}
+
+static void dcache_lru_unlink(struct dcache_entry* entry) {
+    if (entry->lru_prev) entry->lru_prev->lru_next = entry->lru_next;
+    if (entry->lru_next) entry->lru_next->lru_prev = entry->lru_prev;
+    if (entry == lru_head) lru_head = entry->lru_next;
+    if (entry == lru_tail) lru_tail = entry->lru_prev;
+    entry->lru_prev = NULL;
+    entry->lru_next = NULL;
+}
+
+static void dcache_lru_push_front(struct dcache_entry* entry) {
+    entry->lru_prev = NULL;
+    entry->lru_next = lru_head;
+    if (lru_head) lru_head->lru_prev = entry;
+    lru_head = entry;
+    if (!lru_tail) lru_tail = entry;
+}
+
+static void dcache_hash_unlink(struct dcache_entry* entry) {
+    struct dcache_entry** link = &buckets[dcache_hash(entry->disk_id, entry->parent, entry->name)];
+    while (*link) {
+        if (*link == entry) {
+            *link = entry->hash_next;
+            break;
+        }
+        link = &(*link)->hash_next;
+    }
+    entry->hash_next = NULL;
+}
+
+// Drop an entry from its hash chain and move it to the LRU tail for reuse
+static void dcache_release(struct dcache_entry* entry) {
+    dcache_hash_unlink(entry);
+    entry->disk_id = -1;
+    dcache_lru_unlink(entry);
+    entry->lru_prev = lru_tail;
+    if (lru_tail) lru_tail->lru_next = entry;
+    lru_tail = entry;
+    if (!lru_head) lru_head = entry;
+}
+
+static struct dcache_entry* dcache_find(int disk_id, uint32_t parent, const uint8_t* name) {
+    struct dcache_entry* entry = buckets[dcache_hash(disk_id, parent, name)];
+    while (entry) {
+        if (entry->disk_id == disk_id && entry->parent == parent &&
+            memcmp(entry->name, name, DCACHE_NAME_LEN) == 0) {
+            return entry;
+        }
+        entry = entry->hash_next;
+    }
+    return NULL;
+}
+
+void dcache_init() {
+    memset(entries, 0, sizeof(entries));
+    memset(buckets, 0, sizeof(buckets));
+    memset(&stats, 0, sizeof(stats));
+    lru_head = NULL;
+    lru_tail = NULL;
+    spinlock_init(&lock);
+
+    for (int i = 0; i < DCACHE_ENTRIES; i++) {
+        entries[i].disk_id = -1;
+        dcache_lru_push_front(&entries[i]);
+    }
+}
+
+int dcache_lookup(struct disk* disk, uint32_t parent, const uint8_t* name, void* out, uint32_t size) {
+    int res = DCACHE_HIT;
+    spin_lock(&lock);
+
+    struct dcache_entry* entry = dcache_find(disk->id, parent, name);
+    if (!entry) {
+        stats.misses++;
+        res = DCACHE_MISS;
+        goto out;
+    }
+
+    dcache_lru_unlink(entry);
+    dcache_lru_push_front(entry);
+
+    if (entry->negative) {
+        stats.negative_hits++;
+        res = DCACHE_HIT_NEGATIVE;
+        goto out;
+    }
+
+    if (size > DCACHE_DATA_SIZE) size = DCACHE_DATA_SIZE;
+    memcpy(out, entry->data, size);
+    stats.hits++;
+
+out:
+    spin_unlock(&lock);
+    return res;
+}
+
+// Cache a lookup result, or a negative entry when data is NULL
+void dcache_insert(struct disk* disk, uint32_t parent, const uint8_t* name, const void* data, uint32_t size) {
+    spin_lock(&lock);
+    struct dcache_entry* entry = dcache_find(disk->id, parent, name);
+    if (entry) {
+        dcache_lru_unlink(entry);
+    } else {
+        entry = lru_tail;
+        if (!entry) {
+            spin_unlock(&lock);
+            return;
+        }
+        dcache_lru_unlink(entry);
+        if (entry->disk_id >= 0) dcache_hash_unlink(entry);
+
+        entry->disk_id = disk->id;
+        entry->parent = parent;
+        memcpy(entry->name, name, DCACHE_NAME_LEN);
+
+        uint32_t bucket = dcache_hash(disk->id, parent, name);
+        entry->hash_next = buckets[bucket];
+        buckets[bucket] = entry;
+    }
+
+    entry->negative = (data == NULL);
+    memset(entry->data, 0, DCACHE_DATA_SIZE);
+    if (data) {
+        if (size > DCACHE_DATA_SIZE) size = DCACHE_DATA_SIZE;
+        memcpy(entry->data, data, size);
+    }
+
+    dcache_lru_push_front(entry);
+    spin_unlock(&lock);
+}
+
+void dcache_invalidate(struct disk* disk, uint32_t parent, const uint8_t* name) {
+    spin_lock(&lock);
+    struct dcache_entry* entry = dcache_find(disk->id, parent, name);
+    if (entry) dcache_release(entry);
+    spin_unlock(&lock);
+}
+
+void dcache_invalidate_dir(struct disk* disk, uint32_t parent) {
+    spin_lock(&lock);
+    for (int i = 0; i < DCACHE_ENTRIES; i++) {
+        if (entries[i].disk_id == disk->id && entries[i].parent == parent) {
+            dcache_release(&entries[i]);
+        }
+    }
+    spin_unlock(&lock);
+}
+
+void dcache_invalidate_disk(struct disk* disk) {
+    spin_lock(&lock);
+    for (int i = 0; i < DCACHE_ENTRIES; i++) {
+        if (entries[i].disk_id == disk->id) {
+            dcache_release(&entries[i]);
+        }
+    }
+    spin_unlock(&lock);
+}
+
+void dcache_get_stats(struct dcache_stats* out) {
+    spin_lock(&lock);
+    *out = stats;
+    spin_unlock(&lock);
+}
@@ -0,0 +1,46 @@
+#ifndef DCACHE_H
+#define DCACHE_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "../drivers/disk.h"
+
+// Names are cached in their packed on-disk form (FAT 8.3: 8 + 3 bytes,
+// upper case, space padded) so a lookup is a hash and an 11 byte compare
+#define DCACHE_NAME_LEN 11
+// Large enough for a FAT16 directory entry plus its position on disk
+#define DCACHE_DATA_SIZE 36
+#define DCACHE_BUCKETS 64
+#define DCACHE_ENTRIES 256
+
+#define DCACHE_MISS 0
+#define DCACHE_HIT 1
+#define DCACHE_HIT_NEGATIVE 2
+
+struct dcache_entry {
+    int disk_id;
+    uint32_t parent; // Filesystem specific directory id (FAT16: first cluster)
+    uint8_t name[DCACHE_NAME_LEN];
+    bool negative;
+    uint8_t data[DCACHE_DATA_SIZE];
+
+    struct dcache_entry* hash_next;
+    struct dcache_entry* lru_prev;
+    struct dcache_entry* lru_next;
+};
+
+struct dcache_stats {
+    uint32_t hits;
+    uint32_t negative_hits;
+    uint32_t misses;
+};
+
+void dcache_init();
+int dcache_lookup(struct disk* disk, uint32_t parent, const uint8_t* name, void* out, uint32_t size);
+void dcache_insert(struct disk* disk, uint32_t parent, const uint8_t* name, const void* data, uint32_t size);
+void dcache_invalidate(struct disk* disk, uint32_t parent, const uint8_t* name);
+void dcache_invalidate_dir(struct disk* disk, uint32_t parent);
+void dcache_invalidate_disk(struct disk* disk);
+void dcache_get_stats(struct dcache_stats* stats);
+
+#endif
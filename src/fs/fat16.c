@@ -1,6 +1,8 @@
 #include "fat16.h"
 #include "file.h"
 #include "path_parser.h"
+#include "dcache.h"
+#include "pagecache.h"
 #include "../drivers/disk_stream.h"
 #include "../memory/heap/kheap.h"
 #include "../string/string.h"
@@ -9,17 +11,32 @@
 
 void* fat16_open(struct disk* disk, struct path_part* path, FILE_MODE mode);
 
+// Volume state of each resolved drive, kept until it is unmounted so
+// resolving it again doesn't allocate (and lose) another FAT cache
+static struct fat_private* fat16_volumes[MAX_DISKS];
+
 struct filesystem* fat16_init_vfs() {
     static struct filesystem fat16_fs = {
         .name = "FAT16",
         .resolve = fat16_resolve,
+        .unmount = fat16_unmount,
         .open = fat16_open,
         .read = (FS_READ_FUNCTION)fat16_read,
         .seek = (FS_SEEK_FUNCTION)fat16_seek,
         .tell = (FS_TELL_FUNCTION)fat16_tell,
         .close = (FS_CLOSE_FUNCTION)fat16_close,
         .stat = (FS_STAT_FUNCTION)fat16_stat,
-        .list = (FS_LIST_FUNCTION)fat16_list
+        .opendir = (FS_OPENDIR_FUNCTION)fat16_opendir,
+        .readdir = (FS_READDIR_FUNCTION)fat16_readdir,
+        .closedir = (FS_CLOSEDIR_FUNCTION)fat16_closedir,
+        .write = (FS_WRITE_FUNCTION)fat16_write,
+        .truncate = (FS_TRUNCATE_FUNCTION)fat16_truncate,
+        .fallocate = (FS_FALLOCATE_FUNCTION)fat16_fallocate,
+        .unlink = (FS_UNLINK_FUNCTION)fat16_unlink,
+        .pread = (FS_PREAD_FUNCTION)fat16_pread,
+        .pwrite = (FS_PWRITE_FUNCTION)fat16_pwrite,
+        .preadv = (FS_PREADV_FUNCTION)fat16_preadv,
+        .pwritev = (FS_PWRITEV_FUNCTION)fat16_pwritev
     };
     return &fat16_fs;
 }
@@ -48,49 +65,350 @@ void fat16_get_full_relative_filename(struct fat_directory_item* item, char* out
     }
 }
 
-static uint32_t fat16_get_fat_entry(struct disk* disk, uint32_t cluster) {
+static uint16_t* fat16_load_fat_sector(struct disk* disk, uint32_t sector) {
     struct fat_private* private = disk->fs_private;
-    uint32_t fat_table_sector = private->bpb.reserved_sectors;
-    uint32_t fat_table_offset = cluster * FAT16_ENTRY_SIZE;
-    uint32_t fat_table_abs_pos = (fat_table_sector * private->bpb.bytes_per_sector) + fat_table_offset;
-    
-    diskstream_seek(private->stream, fat_table_abs_pos);
-    
-    uint16_t entry = 0;
-    if (diskstream_read(private->stream, &entry, sizeof(entry)) != 0) {
+    uint32_t entries_per_sector = private->fat_entries_per_sector;
+    uint16_t* cached = private->fat_cache + sector * entries_per_sector;
+
+    if (!(private->fat_loaded[sector / 32] & (1U << (sector % 32)))) {
+        if (disk_read_sectors(disk, private->bpb.reserved_sectors + sector, 1, cached) != 0) {
+            return NULL;
+        }
+
+        // Readers sharing the mount lock may page in the same sector at
+        // once; they read identical bytes, so only the bit needs guarding
+        spin_lock(&private->fat_lock);
+        private->fat_loaded[sector / 32] |= 1U << (sector % 32);
+        spin_unlock(&private->fat_lock);
+    }
+
+    return cached;
+}
+
+uint32_t fat16_get_fat_entry(struct disk* disk, uint32_t cluster) {
+    struct fat_private* private = disk->fs_private;
+    uint32_t entries_per_sector = private->fat_entries_per_sector;
+    uint32_t sector = cluster / entries_per_sector;
+
+    if (sector >= private->bpb.fat_sectors) {
         return 0xFFFF; // Error
     }
-    
-    return entry;
+
+    if (private->fat_loaded[sector / 32] & (1U << (sector % 32))) {
+        return private->fat_cache[cluster];
+    }
+
+    if (!fat16_load_fat_sector(disk, sector)) {
+        return 0xFFFF; // Error
+    }
+
+    return private->fat_cache[cluster];
 }
 
-static uint32_t fat16_get_cluster_for_offset(struct disk* disk, uint32_t start_cluster, uint32_t offset) {
+int fat16_set_fat_entry(struct disk* disk, uint32_t cluster, uint16_t value) {
     struct fat_private* private = disk->fs_private;
-    uint32_t cluster_size = private->bpb.sectors_per_cluster * private->bpb.bytes_per_sector;
-    uint32_t clusters_to_skip = offset / cluster_size;
-    uint32_t current_cluster = start_cluster;
-    
-    for (uint32_t i = 0; i < clusters_to_skip; i++) {
-        current_cluster = fat16_get_fat_entry(disk, current_cluster);
-        if (current_cluster >= FAT16_CLUSTER_LAST_MIN) {
-            return 0xFFFF; // End of chain
+    uint32_t entries_per_sector = private->fat_entries_per_sector;
+    uint32_t sector = cluster / entries_per_sector;
+
+    if (sector >= private->bpb.fat_sectors) return -1;
+    if (!fat16_load_fat_sector(disk, sector)) return -2;
+
+    private->fat_cache[cluster] = value;
+    private->fat_dirty[sector / 32] |= 1U << (sector % 32);
+
+    // Keep the free-cluster bitmap in step once it has been built
+    if (private->free_bitmap && cluster >= 2 && cluster < private->total_clusters + 2) {
+        uint32_t bit = 1U << (cluster % 32);
+        bool used = private->free_bitmap[cluster / 32] & bit;
+        if (value == FAT16_CLUSTER_FREE && used) {
+            private->free_bitmap[cluster / 32] &= ~bit;
+            private->free_clusters++;
+        } else if (value != FAT16_CLUSTER_FREE && !used) {
+            private->free_bitmap[cluster / 32] |= bit;
+            private->free_clusters--;
         }
     }
-    
-    return current_cluster;
+    return 0;
+}
+
+// Build the free-cluster bitmap from the FAT. Done on the first allocation
+// so volumes that are only ever read don't page in the whole table.
+static int fat16_load_free_bitmap(struct disk* disk) {
+    struct fat_private* private = disk->fs_private;
+    if (private->free_bitmap) return 0;
+
+    uint32_t last = private->total_clusters + 2;
+    uint32_t words = (last + 31) / 32;
+    uint32_t* bitmap = kmalloc(words * sizeof(uint32_t));
+    if (!bitmap) return -1;
+    memset(bitmap, 0, words * sizeof(uint32_t));
+
+    uint32_t free_clusters = 0;
+    for (uint32_t cluster = 0; cluster < words * 32; cluster++) {
+        // Reserved clusters 0 and 1, and bits past the end, read as used
+        if (cluster >= 2 && cluster < last && fat16_get_fat_entry(disk, cluster) == FAT16_CLUSTER_FREE) {
+            free_clusters++;
+            continue;
+        }
+        bitmap[cluster / 32] |= 1U << (cluster % 32);
+    }
+
+    private->free_bitmap = bitmap;
+    private->free_clusters = free_clusters;
+    return 0;
+}
+
+static bool fat16_cluster_in_use(struct fat_private* private, uint32_t cluster) {
+    return private->free_bitmap[cluster / 32] & (1U << (cluster % 32));
+}
+
+// Find free clusters for an allocation of `count`, searching from `goal` and
+// wrapping around. The first run long enough wins; failing that the longest
+// run seen is returned so the caller can take it and search again.
+static uint32_t fat16_find_free_run(struct fat_private* private, uint32_t goal, uint32_t count, uint32_t* length) {
+    uint32_t last = private->total_clusters + 2;
+    uint32_t best = 0;
+    uint32_t best_length = 0;
+
+    if (goal < 2 || goal >= last) goal = 2;
+
+    for (int pass = 0; pass < 2; pass++) {
+        uint32_t cluster = pass == 0 ? goal : 2;
+        uint32_t end = pass == 0 ? last : goal;
+
+        while (cluster < end) {
+            // Step over fully used words 32 clusters at a time
+            if ((cluster % 32) == 0 && private->free_bitmap[cluster / 32] == 0xFFFFFFFF) {
+                cluster += 32;
+                continue;
+            }
+            if (fat16_cluster_in_use(private, cluster)) {
+                cluster++;
+                continue;
+            }
+
+            uint32_t start = cluster;
+            while (cluster < end && cluster - start < count && !fat16_cluster_in_use(private, cluster)) {
+                cluster++;
+            }
+
+            uint32_t run = cluster - start;
+            if (run == count) {
+                *length = count;
+                return start;
+            }
+            if (run > best_length) {
+                best = start;
+                best_length = run;
+            }
+        }
+    }
+
+    *length = best_length;
+    return best;
+}
+
+// Release every cluster of the chain starting at `cluster`
+static int fat16_free_chain(struct disk* disk, uint32_t cluster) {
+    struct fat_private* private = disk->fs_private;
+
+    // Bounded by the cluster count so a corrupt, looping chain terminates
+    for (uint32_t i = 0; i < private->total_clusters; i++) {
+        if (cluster < 2 || cluster >= FAT16_CLUSTER_RESERVED_MIN) break;
+        uint32_t next = fat16_get_fat_entry(disk, cluster);
+        if (fat16_set_fat_entry(disk, cluster, FAT16_CLUSTER_FREE) != 0) return -1;
+        cluster = next;
+    }
+
+    return 0;
+}
+
+int fat16_flush_fat(struct disk* disk) {
+    struct fat_private* private = disk->fs_private;
+    uint32_t entries_per_sector = private->fat_entries_per_sector;
+
+    for (uint32_t sector = 0; sector < private->bpb.fat_sectors; sector++) {
+        if (!(private->fat_dirty[sector / 32] & (1U << (sector % 32)))) continue;
+
+        uint16_t* cached = private->fat_cache + sector * entries_per_sector;
+        for (uint32_t copy = 0; copy < private->bpb.fat_copies; copy++) {
+            uint32_t lba = private->bpb.reserved_sectors + copy * private->bpb.fat_sectors + sector;
+            if (disk_write_sectors(disk, lba, 1, cached) != 0) return -1;
+        }
+        private->fat_dirty[sector / 32] &= ~(1U << (sector % 32));
+    }
+
+    return 0;
+}
+
+static int fat16_add_extent(struct fat_inode* inode, uint32_t disk_cluster) {
+    if (inode->extent_count > 0) {
+        struct fat_extent* last = &inode->extents[inode->extent_count - 1];
+        if (last->disk_cluster + last->length == disk_cluster) {
+            last->length++;
+            inode->mapped_clusters++;
+            return 0;
+        }
+    }
+
+    if (inode->extent_count == inode->extent_capacity) {
+        uint32_t capacity = inode->extent_capacity ? inode->extent_capacity * 2 : 4;
+        struct fat_extent* extents = kmalloc(capacity * sizeof(struct fat_extent));
+        if (!extents) return -1;
+        if (inode->extents) {
+            memcpy(extents, inode->extents, inode->extent_count * sizeof(struct fat_extent));
+            kfree(inode->extents);
+        }
+        inode->extents = extents;
+        inode->extent_capacity = capacity;
+    }
+
+    struct fat_extent* extent = &inode->extents[inode->extent_count++];
+    extent->file_cluster = inode->mapped_clusters;
+    extent->disk_cluster = disk_cluster;
+    extent->length = 1;
+    inode->mapped_clusters++;
+    return 0;
+}
+
+// Extend the extent map until it covers file cluster index `target`
+static int fat16_map_extents(struct disk* disk, struct fat_inode* inode, uint32_t target) {
+    while (inode->mapped_clusters <= target && !inode->extents_complete) {
+        uint32_t next;
+        if (inode->extent_count == 0) {
+            next = inode->item.low_16_bits_first_cluster;
+        } else {
+            struct fat_extent* last = &inode->extents[inode->extent_count - 1];
+            next = fat16_get_fat_entry(disk, last->disk_cluster + last->length - 1);
+        }
+
+        if (next < 2 || next >= FAT16_CLUSTER_RESERVED_MIN) {
+            inode->extents_complete = true;
+            break;
+        }
+
+        if (fat16_add_extent(inode, next) != 0) return -1;
+    }
+
+    return inode->mapped_clusters > target ? 0 : -1;
+}
+
+// Map a file offset to its disk cluster. If run is not NULL it receives the
+// number of physically contiguous clusters starting at that cluster. Only
+// looks at the extent map, which the caller must have extended far enough,
+// so it is safe under a shared inode lock.
+static uint32_t fat16_get_cluster_for_offset(struct disk* disk, struct fat_inode* inode, uint32_t offset, uint32_t* run) {
+    struct fat_private* private = disk->fs_private;
+    uint32_t file_cluster = offset >> private->cluster_shift;
+
+    if (file_cluster >= inode->mapped_clusters) {
+        return 0xFFFF; // End of chain
+    }
+
+    // Binary search for the run containing file_cluster
+    uint32_t lo = 0;
+    uint32_t hi = inode->extent_count;
+    while (hi - lo > 1) {
+        uint32_t mid = (lo + hi) / 2;
+        if (inode->extents[mid].file_cluster <= file_cluster) {
+            lo = mid;
+        } else {
+            hi = mid;
+        }
+    }
+
+    struct fat_extent* extent = &inode->extents[lo];
+    if (run) {
+        *run = extent->length - (file_cluster - extent->file_cluster);
+    }
+    return extent->disk_cluster + (file_cluster - extent->file_cluster);
+}
+
+// Append `count` clusters to the file, taking the longest free runs the
+// volume has so the file stays as contiguous as possible
+static int fat16_extend_chain(struct disk* disk, struct fat_inode* inode, uint32_t count) {
+    struct fat_private* private = disk->fs_private;
+    if (fat16_load_free_bitmap(disk) != 0) return -1;
+    if (count > private->free_clusters) return -2; // Volume full
+
+    fat16_map_extents(disk, inode, 0xFFFFFFFF);
+    if (!inode->extents_complete) return -1;
+
+    uint32_t tail = 0;
+    if (inode->extent_count > 0) {
+        struct fat_extent* last = &inode->extents[inode->extent_count - 1];
+        tail = last->disk_cluster + last->length - 1;
+    }
+
+    while (count > 0) {
+        uint32_t length = 0;
+        uint32_t start = fat16_find_free_run(private, tail + 1, count, &length);
+        if (start == 0) return -2;
+
+        for (uint32_t i = 0; i < length; i++) {
+            uint32_t next = i + 1 < length ? start + i + 1 : FAT16_CLUSTER_LAST_MAX;
+            if (fat16_set_fat_entry(disk, start + i, next) != 0) return -3;
+            if (fat16_add_extent(inode, start + i) != 0) return -4;
+        }
+
+        if (tail) {
+            if (fat16_set_fat_entry(disk, tail, start) != 0) return -3;
+        } else {
+            inode->item.low_16_bits_first_cluster = start;
+        }
+
+        tail = start + length - 1;
+        count -= length;
+    }
+
+    return 0;
+}
+
+// Cut the chain after its first `keep` clusters and free the rest
+static int fat16_truncate_chain(struct disk* disk, struct fat_inode* inode, uint32_t keep) {
+    struct fat_private* private = disk->fs_private;
+
+    fat16_map_extents(disk, inode, 0xFFFFFFFF);
+    if (!inode->extents_complete) return -1;
+    if (keep >= inode->mapped_clusters) return 0;
+
+    uint32_t first_freed;
+    if (keep == 0) {
+        first_freed = inode->item.low_16_bits_first_cluster;
+        inode->item.low_16_bits_first_cluster = 0;
+    } else {
+        uint32_t last = fat16_get_cluster_for_offset(disk, inode, (keep - 1) << private->cluster_shift, NULL);
+        first_freed = fat16_get_fat_entry(disk, last);
+        if (fat16_set_fat_entry(disk, last, FAT16_CLUSTER_LAST_MAX) != 0) return -2;
+    }
+
+    if (fat16_free_chain(disk, first_freed) != 0) return -2;
+
+    // Drop the extents past the new end
+    while (inode->extent_count > 0) {
+        struct fat_extent* extent = &inode->extents[inode->extent_count - 1];
+        if (extent->file_cluster >= keep) {
+            inode->extent_count--;
+            continue;
+        }
+        if (extent->file_cluster + extent->length > keep) {
+            extent->length = keep - extent->file_cluster;
+        }
+        break;
+    }
+    inode->mapped_clusters = keep;
+    return 0;
 }
 
 // Logic to convert cluster to absolute sector
 uint32_t fat16_cluster_to_sector(struct disk* disk, uint32_t cluster) {
     struct fat_private* private = disk->fs_private;
-    uint32_t root_dir_sectors = ((private->bpb.root_dir_entries * 32) + (private->bpb.bytes_per_sector - 1)) / private->bpb.bytes_per_sector;
-    uint32_t first_data_sector = private->bpb.reserved_sectors + (private->bpb.fat_copies * private->bpb.fat_sectors) + root_dir_sectors;
-    return first_data_sector + (cluster - 2) * private->bpb.sectors_per_cluster;
+    return private->first_data_sector + ((cluster - 2) << private->sectors_per_cluster_shift);
 }
 
 uint32_t fat16_get_root_directory_sector(struct disk* disk) {
     struct fat_private* private = disk->fs_private;
-    return private->bpb.reserved_sectors + (private->bpb.fat_copies * private->bpb.fat_sectors);
+    return private->root_dir_sector;
 }
 
 uint32_t fat16_get_bytes_per_sector(struct disk* disk) {
@@ -98,47 +416,74 @@ uint32_t fat16_get_bytes_per_sector(struct disk* disk) {
     return private->bpb.bytes_per_sector;
 }
 
-static int fat16_get_directory_entry(struct disk* disk, uint32_t cluster, const char* name, struct fat_directory_item* out_item) {
+// Convert a path component to the packed 11 byte 8.3 form stored on disk
+static int fat16_pack_name(const struct path_part* name, uint8_t* out) {
+    memset(out, ' ', 11);
+
+    if (path_part_is(name, ".") || path_part_is(name, "..")) {
+        memcpy(out, name->part, name->len);
+        return 0;
+    }
+
+    const char* str = name->part;
+    uint32_t i = 0;
+    int len = 0;
+    while (i < name->len && str[i] != '.') {
+        if (len == 8) return -1;
+        out[len++] = toupper((unsigned char)str[i++]);
+    }
+    if (len == 0) return -1;
+
+    if (i < name->len) {
+        i++; // Skip '.'
+        len = 0;
+        while (i < name->len) {
+            if (len == 3 || str[i] == '.') return -1;
+            out[8 + len++] = toupper((unsigned char)str[i++]);
+        }
+    }
+
+    return 0;
+}
+
+static int fat16_scan_directory(struct disk* disk, uint32_t cluster, const uint8_t* packed, struct fat_dentry* out) {
     struct fat_private* private = disk->fs_private;
     uint32_t bytes_per_sector = private->bpb.bytes_per_sector;
     uint32_t root_dir_entries = private->bpb.root_dir_entries;
-    uint32_t items_processed = 0;
     
     if (cluster == 0) { // Root Directory
         uint32_t root_dir_sector = fat16_get_root_directory_sector(disk);
-        diskstream_seek(private->stream, root_dir_sector * bytes_per_sector);
+        uint32_t pos = root_dir_sector * bytes_per_sector;
         
-        for (int i = 0; i < root_dir_entries; i++) {
+        for (int i = 0; i < root_dir_entries; i++, pos += sizeof(struct fat_directory_item)) {
             struct fat_directory_item item;
-            if (diskstream_read(private->stream, &item, sizeof(item)) != 0) return -1;
+            if (diskstream_pread(disk, &item, sizeof(item), pos) != 0) return -1;
             if (item.filename[0] == 0x00) break;
             if (item.filename[0] == 0xE5) continue;
             
-            char out_name[13];
-            fat16_get_full_relative_filename(&item, out_name, sizeof(out_name));
-            if (strncasecmp(out_name, name, sizeof(out_name)) == 0) {
-                *out_item = item;
+            if (memcmp(item.filename, packed, 11) == 0) {
+                out->item = item;
+                out->pos = pos;
                 return 0;
             }
         }
     } else { // Subdirectory (Cluster Chain)
-        uint32_t cluster_size = private->bpb.sectors_per_cluster * bytes_per_sector;
+        uint32_t cluster_size = private->cluster_size;
         uint32_t current_cluster = cluster;
         
         while (current_cluster < FAT16_CLUSTER_RESERVED_MIN) {
             uint32_t abs_sector = fat16_cluster_to_sector(disk, current_cluster);
-            diskstream_seek(private->stream, abs_sector * bytes_per_sector);
+            uint32_t pos = abs_sector * bytes_per_sector;
             
-            for (uint32_t i = 0; i < cluster_size / sizeof(struct fat_directory_item); i++) {
+            for (uint32_t i = 0; i < cluster_size / sizeof(struct fat_directory_item); i++, pos += sizeof(struct fat_directory_item)) {
                 struct fat_directory_item item;
-                if (diskstream_read(private->stream, &item, sizeof(item)) != 0) return -2;
+                if (diskstream_pread(disk, &item, sizeof(item), pos) != 0) return -2;
                 if (item.filename[0] == 0x00) return -3;
                 if (item.filename[0] == 0xE5) continue;
                 
-                char out_name[13];
-                fat16_get_full_relative_filename(&item, out_name, sizeof(out_name));
-                if (strncasecmp(out_name, name, sizeof(out_name)) == 0) {
-                    *out_item = item;
+                if (memcmp(item.filename, packed, 11) == 0) {
+                    out->item = item;
+                    out->pos = pos;
                     return 0;
                 }
             }
@@ -149,139 +494,642 @@ static int fat16_get_directory_entry(struct disk* disk, uint32_t cluster, const
     return -4; // Not found
 }
 
-int fat16_list(struct disk* disk, struct path_part* path) {
+static int fat16_get_directory_entry(struct disk* disk, uint32_t cluster, const struct path_part* name, struct fat_dentry* out) {
+    uint8_t packed[11];
+    if (fat16_pack_name(name, packed) != 0) {
+        return -4; // Not a valid 8.3 name, so it can't exist
+    }
+
+    switch (dcache_lookup(disk, cluster, packed, out, sizeof(struct fat_dentry))) {
+        case DCACHE_HIT:
+            return 0;
+        case DCACHE_HIT_NEGATIVE:
+            return -4;
+    }
+
+    int res = fat16_scan_directory(disk, cluster, packed, out);
+    if (res == 0) {
+        dcache_insert(disk, cluster, packed, out, sizeof(struct fat_dentry));
+    } else if (res == -3 || res == -4) {
+        dcache_insert(disk, cluster, packed, NULL, 0);
+    }
+    return res;
+}
+
+// Write a directory entry back to disk and refresh its dcache copy
+static int fat16_write_dentry(struct disk* disk, uint32_t parent, struct fat_dentry* dentry) {
+    if (diskstream_pwrite(disk, &dentry->item, sizeof(dentry->item), dentry->pos) != 0) return -1;
+    dcache_insert(disk, parent, dentry->item.filename, dentry, sizeof(struct fat_dentry));
+    return 0;
+}
+
+// Find a free directory slot. A full subdirectory grows by a zeroed cluster;
+// the root directory has a fixed size.
+static int fat16_find_free_slot(struct disk* disk, uint32_t cluster, uint32_t* out_pos) {
     struct fat_private* private = disk->fs_private;
     uint32_t bytes_per_sector = private->bpb.bytes_per_sector;
-    uint32_t root_dir_entries = private->bpb.root_dir_entries;
-    uint32_t current_cluster = 0;
-
-    struct path_part* current_part = path;
-    while (current_part) {
-        struct fat_directory_item item;
-        if (fat16_get_directory_entry(disk, current_cluster, current_part->part, &item) != 0) {
-            return -1;
-        }
-        if (!(item.attribute & FAT_FILE_SUBDIRECTORY)) return -1;
-        current_cluster = item.low_16_bits_first_cluster;
-        current_part = current_part->next;
-    }
-
-    if (current_cluster == 0) {
-         uint32_t root_dir_sector = fat16_get_root_directory_sector(disk);
-         diskstream_seek(private->stream, root_dir_sector * bytes_per_sector);
-         for (int i = 0; i < root_dir_entries; i++) {
-             struct fat_directory_item item;
-             if (diskstream_read(private->stream, &item, sizeof(item)) != 0) break;
-             if (item.filename[0] == 0x00) break;
-             if (item.filename[0] == 0xE5) continue;
-             
-             char out_name[13];
-             fat16_get_full_relative_filename(&item, out_name, sizeof(out_name));
-             print_string(out_name);
-             if (item.attribute & FAT_FILE_SUBDIRECTORY) print_string("/");
-             print_string("\n");
-         }
-    } else {
-        uint32_t cluster_size = private->bpb.sectors_per_cluster * bytes_per_sector;
-        while (current_cluster < FAT16_CLUSTER_RESERVED_MIN) {
-            uint32_t abs_sector = fat16_cluster_to_sector(disk, current_cluster);
-            diskstream_seek(private->stream, abs_sector * bytes_per_sector);
-            for (uint32_t i = 0; i < cluster_size / sizeof(struct fat_directory_item); i++) {
-                struct fat_directory_item item;
-                if (diskstream_read(private->stream, &item, sizeof(item)) != 0) break;
-                if (item.filename[0] == 0x00) break;
-                if (item.filename[0] == 0xE5) continue;
-                
-                char out_name[13];
-                fat16_get_full_relative_filename(&item, out_name, sizeof(out_name));
-                print_string(out_name);
-                if (item.attribute & FAT_FILE_SUBDIRECTORY) print_string("/");
-                print_string("\n");
+
+    if (cluster == 0) {
+        uint32_t pos = private->root_dir_sector * bytes_per_sector;
+        for (uint32_t i = 0; i < private->bpb.root_dir_entries; i++, pos += sizeof(struct fat_directory_item)) {
+            struct fat_directory_item item;
+            if (diskstream_pread(disk, &item, sizeof(item), pos) != 0) return -1;
+            if (item.filename[0] == 0x00 || item.filename[0] == 0xE5) {
+                *out_pos = pos;
+                return 0;
             }
-            current_cluster = fat16_get_fat_entry(disk, current_cluster);
         }
+        return -2; // Root directory full
     }
+
+    uint32_t current_cluster = cluster;
+    uint32_t last_cluster = cluster;
+    while (current_cluster >= 2 && current_cluster < FAT16_CLUSTER_RESERVED_MIN) {
+        uint32_t pos = fat16_cluster_to_sector(disk, current_cluster) * bytes_per_sector;
+        for (uint32_t i = 0; i < private->cluster_size / sizeof(struct fat_directory_item); i++, pos += sizeof(struct fat_directory_item)) {
+            struct fat_directory_item item;
+            if (diskstream_pread(disk, &item, sizeof(item), pos) != 0) return -1;
+            if (item.filename[0] == 0x00 || item.filename[0] == 0xE5) {
+                *out_pos = pos;
+                return 0;
+            }
+        }
+        last_cluster = current_cluster;
+        current_cluster = fat16_get_fat_entry(disk, current_cluster);
+    }
+
+    if (fat16_load_free_bitmap(disk) != 0) return -1;
+
+    uint32_t length = 0;
+    uint32_t new_cluster = fat16_find_free_run(private, last_cluster + 1, 1, &length);
+    if (new_cluster == 0) return -2; // Volume full
+
+    // Zero the cluster first so it reads as an empty directory tail
+    char* zero = kmalloc(private->cluster_size);
+    if (!zero) return -1;
+    memset(zero, 0, private->cluster_size);
+    uint32_t sector = fat16_cluster_to_sector(disk, new_cluster);
+    int res = disk_write_sectors(disk, sector, 1U << private->sectors_per_cluster_shift, zero);
+    kfree(zero);
+    if (res != 0) return -1;
+
+    if (fat16_set_fat_entry(disk, new_cluster, FAT16_CLUSTER_LAST_MAX) != 0 ||
+        fat16_set_fat_entry(disk, last_cluster, new_cluster) != 0 ||
+        fat16_flush_fat(disk) != 0) {
+        return -1;
+    }
+
+    *out_pos = sector * bytes_per_sector;
     return 0;
 }
 
-// legacy fat16_open removed
+// Create an empty file called `name` in the directory at `parent`
+static int fat16_create_entry(struct disk* disk, uint32_t parent, const struct path_part* name, struct fat_dentry* out) {
+    uint8_t packed[11];
+    if (path_part_is(name, ".") || path_part_is(name, "..")) return -1;
+    if (fat16_pack_name(name, packed) != 0) return -1;
+
+    uint32_t pos;
+    if (fat16_find_free_slot(disk, parent, &pos) != 0) return -2;
+
+    memset(out, 0, sizeof(struct fat_dentry));
+    memcpy(out->item.filename, packed, 11);
+    out->item.attribute = FAT_FILE_ARCHIVE;
+    out->pos = pos;
+    return fat16_write_dentry(disk, parent, out);
+}
+
+// Follow every component but the last. *parent receives the first cluster
+// of the directory holding the last component (0 for the root directory).
+static struct path_part* fat16_walk_parent(struct disk* disk, struct path_part* path, uint32_t* parent) {
+    *parent = 0;
+    while (path->next) {
+        struct fat_dentry dentry;
+        if (fat16_get_directory_entry(disk, *parent, path, &dentry) != 0) return NULL;
+        if (!(dentry.item.attribute & FAT_FILE_SUBDIRECTORY)) return NULL;
+        *parent = dentry.item.low_16_bits_first_cluster;
+        path = path->next;
+    }
+    return path;
+}
+
+static FILE_STAT_FLAGS fat16_attribute_to_flags(uint8_t attribute) {
+    FILE_STAT_FLAGS flags = 0;
+    if (attribute & FAT_FILE_READ_ONLY) flags |= FILE_STAT_READ_ONLY;
+    if (attribute & FAT_FILE_HIDDEN) flags |= FILE_STAT_HIDDEN;
+    if (attribute & FAT_FILE_SYSTEM) flags |= FILE_STAT_SYSTEM;
+    if (attribute & FAT_FILE_VOLUME_LABEL) flags |= FILE_STAT_VOLUME_LABEL;
+    if (attribute & FAT_FILE_SUBDIRECTORY) flags |= FILE_STAT_DIRECTORY;
+    if (attribute & FAT_FILE_ARCHIVE) flags |= FILE_STAT_ARCHIVE;
+    return flags;
+}
+
+void* fat16_opendir(struct disk* disk, struct path_part* path) {
+    struct fat_private* private = disk->fs_private;
+    uint32_t cluster = 0;
+
+    rwlock_read_lock(&private->lock);
+    for (struct path_part* part = path; part; part = part->next) {
+        struct fat_dentry dentry;
+        if (fat16_get_directory_entry(disk, cluster, part, &dentry) != 0 ||
+            !(dentry.item.attribute & FAT_FILE_SUBDIRECTORY)) {
+            rwlock_read_unlock(&private->lock);
+            return NULL;
+        }
+        cluster = dentry.item.low_16_bits_first_cluster;
+    }
+    rwlock_read_unlock(&private->lock);
+
+    struct fat_directory* dir = kmalloc(sizeof(struct fat_directory));
+    if (!dir) return NULL;
+    dir->cluster = cluster;
+    dir->walk_index = 0;
+    dir->walk_cluster = cluster;
+    return dir;
+}
+
+static int fat16_readdir_locked(struct disk* disk, struct fat_directory* dir, uint32_t* cursor, struct fs_dirent* entries, uint32_t count) {
+    struct fat_private* private = disk->fs_private;
+    uint32_t entries_per_sector = private->bpb.bytes_per_sector / sizeof(struct fat_directory_item);
+    uint32_t entries_per_cluster_shift = private->cluster_shift - 5; // 32 byte entries
+
+    struct fat_directory_item items[16];
+    uint32_t loaded_sector = 0;
+    uint32_t filled = 0;
+
+    while (filled < count) {
+        uint32_t index = *cursor;
+        uint32_t sector;
+
+        if (dir->cluster == 0) {
+            if (index >= private->bpb.root_dir_entries) break;
+            sector = private->root_dir_sector + index / entries_per_sector;
+        } else {
+            // Follow the chain from the last cluster visited, so reading a
+            // directory front to back walks it once
+            uint32_t cluster_index = index >> entries_per_cluster_shift;
+            if (cluster_index < dir->walk_index) {
+                dir->walk_index = 0;
+                dir->walk_cluster = dir->cluster;
+            }
+            while (dir->walk_index < cluster_index) {
+                uint32_t next = fat16_get_fat_entry(disk, dir->walk_cluster);
+                if (next < 2 || next >= FAT16_CLUSTER_RESERVED_MIN) break;
+                dir->walk_cluster = next;
+                dir->walk_index++;
+            }
+            if (dir->walk_index < cluster_index) break; // End of chain
+
+            uint32_t in_cluster = index & ((1U << entries_per_cluster_shift) - 1);
+            sector = fat16_cluster_to_sector(disk, dir->walk_cluster) + in_cluster / entries_per_sector;
+        }
 
-int fat16_close(void* private) {
+        if (sector != loaded_sector) {
+            if (disk_read_sectors(disk, sector, 1, items) != 0) {
+                return filled > 0 ? (int)filled : -1;
+            }
+            loaded_sector = sector;
+        }
+
+        struct fat_directory_item* item = &items[index % entries_per_sector];
+        if (item->filename[0] == 0x00) break; // End of directory
+        (*cursor)++;
+
+        // Skip deleted entries, long name fragments and the volume label
+        if (item->filename[0] == 0xE5) continue;
+        if (item->attribute & FAT_FILE_VOLUME_LABEL) continue;
+
+        struct fs_dirent* entry = &entries[filled++];
+        fat16_get_full_relative_filename(item, entry->name, sizeof(entry->name));
+        entry->size = item->filesize;
+        entry->flags = fat16_attribute_to_flags(item->attribute);
+        entry->first_cluster = item->low_16_bits_first_cluster;
+    }
+
+    return filled;
+}
+
+int fat16_readdir(struct disk* disk, void* private_data, uint32_t* cursor, struct fs_dirent* entries, uint32_t count) {
+    struct fat_private* private = disk->fs_private;
+    rwlock_read_lock(&private->lock);
+    int res = fat16_readdir_locked(disk, (struct fat_directory*)private_data, cursor, entries, count);
+    rwlock_read_unlock(&private->lock);
+    return res;
+}
+
+int fat16_closedir(void* private) {
     kfree(private);
     return 0;
 }
 
-int fat16_read(struct disk* disk, void* private_data, uint32_t size, uint32_t nmemb, char* out) {
-    struct fat_file_descriptor* desc = (struct fat_file_descriptor*)private_data;
+// legacy fat16_open removed
+
+// Write the inode's size and first cluster back to its directory entry
+static int fat16_sync_dentry(struct disk* disk, struct fat_inode* inode) {
+    struct fat_dentry dentry;
+    dentry.item = inode->item;
+    dentry.pos = inode->dirent_pos;
+    return fat16_write_dentry(disk, inode->parent_cluster, &dentry);
+}
+
+// Find the in-core inode for a directory entry, creating it on first open
+static struct fat_inode* fat16_get_inode(struct disk* disk, uint32_t parent, struct fat_dentry* dentry) {
     struct fat_private* private = disk->fs_private;
-    uint32_t total_to_read = size * nmemb;
-    if (desc->pos + total_to_read > desc->item.filesize) {
-        total_to_read = desc->item.filesize - desc->pos;
+
+    // Readers open files side by side under the shared mount lock
+    spin_lock(&private->inodes_lock);
+    for (struct fat_inode* inode = private->inodes; inode; inode = inode->next) {
+        if (inode->dirent_pos == dentry->pos) {
+            inode->refcount++;
+            spin_unlock(&private->inodes_lock);
+            return inode;
+        }
     }
-    
-    if (total_to_read == 0) return 0;
+    spin_unlock(&private->inodes_lock);
 
-    uint32_t total_read = 0;
-    uint32_t cluster_size = private->bpb.sectors_per_cluster * private->bpb.bytes_per_sector;
-    
-    // Efficient cluster lookup: Use cache if possible
-    uint32_t current_cluster;
-    uint32_t start_cluster;
-    uint32_t start_pos;
-
-    if (desc->pos >= desc->last_cluster_pos) {
-        start_cluster = desc->last_cluster;
-        start_pos = desc->last_cluster_pos;
-    } else {
-        start_cluster = desc->item.low_16_bits_first_cluster;
-        start_pos = 0;
+    struct fat_inode* inode = kmalloc(sizeof(struct fat_inode));
+    if (!inode) return NULL;
+    memset(inode, 0, sizeof(struct fat_inode));
+    rwlock_init(&inode->lock);
+    inode->item = dentry->item;
+    inode->parent_cluster = parent;
+    inode->dirent_pos = dentry->pos;
+    inode->refcount = 1;
+
+    // Another reader may have got there while this one was allocated
+    spin_lock(&private->inodes_lock);
+    for (struct fat_inode* other = private->inodes; other; other = other->next) {
+        if (other->dirent_pos == dentry->pos) {
+            other->refcount++;
+            spin_unlock(&private->inodes_lock);
+            kfree(inode);
+            return other;
+        }
     }
+    inode->next = private->inodes;
+    private->inodes = inode;
+    spin_unlock(&private->inodes_lock);
+    return inode;
+}
 
-    current_cluster = fat16_get_cluster_for_offset(disk, start_cluster, desc->pos - start_pos);
-    if (current_cluster >= FAT16_CLUSTER_RESERVED_MIN) return 0;
+// Drop a reference with the mount lock held exclusively, so no one can
+// open the file again while its last close trims it
+static int fat16_put_inode(struct disk* disk, struct fat_inode* inode) {
+    struct fat_private* private = disk->fs_private;
+    int res = 0;
 
-    // Update cache
-    desc->last_cluster = current_cluster;
-    desc->last_cluster_pos = (desc->pos / cluster_size) * cluster_size;
+    spin_lock(&private->inodes_lock);
+    if (--inode->refcount > 0) {
+        spin_unlock(&private->inodes_lock);
+        return 0;
+    }
 
-    while (total_read < total_to_read) {
-        uint32_t offset_in_file = desc->pos + total_read;
-        uint32_t offset_in_cluster = offset_in_file % cluster_size;
-        
-        // Check if we need to advance to the next cluster
-        if (total_read > 0 && offset_in_cluster == 0) {
-            current_cluster = fat16_get_fat_entry(disk, current_cluster);
-            // Update cache as we go
-            desc->last_cluster = current_cluster;
-            desc->last_cluster_pos = offset_in_file;
+    struct fat_inode** link = &private->inodes;
+    while (*link && *link != inode) {
+        link = &(*link)->next;
+    }
+    if (*link) *link = inode->next;
+    spin_unlock(&private->inodes_lock);
+
+    if (inode->allocated) {
+        uint32_t keep = (inode->item.filesize + private->cluster_size - 1) >> private->cluster_shift;
+
+        // Give back clusters preallocated past the end of the file. The
+        // entry is updated before the FAT so it never points at free space.
+        fat16_map_extents(disk, inode, keep);
+        if (inode->mapped_clusters > keep) {
+            if (fat16_truncate_chain(disk, inode, keep) != 0 || fat16_sync_dentry(disk, inode) != 0) {
+                res = -1;
+            }
         }
+        if (fat16_flush_fat(disk) != 0) res = -1;
+    }
 
+    if (inode->extents) kfree(inode->extents);
+    kfree(inode);
+    return res;
+}
+
+int fat16_close(void* private_data) {
+    struct fat_file_descriptor* desc = (struct fat_file_descriptor*)private_data;
+    struct fat_private* private = desc->disk->fs_private;
+    struct fat_inode* inode = desc->inode;
+
+    // Only the last close can change anything on disk; the others just
+    // drop their reference without waiting for the mount lock
+    spin_lock(&private->inodes_lock);
+    bool last = inode->refcount == 1;
+    if (!last) inode->refcount--;
+    spin_unlock(&private->inodes_lock);
+
+    int res = 0;
+    if (last) {
+        rwlock_write_lock(&private->lock);
+        res = fat16_put_inode(desc->disk, inode);
+        rwlock_write_unlock(&private->lock);
+    }
+    kfree(desc);
+    return res;
+}
+
+// Copy `count` bytes at `offset` between the file and `buf`, a contiguous
+// cluster run per transfer. The range must already be mapped (and for
+// writes, allocated). Returns the bytes moved.
+static uint32_t fat16_transfer(struct disk* disk, struct fat_inode* inode, char* buf, uint32_t count, uint32_t offset, bool write) {
+    struct fat_private* private = disk->fs_private;
+    uint32_t cluster_size = private->cluster_size;
+    uint32_t done = 0;
+
+    while (done < count) {
+        uint32_t offset_in_file = offset + done;
+        uint32_t offset_in_cluster = offset_in_file & (cluster_size - 1);
+
+        // Map the offset through the extent map rather than walking the chain
+        uint32_t run = 0;
+        uint32_t current_cluster = fat16_get_cluster_for_offset(disk, inode, offset_in_file, &run);
         if (current_cluster >= FAT16_CLUSTER_RESERVED_MIN) {
             break; // End of chain or error
         }
-        
+
         uint32_t abs_sector = fat16_cluster_to_sector(disk, current_cluster);
         uint32_t abs_pos = (abs_sector * private->bpb.bytes_per_sector) + offset_in_cluster;
-        
-        uint32_t to_read_this_cluster = cluster_size - offset_in_cluster;
-        if (to_read_this_cluster > (total_to_read - total_read)) {
-            to_read_this_cluster = total_to_read - total_read;
+
+        // Move the rest of the contiguous run as a single transfer
+        uint32_t this_run = (run << private->cluster_shift) - offset_in_cluster;
+        if (this_run > count - done) {
+            this_run = count - done;
         }
-        
-        diskstream_seek(private->stream, abs_pos);
-        if (diskstream_read(private->stream, out + total_read, to_read_this_cluster) != 0) {
+
+        int res = write ? diskstream_pwrite(disk, buf + done, this_run, abs_pos)
+                        : diskstream_pread(disk, buf + done, this_run, abs_pos);
+        if (res != 0) {
             break;
         }
-        
-        total_read += to_read_this_cluster;
+
+        done += this_run;
     }
-    
-    desc->pos += total_read;
-    return total_read / size;
+
+    return done;
+}
+
+int fat16_pread(struct disk* disk, void* private_data, char* out, uint32_t count, uint32_t offset) {
+    struct fs_iovec iov = { out, count };
+    return fat16_preadv(disk, private_data, &iov, 1, offset);
+}
+
+static int fat16_preadv_locked(struct disk* disk, struct fat_inode* inode, const struct fs_iovec* iov, int iovcnt, uint32_t offset) {
+    struct fat_private* private = disk->fs_private;
+
+    if (offset >= inode->item.filesize) return 0;
+    uint32_t total_to_read = 0;
+    for (int i = 0; i < iovcnt; i++) {
+        total_to_read += iov[i].len;
+    }
+    if (total_to_read > inode->item.filesize - offset) {
+        total_to_read = inode->item.filesize - offset;
+    }
+
+    if (total_to_read == 0) return 0;
+
+    // Map the whole request up front so each extent is seen at its full
+    // length. Other readers of the file may be using the map, so extending
+    // it takes the inode lock exclusively; the copy itself shares it.
+    uint32_t last_cluster = (offset + total_to_read - 1) >> private->cluster_shift;
+    rwlock_read_lock(&inode->lock);
+    if (inode->mapped_clusters <= last_cluster && !inode->extents_complete) {
+        rwlock_read_unlock(&inode->lock);
+        rwlock_write_lock(&inode->lock);
+        fat16_map_extents(disk, inode, last_cluster);
+        rwlock_write_unlock(&inode->lock);
+        rwlock_read_lock(&inode->lock);
+    }
+
+    uint32_t total_read = 0;
+    for (int i = 0; i < iovcnt && total_read < total_to_read; i++) {
+        uint32_t len = iov[i].len;
+        if (len > total_to_read - total_read) {
+            len = total_to_read - total_read;
+        }
+
+        uint32_t res = fat16_transfer(disk, inode, iov[i].base, len, offset + total_read, false);
+        total_read += res;
+        if (res < len) break;
+    }
+    rwlock_read_unlock(&inode->lock);
+
+    return total_read;
+}
+
+int fat16_preadv(struct disk* disk, void* private_data, const struct fs_iovec* iov, int iovcnt, uint32_t offset) {
+    struct fat_file_descriptor* desc = (struct fat_file_descriptor*)private_data;
+    struct fat_private* private = disk->fs_private;
+
+    rwlock_read_lock(&private->lock);
+    int res = fat16_preadv_locked(disk, desc->inode, iov, iovcnt, offset);
+    rwlock_read_unlock(&private->lock);
+    return res;
+}
+
+int fat16_read(struct disk* disk, void* private_data, uint32_t size, uint32_t nmemb, char* out) {
+    struct fat_file_descriptor* desc = (struct fat_file_descriptor*)private_data;
+    int res = fat16_pread(disk, desc, out, size * nmemb, desc->pos);
+    if (res < 0) return res;
+
+    desc->pos += res;
+    return res / size;
+}
+
+int fat16_pwrite(struct disk* disk, void* private_data, const char* in, uint32_t count, uint32_t offset) {
+    struct fs_iovec iov = { (void*)in, count };
+    return fat16_pwritev(disk, private_data, &iov, 1, offset);
+}
+
+// Writers change the FAT and directory entries, so everything from here on
+// runs with the mount lock held exclusively and needs no inode lock
+static int fat16_pwritev_locked(struct disk* disk, struct fat_inode* inode, const struct fs_iovec* iov, int iovcnt, uint32_t offset) {
+    struct fat_private* private = disk->fs_private;
+
+    uint32_t count = 0;
+    for (int i = 0; i < iovcnt; i++) {
+        count += iov[i].len;
+    }
+    if (count == 0) return 0;
+
+    uint32_t end = offset + count;
+    if (end < offset) return -2;
+
+    // Allocate the whole request up front so it lands in as few runs as the
+    // free space allows, and get the FAT on disk before any data
+    uint32_t first_cluster = inode->item.low_16_bits_first_cluster;
+    uint32_t needed = (end + private->cluster_size - 1) >> private->cluster_shift;
+    fat16_map_extents(disk, inode, needed - 1);
+    if (inode->mapped_clusters < needed) {
+        inode->allocated = true;
+        int res = fat16_extend_chain(disk, inode, needed - inode->mapped_clusters);
+        if (fat16_flush_fat(disk) != 0 || res != 0) return -3;
+    }
+
+    uint32_t total_written = 0;
+    for (int i = 0; i < iovcnt; i++) {
+        uint32_t res = fat16_transfer(disk, inode, iov[i].base, iov[i].len, offset + total_written, true);
+        total_written += res;
+        if (res < iov[i].len) break;
+    }
+
+    // The entry goes last, once the data and FAT it points at are on disk
+    end = offset + total_written;
+    if (end > inode->item.filesize || inode->item.low_16_bits_first_cluster != first_cluster) {
+        if (end > inode->item.filesize) {
+            inode->item.filesize = end;
+        }
+        if (fat16_sync_dentry(disk, inode) != 0) return -4;
+    }
+
+    return total_written;
+}
+
+int fat16_pwritev(struct disk* disk, void* private_data, const struct fs_iovec* iov, int iovcnt, uint32_t offset) {
+    struct fat_file_descriptor* desc = (struct fat_file_descriptor*)private_data;
+    struct fat_private* private = disk->fs_private;
+    if (desc->mode == FILE_MODE_READ) return -1;
+
+    rwlock_write_lock(&private->lock);
+    int res = fat16_pwritev_locked(disk, desc->inode, iov, iovcnt, offset);
+    rwlock_write_unlock(&private->lock);
+    return res;
+}
+
+int fat16_write(struct disk* disk, void* private_data, uint32_t size, uint32_t nmemb, const char* in) {
+    struct fat_file_descriptor* desc = (struct fat_file_descriptor*)private_data;
+    if (desc->mode == FILE_MODE_APPEND) {
+        desc->pos = desc->inode->item.filesize;
+    }
+
+    int res = fat16_pwrite(disk, desc, in, size * nmemb, desc->pos);
+    if (res < 0) return res;
+
+    desc->pos += res;
+    return res / size;
+}
+
+static int fat16_truncate_locked(struct disk* disk, struct fat_file_descriptor* desc, uint32_t size) {
+    struct fat_inode* inode = desc->inode;
+    struct fat_private* private = disk->fs_private;
+
+    if (size > inode->item.filesize) {
+        // Grow by writing zeros so the new range reads back as zeros
+        char* zero = kmalloc(private->cluster_size);
+        if (!zero) return -2;
+        memset(zero, 0, private->cluster_size);
+
+        int res = 0;
+        while (inode->item.filesize < size) {
+            uint32_t chunk = size - inode->item.filesize;
+            if (chunk > private->cluster_size) chunk = private->cluster_size;
+            struct fs_iovec iov = { zero, chunk };
+            if (fat16_pwritev_locked(disk, inode, &iov, 1, inode->item.filesize) != (int)chunk) {
+                res = -3;
+                break;
+            }
+        }
+        kfree(zero);
+        return res;
+    }
+
+    uint32_t keep = (size + private->cluster_size - 1) >> private->cluster_shift;
+    if (fat16_truncate_chain(disk, inode, keep) != 0) return -4;
+
+    inode->item.filesize = size;
+    if (desc->pos > size) {
+        desc->pos = size;
+    }
+
+    // Shrink the entry before the freed clusters become visible
+    if (fat16_sync_dentry(disk, inode) != 0) return -5;
+    return fat16_flush_fat(disk);
+}
+
+int fat16_truncate(struct disk* disk, void* private_data, uint32_t size) {
+    struct fat_file_descriptor* desc = (struct fat_file_descriptor*)private_data;
+    struct fat_private* private = disk->fs_private;
+    if (desc->mode == FILE_MODE_READ) return -1;
+
+    rwlock_write_lock(&private->lock);
+    int res = fat16_truncate_locked(disk, desc, size);
+    rwlock_write_unlock(&private->lock);
+    return res;
+}
+
+static int fat16_fallocate_locked(struct disk* disk, struct fat_inode* inode, uint32_t length) {
+    struct fat_private* private = disk->fs_private;
+
+    // Reserve clusters without changing the file size; whatever is still
+    // past the end of the file on the last close is released again
+    uint32_t needed = (length + private->cluster_size - 1) >> private->cluster_shift;
+    if (needed == 0) return 0;
+
+    fat16_map_extents(disk, inode, needed - 1);
+    if (inode->mapped_clusters >= needed) return 0;
+
+    uint32_t first_cluster = inode->item.low_16_bits_first_cluster;
+    inode->allocated = true;
+    int res = fat16_extend_chain(disk, inode, needed - inode->mapped_clusters);
+    if (fat16_flush_fat(disk) != 0) return -2;
+    if (inode->item.low_16_bits_first_cluster != first_cluster && fat16_sync_dentry(disk, inode) != 0) return -3;
+    return res == 0 ? 0 : -4;
+}
+
+int fat16_fallocate(struct disk* disk, void* private_data, uint32_t length) {
+    struct fat_file_descriptor* desc = (struct fat_file_descriptor*)private_data;
+    struct fat_private* private = disk->fs_private;
+    if (desc->mode == FILE_MODE_READ) return -1;
+
+    rwlock_write_lock(&private->lock);
+    int res = fat16_fallocate_locked(disk, desc->inode, length);
+    rwlock_write_unlock(&private->lock);
+    return res;
+}
+
+static int fat16_unlink_locked(struct disk* disk, struct path_part* path) {
+    struct fat_private* private = disk->fs_private;
+    uint32_t parent;
+    struct path_part* last = fat16_walk_parent(disk, path, &parent);
+    if (!last) return -1;
+
+    struct fat_dentry dentry;
+    if (fat16_get_directory_entry(disk, parent, last, &dentry) != 0) return -1;
+    if (dentry.item.attribute & (FAT_FILE_SUBDIRECTORY | FAT_FILE_VOLUME_LABEL)) return -2;
+    if (dentry.item.attribute & FAT_FILE_READ_ONLY) return -3;
+
+    // Files still open keep their clusters; refuse rather than free them
+    for (struct fat_inode* inode = private->inodes; inode; inode = inode->next) {
+        if (inode->dirent_pos == dentry.pos) return -6;
+    }
+
+    uint8_t packed[11];
+    memcpy(packed, dentry.item.filename, 11);
+
+    // Remove the entry before its clusters are freed
+    uint8_t deleted = 0xE5;
+    if (diskstream_pwrite(disk, &deleted, 1, dentry.pos) != 0) return -4;
+    dcache_insert(disk, parent, packed, NULL, 0);
+    pagecache_invalidate(disk, dentry.pos);
+
+    if (fat16_free_chain(disk, dentry.item.low_16_bits_first_cluster) != 0) return -5;
+    return fat16_flush_fat(disk);
+}
+
+int fat16_unlink(struct disk* disk, struct path_part* path) {
+    struct fat_private* private = disk->fs_private;
+    rwlock_write_lock(&private->lock);
+    int res = fat16_unlink_locked(disk, path);
+    rwlock_write_unlock(&private->lock);
+    return res;
 }
 
 int fat16_seek(void* private, int offset, FILE_SEEK_MODE whence) {
     struct fat_file_descriptor* desc = (struct fat_file_descriptor*)private;
+    uint32_t filesize = desc->inode->item.filesize;
     uint32_t new_pos = desc->pos;
 
     switch (whence) {
@@ -292,11 +1140,11 @@ int fat16_seek(void* private, int offset, FILE_SEEK_MODE whence) {
             new_pos += offset;
             break;
         case FILE_SEEK_END:
-            new_pos = desc->item.filesize + offset;
+            new_pos = filesize + offset;
             break;
     }
 
-    if (new_pos > desc->item.filesize) {
+    if (new_pos > filesize) {
         return -1;
     }
 
@@ -311,80 +1159,165 @@ int fat16_tell(void* private) {
 
 int fat16_stat(struct disk* disk, void* private, struct file_stat* stat) {
     struct fat_file_descriptor* desc = (struct fat_file_descriptor*)private;
-    stat->filesize = desc->item.filesize;
-    stat->flags = 0;
-    if (desc->item.attribute & FAT_FILE_READ_ONLY) stat->flags |= FILE_STAT_READ_ONLY;
-    if (desc->item.attribute & FAT_FILE_HIDDEN) stat->flags |= FILE_STAT_HIDDEN;
-    if (desc->item.attribute & FAT_FILE_SYSTEM) stat->flags |= FILE_STAT_SYSTEM;
-    if (desc->item.attribute & FAT_FILE_VOLUME_LABEL) stat->flags |= FILE_STAT_VOLUME_LABEL;
-    if (desc->item.attribute & FAT_FILE_SUBDIRECTORY) stat->flags |= FILE_STAT_DIRECTORY;
-    if (desc->item.attribute & FAT_FILE_ARCHIVE) stat->flags |= FILE_STAT_ARCHIVE;
+    struct fat_private* fat = disk->fs_private;
+    struct fat_directory_item* item = &desc->inode->item;
+
+    rwlock_read_lock(&fat->lock);
+    stat->filesize = item->filesize;
+    stat->ino = desc->inode->dirent_pos;
+    stat->flags = fat16_attribute_to_flags(item->attribute);
+    rwlock_read_unlock(&fat->lock);
     return 0;
 }
-void* fat16_open(struct disk* disk, struct path_part* path, FILE_MODE mode) {
-    if (mode != FILE_MODE_READ) return NULL;
-    
-    struct fat_directory_item item;
-    uint32_t current_cluster = 0; // Start at root
-    struct path_part* current_part = path;
-    
-    while (current_part) {
-        if (fat16_get_directory_entry(disk, current_cluster, current_part->part, &item) != 0) {
-            return NULL;
-        }
-        
-        if (current_part->next) {
-            // Must be a directory
-            if (!(item.attribute & FAT_FILE_SUBDIRECTORY)) return NULL;
-            current_cluster = item.low_16_bits_first_cluster;
-        }
-        current_part = current_part->next;
+static void* fat16_open_locked(struct disk* disk, struct path_part* path, FILE_MODE mode) {
+    uint32_t parent;
+    struct path_part* last = fat16_walk_parent(disk, path, &parent);
+    if (!last) return NULL;
+
+    struct fat_dentry dentry;
+    int res = fat16_get_directory_entry(disk, parent, last, &dentry);
+    if (res != 0) {
+        // Writers create files that don't exist yet
+        if (mode == FILE_MODE_READ || (res != -3 && res != -4)) return NULL;
+        if (fat16_create_entry(disk, parent, last, &dentry) != 0) return NULL;
     }
     
-    // Last part found. Ensure it's not a directory if we are opening a file.
-    if (item.attribute & FAT_FILE_SUBDIRECTORY) return NULL;
+    // Ensure it's not a directory if we are opening a file.
+    if (dentry.item.attribute & FAT_FILE_SUBDIRECTORY) return NULL;
+    if (mode != FILE_MODE_READ && (dentry.item.attribute & FAT_FILE_READ_ONLY)) return NULL;
     
+    struct fat_inode* inode = fat16_get_inode(disk, parent, &dentry);
+    if (!inode) return NULL;
+
     // Create descriptor
     struct fat_file_descriptor* desc = kmalloc(sizeof(struct fat_file_descriptor));
-    desc->item = item;
+    if (!desc) {
+        fat16_put_inode(disk, inode);
+        return NULL;
+    }
+    desc->inode = inode;
     desc->pos = 0;
-    desc->last_cluster = item.low_16_bits_first_cluster;
-    desc->last_cluster_pos = 0;
+    desc->disk = disk;
+    desc->mode = mode;
+
+    if (mode == FILE_MODE_WRITE && inode->item.filesize > 0) {
+        if (fat16_truncate_locked(disk, desc, 0) != 0) {
+            fat16_put_inode(disk, inode);
+            kfree(desc);
+            return NULL;
+        }
+    } else if (mode == FILE_MODE_APPEND) {
+        desc->pos = inode->item.filesize;
+    }
+    return desc;
+}
+
+// Opening for reading only looks things up; writers may create or
+// truncate the file, so they get the volume to themselves
+void* fat16_open(struct disk* disk, struct path_part* path, FILE_MODE mode) {
+    struct fat_private* private = disk->fs_private;
+    void* desc;
+
+    if (mode == FILE_MODE_READ) {
+        rwlock_read_lock(&private->lock);
+        desc = fat16_open_locked(disk, path, mode);
+        rwlock_read_unlock(&private->lock);
+    } else {
+        rwlock_write_lock(&private->lock);
+        desc = fat16_open_locked(disk, path, mode);
+        rwlock_write_unlock(&private->lock);
+    }
     return desc;
 }
 
 int fat16_resolve(struct disk* disk) {
-    struct disk_stream* stream = diskstream_new(disk->id);
-    if (!stream) return -1;
-    
+    if (fat16_volumes[disk->id]) {
+        disk->fs_private = fat16_volumes[disk->id];
+        return 0;
+    }
+
     struct fat_boot_sector bpb;
-    if (diskstream_read(stream, &bpb, sizeof(bpb)) != 0) {
-        diskstream_close(stream);
+    if (diskstream_pread(disk, &bpb, sizeof(bpb), 0) != 0) {
         return -2;
     }
     
     // Check boot signature 0xAA55 at offset 510
     if (bpb.boot_signature != 0xAA55) {
-        diskstream_close(stream);
         return -3;
     }
 
     // Check Extended BPB signature (0x28 or 0x29)
     if (bpb.signature != 0x29 && bpb.signature != 0x28) {
-        diskstream_close(stream);
         return -4;
     }
 
     // Basic consistency checks
-    if (bpb.bytes_per_sector != 512 || bpb.sectors_per_cluster == 0) {
-        diskstream_close(stream);
+    if (bpb.bytes_per_sector != 512 || bpb.sectors_per_cluster == 0 ||
+        (bpb.sectors_per_cluster & (bpb.sectors_per_cluster - 1)) != 0) {
         return -5;
     }
-    
+
+    if (bpb.fat_sectors == 0 || bpb.fat_sectors > FAT16_MAX_FAT_SECTORS || bpb.fat_copies == 0) {
+        return -6;
+    }
+
+    uint16_t* fat_cache = kmalloc(bpb.fat_sectors * bpb.bytes_per_sector);
+    if (!fat_cache) {
+        return -7;
+    }
+
     struct fat_private* private = kmalloc(sizeof(struct fat_private));
-    private->stream = stream;
+    if (!private) {
+        kfree(fat_cache);
+        return -7;
+    }
+    memset(private, 0, sizeof(struct fat_private));
+    rwlock_init(&private->lock);
+    spinlock_init(&private->fat_lock);
+    spinlock_init(&private->inodes_lock);
     private->bpb = bpb;
+    private->fat_cache = fat_cache;
     disk->fs_private = private;
+    fat16_volumes[disk->id] = private;
+
+    // Work out the layout once so cluster/sector maths is shifts and adds
+    uint32_t root_dir_sectors = ((bpb.root_dir_entries * 32) + (bpb.bytes_per_sector - 1)) / bpb.bytes_per_sector;
+    private->root_dir_sector = bpb.reserved_sectors + (bpb.fat_copies * bpb.fat_sectors);
+    private->first_data_sector = private->root_dir_sector + root_dir_sectors;
+    private->cluster_size = bpb.sectors_per_cluster * bpb.bytes_per_sector;
+    while ((1U << private->sectors_per_cluster_shift) < bpb.sectors_per_cluster) {
+        private->sectors_per_cluster_shift++;
+    }
+    private->cluster_shift = private->sectors_per_cluster_shift + 9; // 512 byte sectors
+    private->fat_entries_per_sector = bpb.bytes_per_sector / FAT16_ENTRY_SIZE;
+
+    uint32_t total_sectors = bpb.total_sectors ? bpb.total_sectors : bpb.sectors_big;
+    uint32_t data_start = private->first_data_sector;
+    private->total_clusters = total_sectors > data_start ? (total_sectors - data_start) >> private->sectors_per_cluster_shift : 0;
+    uint32_t fat_entries = bpb.fat_sectors * (bpb.bytes_per_sector / FAT16_ENTRY_SIZE);
+    if (private->total_clusters > fat_entries - 2) {
+        private->total_clusters = fat_entries - 2;
+    }
+    if (private->total_clusters > FAT16_CLUSTER_RESERVED_MIN - 2) {
+        private->total_clusters = FAT16_CLUSTER_RESERVED_MIN - 2;
+    }
     
     return 0;
 }
+
+int fat16_unmount(struct disk* disk) {
+    struct fat_private* private = disk->fs_private;
+    if (!private) return -1;
+
+    rwlock_write_lock(&private->lock);
+    int res = fat16_flush_fat(disk);
+    dcache_invalidate_disk(disk);
+    rwlock_write_unlock(&private->lock);
+
+    kfree(private->fat_cache);
+    if (private->free_bitmap) kfree(private->free_bitmap);
+    kfree(private);
+    disk->fs_private = NULL;
+    fat16_volumes[disk->id] = NULL;
+    return res;
+}
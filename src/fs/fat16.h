@@ -2,7 +2,10 @@
 #define FAT16_H
 
 #include <stdint.h>
+#include <stdbool.h>
 #include "../drivers/disk_stream.h"
+#include "file.h"
+#include "../task/lock.h"
 
 #define FAT16_SIGNATURE 0x29
 #define FAT16_ENTRY_SIZE 2
@@ -15,6 +18,9 @@
 #define FAT16_CLUSTER_LAST_MIN 0xFFF8
 #define FAT16_CLUSTER_LAST_MAX 0xFFFF
 
+// A FAT16 FAT holds at most 65536 entries, i.e. 128KB or 256 sectors
+#define FAT16_MAX_FAT_SECTORS 256
+
 typedef uint8_t FAT_DIRECTORY_ITEM_ATTRIB;
 #define FAT_FILE_READ_ONLY 0x01
 #define FAT_FILE_HIDDEN 0x02
@@ -69,31 +75,128 @@ struct fat_directory_item {
     uint32_t filesize;
 } __attribute__((packed));
 
+// A directory entry together with its byte position on disk
+struct fat_dentry {
+    struct fat_directory_item item;
+    uint32_t pos;
+};
+
 struct fat_private {
     struct fat_boot_sector bpb;
-    struct disk_stream* stream;
+
+    // Shared by lookups and reads, exclusive for anything that changes the
+    // FAT, a directory or a file's size. Disk access is positional, so
+    // holders of the shared side never disturb each other.
+    struct rwlock lock;
+
+    // Guards the loaded-sector bits of the FAT cache, which readers set
+    // when they page a sector in, and the open inode list
+    struct spinlock fat_lock;
+    struct spinlock inodes_lock;
+
+    // In-memory copy of the FAT, paged in a sector at a time on first use.
+    // Dirty sectors are written back to every FAT copy by fat16_flush_fat.
+    uint16_t* fat_cache;
+    uint32_t fat_loaded[FAT16_MAX_FAT_SECTORS / 32];
+    uint32_t fat_dirty[FAT16_MAX_FAT_SECTORS / 32];
+    uint32_t total_clusters;
+
+    // One bit per cluster, set when the cluster is in use. Built from the
+    // FAT on the first allocation and kept in step with every FAT update.
+    uint32_t* free_bitmap;
+    uint32_t free_clusters;
+
+    // Files currently open on this volume
+    struct fat_inode* inodes;
+
+    // Geometry precomputed at mount time
+    uint32_t root_dir_sector;
+    uint32_t first_data_sector;
+    uint32_t cluster_size;
+    uint32_t cluster_shift;  // log2(cluster_size)
+    uint32_t sectors_per_cluster_shift;
+    uint32_t fat_entries_per_sector;
+};
+
+// A run of physically contiguous clusters within a file
+struct fat_extent {
+    uint32_t file_cluster; // Index of the run's first cluster within the file
+    uint32_t disk_cluster; // Cluster number on disk
+    uint32_t length;       // Clusters in the run
+};
+
+// In-core state of an open file, shared by every descriptor open on it so
+// size and cluster chain changes are seen through all of them
+struct fat_inode {
+    struct fat_directory_item item;
+
+    // Readers of the file share it; extending the extent map takes it
+    // exclusively. Taken inside the mount lock.
+    struct rwlock lock;
+
+    // Where the directory entry lives, so size and first cluster can be
+    // written back as the file changes. dirent_pos doubles as the inode
+    // number handed to the VFS.
+    uint32_t parent_cluster;
+    uint32_t dirent_pos;
+
+    // Extent map of the cluster chain, extended lazily as reads reach
+    // further into the file so any offset maps with a binary search
+    struct fat_extent* extents;
+    uint32_t extent_count;
+    uint32_t extent_capacity;
+    uint32_t mapped_clusters;
+    bool extents_complete;
+
+    // Set once clusters are allocated so the last close trims any left
+    // past the end of the file
+    bool allocated;
+    int refcount;
+    struct fat_inode* next;
+};
+
+// Open directory. The readdir cursor is an entry index; the cluster holding
+// the last entry read is remembered so sequential reads don't rewalk the chain.
+struct fat_directory {
+    uint32_t cluster; // First cluster, 0 for the root directory
+    uint32_t walk_index;
+    uint32_t walk_cluster;
 };
 
 // Generic Filesystem Interface (Simplified for now)
 struct fat_file_descriptor {
-    struct fat_directory_item item;
+    struct fat_inode* inode;
     uint32_t pos;
-    uint32_t last_cluster;
-    uint32_t last_cluster_pos;
+    struct disk* disk;
+    FILE_MODE mode;
 };
 
-#include "file.h"
-
 int fat16_resolve(struct disk* disk);
+int fat16_unmount(struct disk* disk);
 void* fat16_open(struct disk* disk, struct path_part* path, FILE_MODE mode);
 struct filesystem* fat16_init_vfs();
 
 int fat16_read(struct disk* disk, void* private, uint32_t size, uint32_t nmemb, char* out);
+int fat16_write(struct disk* disk, void* private, uint32_t size, uint32_t nmemb, const char* in);
+int fat16_pread(struct disk* disk, void* private, char* out, uint32_t count, uint32_t offset);
+int fat16_pwrite(struct disk* disk, void* private, const char* in, uint32_t count, uint32_t offset);
+int fat16_preadv(struct disk* disk, void* private, const struct fs_iovec* iov, int iovcnt, uint32_t offset);
+int fat16_pwritev(struct disk* disk, void* private, const struct fs_iovec* iov, int iovcnt, uint32_t offset);
+int fat16_truncate(struct disk* disk, void* private, uint32_t size);
+int fat16_fallocate(struct disk* disk, void* private, uint32_t length);
+int fat16_unlink(struct disk* disk, struct path_part* path);
 int fat16_seek(void* private, int offset, FILE_SEEK_MODE whence);
 int fat16_tell(void* private);
 int fat16_close(void* private);
 int fat16_stat(struct disk* disk, void* private, struct file_stat* stat);
-int fat16_list(struct disk* disk, struct path_part* path);
+void* fat16_opendir(struct disk* disk, struct path_part* path);
+int fat16_readdir(struct disk* disk, void* private, uint32_t* cursor, struct fs_dirent* entries, uint32_t count);
+int fat16_closedir(void* private);
+
+// FAT table access (served from the in-memory FAT cache)
+uint32_t fat16_get_fat_entry(struct disk* disk, uint32_t cluster);
+int fat16_set_fat_entry(struct disk* disk, uint32_t cluster, uint16_t value);
+int fat16_flush_fat(struct disk* disk);
 
 // For Testing
 uint32_t fat16_cluster_to_sector(struct disk* disk, uint32_t cluster);
@@ -2,15 +2,27 @@
 #include "../memory/heap/kheap.h"
 #include "../string/string.h"
 #include "path_parser.h"
+#include "dcache.h"
+#include "pagecache.h"
+#include "../task/lock.h"
 #include <stddef.h>
 
 #define MAX_FILESYSTEMS 12
-#define MAX_FILE_DESCRIPTORS 512
 
 static struct filesystem* filesystems[MAX_FILESYSTEMS];
-static struct file_descriptor* file_descriptors[MAX_FILE_DESCRIPTORS];
 
-static struct disk disks[2];
+// Descriptors resolve in the running process's table; the kernel has its
+// own for when no process is running
+static struct file_table kernel_files;
+static struct file_table* current_files = &kernel_files;
+
+static struct mutex fs_mutex;
+
+// Filesystem mounted on each drive, indexed by drive number
+static struct filesystem* mounts[MAX_DISKS];
+
+// Open files on each drive, so unmount can tell it is busy
+static int open_files[MAX_DISKS];
 
 static struct filesystem** fs_get_free_filesystem() {
     for (int i = 0; i < MAX_FILESYSTEMS; i++) {
@@ -23,11 +35,21 @@ static struct filesystem** fs_get_free_filesystem() {
 
 void fs_init() {
     memset(filesystems, 0, sizeof(filesystems));
-    memset(file_descriptors, 0, sizeof(file_descriptors));
-    memset(disks, 0, sizeof(disks));
-    for (int i = 0; i < 2; i++) {
-        disks[i].id = i;
-    }
+    memset(mounts, 0, sizeof(mounts));
+    memset(open_files, 0, sizeof(open_files));
+    file_table_init(&kernel_files);
+    current_files = &kernel_files;
+    mutex_init(&fs_mutex);
+    dcache_init();
+    pagecache_init();
+}
+
+void fs_lock() {
+    mutex_lock(&fs_mutex);
+}
+
+void fs_unlock() {
+    mutex_unlock(&fs_mutex);
 }
 
 int fs_insert_filesystem(struct filesystem* fs) {
@@ -37,21 +59,109 @@ int fs_insert_filesystem(struct filesystem* fs) {
     return 0;
 }
 
-static struct file_descriptor* fs_new_descriptor() {
-    for (int i = 0; i < MAX_FILE_DESCRIPTORS; i++) {
-        if (file_descriptors[i] == NULL) {
-            struct file_descriptor* desc = kmalloc(sizeof(struct file_descriptor));
-            desc->index = i + 1;
-            file_descriptors[i] = desc;
-            return desc;
+void file_table_init(struct file_table* table) {
+    memset(table->files, 0, sizeof(table->files));
+    memset(table->free, 0xFF, sizeof(table->free));
+    table->free_words = (1U << FILE_TABLE_WORDS) - 1;
+}
+
+static void file_table_mark_used(struct file_table* table, int slot) {
+    int word = slot / 32;
+    table->free[word] &= ~(1U << (slot % 32));
+    if (!table->free[word]) {
+        table->free_words &= ~(1U << word);
+    }
+}
+
+static void file_table_mark_free(struct file_table* table, int slot) {
+    int word = slot / 32;
+    table->free[word] |= 1U << (slot % 32);
+    table->free_words |= 1U << word;
+}
+
+// Install `desc` at the lowest free descriptor
+static int file_table_alloc(struct file_table* table, struct file_descriptor* desc) {
+    if (!table->free_words) return -1;
+
+    int word = __builtin_ctz(table->free_words);
+    int slot = word * 32 + __builtin_ctz(table->free[word]);
+    file_table_mark_used(table, slot);
+    table->files[slot] = desc;
+    return slot + 1;
+}
+
+static struct file_descriptor* file_table_get(struct file_table* table, int fd) {
+    if (fd <= 0 || fd > FILE_TABLE_SIZE) return NULL;
+    return table->files[fd - 1];
+}
+
+static void file_table_remove(struct file_table* table, int fd) {
+    table->files[fd - 1] = NULL;
+    file_table_mark_free(table, fd - 1);
+}
+
+// Create an open file with one reference and give it a descriptor
+static struct file_descriptor* fs_new_descriptor(struct disk* disk, int* fd) {
+    struct file_descriptor* desc = kmalloc(sizeof(struct file_descriptor));
+    if (!desc) return NULL;
+    memset(desc, 0, sizeof(struct file_descriptor));
+
+    *fd = file_table_alloc(current_files, desc);
+    if (*fd < 0) {
+        kfree(desc);
+        return NULL;
+    }
+
+    desc->refcount = 1;
+    desc->disk = disk;
+    open_files[disk->id]++;
+    return desc;
+}
+
+// Drop a reference to an open file, closing it with the last one
+static int fs_release(struct file_descriptor* desc) {
+    if (--desc->refcount > 0) return 0;
+
+    int res = 0;
+    struct filesystem* fs = desc->filesystem;
+    if (desc->directory) {
+        res = fs->closedir ? fs->closedir(desc->private) : 0;
+    } else if (!desc->cache || !pagecache_release(desc->cache, desc->private)) {
+        // A writer closing with dirty pages hands its handle to the cache
+        res = fs->close ? fs->close(desc->private) : 0;
+    }
+
+    open_files[desc->disk->id]--;
+    kfree(desc);
+    return res;
+}
+
+int file_table_copy(struct file_table* dst, struct file_table* src) {
+    memcpy(dst, src, sizeof(struct file_table));
+    for (int i = 0; i < FILE_TABLE_SIZE; i++) {
+        if (dst->files[i]) {
+            dst->files[i]->refcount++;
         }
     }
-    return NULL;
+    return 0;
+}
+
+void file_table_close_all(struct file_table* table) {
+    for (int i = 0; i < FILE_TABLE_SIZE; i++) {
+        if (table->files[i]) {
+            fs_release(table->files[i]);
+        }
+    }
+    file_table_init(table);
+}
+
+void fs_set_file_table(struct file_table* table) {
+    current_files = table ? table : &kernel_files;
 }
 
 static struct file_descriptor* fs_get_descriptor(int fd) {
-    if (fd <= 0 || fd > MAX_FILE_DESCRIPTORS) return NULL;
-    return file_descriptors[fd - 1];
+    struct file_descriptor* desc = file_table_get(current_files, fd);
+    return desc && !desc->directory ? desc : NULL;
 }
 
 struct filesystem* fs_resolve(struct disk* disk) {
@@ -63,6 +173,50 @@ struct filesystem* fs_resolve(struct disk* disk) {
     return NULL;
 }
 
+int fs_mount(int drive_no) {
+    struct disk* disk = disk_get(drive_no);
+    if (!disk) return -1;
+    if (mounts[drive_no]) return 0;
+
+    struct filesystem* fs = fs_resolve(disk);
+    if (!fs) return -2;
+
+    mounts[drive_no] = fs;
+    return 0;
+}
+
+int fs_unmount(int drive_no) {
+    struct disk* disk = disk_get(drive_no);
+    if (!disk || !mounts[drive_no]) return -1;
+
+    // Write back cached data first; this also closes handles the cache
+    // kept open for write-back
+    pagecache_flush_disk(disk);
+
+    if (open_files[drive_no] > 0) {
+        return -2; // Busy
+    }
+
+    struct filesystem* fs = mounts[drive_no];
+    pagecache_invalidate_disk(disk);
+    int res = fs->unmount ? fs->unmount(disk) : 0;
+    mounts[drive_no] = NULL;
+    return res;
+}
+
+// Return the filesystem mounted on the disk, mounting it on first use
+struct filesystem* fs_get_mount(struct disk* disk) {
+    if (!mounts[disk->id] && fs_mount(disk->id) != 0) {
+        return NULL;
+    }
+    return mounts[disk->id];
+}
+
+struct filesystem* fs_get_mounted(int drive_no) {
+    if (drive_no < 0 || drive_no >= MAX_DISKS) return NULL;
+    return mounts[drive_no];
+}
+
 static FILE_MODE fs_parse_mode(const char* str) {
     if (strncmp(str, "r", 1) == 0) return FILE_MODE_READ;
     if (strncmp(str, "w", 1) == 0) return FILE_MODE_WRITE;
@@ -72,25 +226,24 @@ static FILE_MODE fs_parse_mode(const char* str) {
 
 int fopen(const char* filename, const char* mode_str) {
     int res = 0;
-    struct path_root* root_path = path_parser_parse(filename, NULL);
-    if (!root_path) {
+    struct path_root root_path;
+    if (path_parser_parse(&root_path, filename) != 0) {
         res = -1;
         goto out;
     }
 
-    if (!root_path->first) {
+    if (!root_path.first) {
         res = -2;
         goto out;
     }
 
-    int drive_no = root_path->drive_no;
-    if (drive_no < 0 || drive_no > 1) {
+    struct disk* disk = disk_get(root_path.drive_no);
+    if (!disk) {
         res = -3;
         goto out;
     }
-    
-    struct disk* disk = &disks[drive_no];
-    struct filesystem* fs = fs_resolve(disk);
+
+    struct filesystem* fs = fs_get_mount(disk);
     if (!fs) {
         res = -4;
         goto out;
@@ -102,83 +255,481 @@ int fopen(const char* filename, const char* mode_str) {
         goto out;
     }
 
-    void* fs_private = fs->open(disk, root_path->first, mode);
+    void* fs_private = fs->open(disk, root_path.first, mode);
     if (!fs_private) {
         res = -6;
         goto out;
     }
 
-    struct file_descriptor* desc = fs_new_descriptor();
+    int fd;
+    struct file_descriptor* desc = fs_new_descriptor(disk, &fd);
     if (!desc) {
+        fs->close(fs_private);
         res = -7;
         goto out;
     }
 
     desc->filesystem = fs;
     desc->private = fs_private;
-    desc->disk = disk;
-    res = desc->index;
+    desc->mode = mode;
 
-out:
-    if (root_path) {
-        path_parser_free(root_path);
+    struct file_stat stat;
+    if (!(fs->flags & FS_FLAG_MEMORY) && fs->pread && fs->stat && fs->stat(disk, fs_private, &stat) == 0) {
+        desc->cache = pagecache_open(disk, fs, stat.ino, stat.filesize);
+        if (desc->cache && mode == FILE_MODE_WRITE) {
+            // The filesystem truncated the file; drop what the cache holds
+            pagecache_truncate(desc->cache, 0);
+        } else if (desc->cache && mode == FILE_MODE_APPEND) {
+            desc->pos = desc->cache->size;
+        }
     }
+    res = fd;
+
+out:
+    return res;
+}
+
+// Reads through the page cache let fs_lock go: the cache has its own lock,
+// and a miss waiting on the disk shouldn't hold up every other task's
+// filesystem calls. Descriptors belong to the calling task's table, so
+// nothing closes this one meanwhile.
+static int fs_cached_read(struct file_descriptor* desc, char* out, uint32_t count, uint32_t offset) {
+    fs_unlock();
+    int res = pagecache_read(desc->cache, desc->private, out, count, offset);
+    fs_lock();
     return res;
 }
 
 int fread(void* ptr, uint32_t size, uint32_t nmemb, int fd) {
     struct file_descriptor* desc = fs_get_descriptor(fd);
-    if (!desc || !desc->filesystem->read) return -1;
+    if (!desc || size == 0) return -1;
+
+    if (desc->cache) {
+        int res = fs_cached_read(desc, (char*)ptr, size * nmemb, desc->pos);
+        if (res < 0) return res;
+        desc->pos += res;
+        return res / size;
+    }
+
+    if (!desc->filesystem->read) return -1;
     return desc->filesystem->read(desc->disk, desc->private, size, nmemb, (char*)ptr);
 }
 
+int fwrite(const void* ptr, uint32_t size, uint32_t nmemb, int fd) {
+    struct file_descriptor* desc = fs_get_descriptor(fd);
+    if (!desc || size == 0) return -1;
+
+    if (desc->cache) {
+        if (desc->mode == FILE_MODE_READ) return -1;
+        if (desc->mode == FILE_MODE_APPEND) {
+            desc->pos = desc->cache->size;
+        }
+
+        int res = pagecache_write(desc->cache, desc->private, (const char*)ptr, size * nmemb, desc->pos);
+        if (res < 0) return res;
+        desc->pos += res;
+        return res / size;
+    }
+
+    if (!desc->filesystem->write) return -1;
+    return desc->filesystem->write(desc->disk, desc->private, size, nmemb, (const char*)ptr);
+}
+
+// Move each buffer in turn at consecutive offsets, stopping at the first
+// short transfer. Used when the filesystem has no vectored op of its own.
+static int fs_transfer_vector(struct file_descriptor* desc, const struct fs_iovec* iov, int iovcnt, uint32_t offset, bool write) {
+    struct filesystem* fs = desc->filesystem;
+    uint32_t total = 0;
+
+    for (int i = 0; i < iovcnt; i++) {
+        int res;
+        if (desc->cache) {
+            res = write ? pagecache_write(desc->cache, desc->private, iov[i].base, iov[i].len, offset + total)
+                        : fs_cached_read(desc, iov[i].base, iov[i].len, offset + total);
+        } else if (write) {
+            if (!fs->pwrite) return -1;
+            res = fs->pwrite(desc->disk, desc->private, iov[i].base, iov[i].len, offset + total);
+        } else {
+            if (!fs->pread) return -1;
+            res = fs->pread(desc->disk, desc->private, iov[i].base, iov[i].len, offset + total);
+        }
+
+        if (res < 0) return total ? (int)total : res;
+        total += res;
+        if ((uint32_t)res < iov[i].len) break;
+    }
+
+    return total;
+}
+
+static int fs_preadv_file(struct file_descriptor* desc, const struct fs_iovec* iov, int iovcnt, uint32_t offset) {
+    // Cached files must be read through the cache, which may hold data the
+    // filesystem hasn't seen yet
+    if (!desc->cache && desc->filesystem->preadv) {
+        return desc->filesystem->preadv(desc->disk, desc->private, iov, iovcnt, offset);
+    }
+    return fs_transfer_vector(desc, iov, iovcnt, offset, false);
+}
+
+int preadv(int fd, const struct fs_iovec* iov, int iovcnt, uint32_t offset) {
+    struct file_descriptor* desc = fs_get_descriptor(fd);
+    if (!desc || iovcnt < 0) return -1;
+    return fs_preadv_file(desc, iov, iovcnt, offset);
+}
+
+// Positional writes go where they are told, even in append mode
+int pwritev(int fd, const struct fs_iovec* iov, int iovcnt, uint32_t offset) {
+    struct file_descriptor* desc = fs_get_descriptor(fd);
+    if (!desc || iovcnt < 0 || desc->mode == FILE_MODE_READ) return -1;
+
+    if (!desc->cache && desc->filesystem->pwritev) {
+        return desc->filesystem->pwritev(desc->disk, desc->private, iov, iovcnt, offset);
+    }
+    return fs_transfer_vector(desc, iov, iovcnt, offset, true);
+}
+
+int pread(int fd, void* buf, uint32_t count, uint32_t offset) {
+    struct fs_iovec iov = { buf, count };
+    return preadv(fd, &iov, 1, offset);
+}
+
+int pwrite(int fd, const void* buf, uint32_t count, uint32_t offset) {
+    struct fs_iovec iov = { (void*)buf, count };
+    return pwritev(fd, &iov, 1, offset);
+}
+
+int readv(int fd, const struct fs_iovec* iov, int iovcnt) {
+    struct file_descriptor* desc = fs_get_descriptor(fd);
+    if (!desc) return -1;
+
+    if (desc->cache) {
+        int res = preadv(fd, iov, iovcnt, desc->pos);
+        if (res > 0) desc->pos += res;
+        return res;
+    }
+
+    // The filesystem keeps the position; let it advance buffer by buffer
+    int total = 0;
+    for (int i = 0; i < iovcnt; i++) {
+        if (iov[i].len == 0) continue;
+        int res = fread(iov[i].base, 1, iov[i].len, fd);
+        if (res < 0) return total ? total : res;
+        total += res;
+        if ((uint32_t)res < iov[i].len) break;
+    }
+    return total;
+}
+
+int writev(int fd, const struct fs_iovec* iov, int iovcnt) {
+    struct file_descriptor* desc = fs_get_descriptor(fd);
+    if (!desc) return -1;
+
+    if (desc->cache) {
+        if (desc->mode == FILE_MODE_APPEND) {
+            desc->pos = desc->cache->size;
+        }
+        int res = pwritev(fd, iov, iovcnt, desc->pos);
+        if (res > 0) desc->pos += res;
+        return res;
+    }
+
+    int total = 0;
+    for (int i = 0; i < iovcnt; i++) {
+        if (iov[i].len == 0) continue;
+        int res = fwrite(iov[i].base, 1, iov[i].len, fd);
+        if (res < 0) return total ? total : res;
+        total += res;
+        if ((uint32_t)res < iov[i].len) break;
+    }
+    return total;
+}
+
+int ftruncate(int fd, uint32_t size) {
+    struct file_descriptor* desc = fs_get_descriptor(fd);
+    if (!desc || !desc->filesystem->truncate) return -1;
+
+    // Bring the filesystem up to date so it truncates what the file holds
+    if (desc->cache && pagecache_flush_file(desc->cache) != 0) return -2;
+
+    int res = desc->filesystem->truncate(desc->disk, desc->private, size);
+    if (res == 0 && desc->cache) {
+        pagecache_truncate(desc->cache, size);
+        if (desc->pos > size) desc->pos = size;
+    }
+    return res;
+}
+
+int fallocate(int fd, uint32_t length) {
+    struct file_descriptor* desc = fs_get_descriptor(fd);
+    if (!desc || !desc->filesystem->fallocate) return -1;
+    return desc->filesystem->fallocate(desc->disk, desc->private, length);
+}
+
+int funlink(const char* filename) {
+    int res = 0;
+    struct path_root root_path;
+    if (path_parser_parse(&root_path, filename) != 0) {
+        res = -1;
+        goto out;
+    }
+
+    if (!root_path.first) {
+        res = -2;
+        goto out;
+    }
+
+    struct disk* disk = disk_get(root_path.drive_no);
+    if (!disk) {
+        res = -3;
+        goto out;
+    }
+
+    struct filesystem* fs = fs_get_mount(disk);
+    if (!fs || !fs->unlink) {
+        res = -4;
+        goto out;
+    }
+
+    // Let the cache close any handle it holds for write-back first
+    pagecache_flush_disk(disk);
+    res = fs->unlink(disk, root_path.first);
+
+out:
+    return res;
+}
+
+int mkdir(const char* path) {
+    int res = 0;
+    struct path_root root_path;
+    if (path_parser_parse(&root_path, path) != 0) {
+        res = -1;
+        goto out;
+    }
+
+    if (!root_path.first) {
+        res = -2;
+        goto out;
+    }
+
+    struct disk* disk = disk_get(root_path.drive_no);
+    if (!disk) {
+        res = -3;
+        goto out;
+    }
+
+    struct filesystem* fs = fs_get_mount(disk);
+    if (!fs || !fs->mkdir) {
+        res = -4;
+        goto out;
+    }
+
+    res = fs->mkdir(disk, root_path.first);
+
+out:
+    return res;
+}
+
 int fseek(int fd, int offset, FILE_SEEK_MODE whence) {
     struct file_descriptor* desc = fs_get_descriptor(fd);
-    if (!desc || !desc->filesystem->seek) return -1;
+    if (!desc) return -1;
+
+    if (desc->cache) {
+        uint32_t new_pos = desc->pos;
+        switch (whence) {
+            case FILE_SEEK_SET:
+                new_pos = offset;
+                break;
+            case FILE_SEEK_CUR:
+                new_pos += offset;
+                break;
+            case FILE_SEEK_END:
+                new_pos = desc->cache->size + offset;
+                break;
+        }
+
+        if (new_pos > desc->cache->size) return -1;
+        desc->pos = new_pos;
+        return 0;
+    }
+
+    if (!desc->filesystem->seek) return -1;
     return desc->filesystem->seek(desc->private, offset, whence);
 }
 
 int ftell(int fd) {
     struct file_descriptor* desc = fs_get_descriptor(fd);
-    if (!desc || !desc->filesystem->tell) return -1;
+    if (!desc) return -1;
+    if (desc->cache) return desc->pos;
+    if (!desc->filesystem->tell) return -1;
     return desc->filesystem->tell(desc->private);
 }
 
 int fstat(int fd, struct file_stat* stat) {
     struct file_descriptor* desc = fs_get_descriptor(fd);
     if (!desc || !desc->filesystem->stat) return -1;
-    return desc->filesystem->stat(desc->disk, desc->private, stat);
+    int res = desc->filesystem->stat(desc->disk, desc->private, stat);
+    if (res == 0 && desc->cache) {
+        stat->filesize = desc->cache->size;
+    }
+    return res;
+}
+
+int fsync(int fd) {
+    struct file_descriptor* desc = fs_get_descriptor(fd);
+    if (!desc) return -1;
+    if (!desc->cache) return 0;
+    return pagecache_flush_file(desc->cache);
+}
+
+int fs_sync() {
+    return pagecache_sync();
 }
 
 int fclose(int fd) {
     struct file_descriptor* desc = fs_get_descriptor(fd);
-    if (!desc || !desc->filesystem->close) return -1;
-    int res = desc->filesystem->close(desc->private);
-    if (res == 0) {
-        file_descriptors[desc->index - 1] = NULL;
-        kfree(desc);
+    if (!desc) return -1;
+
+    file_table_remove(current_files, fd);
+    return fs_release(desc);
+}
+
+int dup(int fd) {
+    struct file_descriptor* desc = file_table_get(current_files, fd);
+    if (!desc) return -1;
+
+    int new_fd = file_table_alloc(current_files, desc);
+    if (new_fd < 0) return -2;
+
+    desc->refcount++;
+    return new_fd;
+}
+
+int dup2(int fd, int new_fd) {
+    struct file_descriptor* desc = file_table_get(current_files, fd);
+    if (!desc || new_fd <= 0 || new_fd > FILE_TABLE_SIZE) return -1;
+    if (new_fd == fd) return new_fd;
+
+    // Take the new reference first so closing the old one can't free desc
+    desc->refcount++;
+    struct file_descriptor* old = file_table_get(current_files, new_fd);
+    if (old) {
+        fs_release(old);
+    } else {
+        file_table_mark_used(current_files, new_fd - 1);
     }
-    return res;
+    current_files->files[new_fd - 1] = desc;
+    return new_fd;
 }
 
-int fs_list(const char* path) {
-    struct path_root* root_path = path_parser_parse(path, NULL);
-    if (!root_path) return -1;
+static struct file_descriptor* fs_get_dir_descriptor(int dd) {
+    struct file_descriptor* desc = file_table_get(current_files, dd);
+    return desc && desc->directory ? desc : NULL;
+}
 
-    int drive_no = root_path->drive_no;
-    if (drive_no < 0 || drive_no > 1) {
-        path_parser_free(root_path);
-        return -2;
+int opendir(const char* path) {
+    int res = 0;
+    struct path_root root_path;
+    if (path_parser_parse(&root_path, path) != 0) {
+        res = -1;
+        goto out;
     }
 
-    struct disk* disk = &disks[drive_no];
-    struct filesystem* fs = fs_resolve(disk);
-    if (!fs || !fs->list) {
-        path_parser_free(root_path);
-        return -3;
+    struct disk* disk = disk_get(root_path.drive_no);
+    if (!disk) {
+        res = -2;
+        goto out;
+    }
+
+    struct filesystem* fs = fs_get_mount(disk);
+    if (!fs || !fs->opendir || !fs->readdir) {
+        res = -3;
+        goto out;
     }
 
-    int res = fs->list(disk, root_path->first);
-    path_parser_free(root_path);
+    void* fs_private = fs->opendir(disk, root_path.first);
+    if (!fs_private) {
+        res = -4;
+        goto out;
+    }
+
+    int dd;
+    struct file_descriptor* desc = fs_new_descriptor(disk, &dd);
+    if (!desc) {
+        if (fs->closedir) fs->closedir(fs_private);
+        res = -5;
+        goto out;
+    }
+
+    desc->filesystem = fs;
+    desc->private = fs_private;
+    desc->mode = FILE_MODE_READ;
+    desc->directory = true;
+    res = dd;
+
+out:
     return res;
 }
+
+int readdir(int dd, struct fs_dirent* entries, uint32_t count) {
+    struct file_descriptor* desc = fs_get_dir_descriptor(dd);
+    if (!desc) return -1;
+    return desc->filesystem->readdir(desc->disk, desc->private, &desc->pos, entries, count);
+}
+
+int telldir(int dd) {
+    struct file_descriptor* desc = fs_get_dir_descriptor(dd);
+    if (!desc) return -1;
+    return desc->pos;
+}
+
+int seekdir(int dd, uint32_t cursor) {
+    struct file_descriptor* desc = fs_get_dir_descriptor(dd);
+    if (!desc) return -1;
+    desc->pos = cursor;
+    return 0;
+}
+
+int closedir(int dd) {
+    struct file_descriptor* desc = fs_get_dir_descriptor(dd);
+    if (!desc) return -1;
+
+    file_table_remove(current_files, dd);
+    return fs_release(desc);
+}
+
+struct file_descriptor* fs_hold(int fd) {
+    struct file_descriptor* desc = fs_get_descriptor(fd);
+    if (!desc) return NULL;
+    desc->refcount++;
+    return desc;
+}
+
+void fs_put(struct file_descriptor* desc) {
+    fs_release(desc);
+}
+
+int fs_pread_file(struct file_descriptor* desc, void* buf, uint32_t count, uint32_t offset) {
+    struct fs_iovec iov = { buf, count };
+    return fs_preadv_file(desc, &iov, 1, offset);
+}
+
+// The page to map in place for file page `index`, or NULL if the caller has
+// to make its own copy. `pin` is handed back to fs_unmap_page when done.
+void* fs_map_page(struct file_descriptor* desc, uint32_t index, void** pin) {
+    *pin = NULL;
+    if (desc->cache) {
+        // Like reads, pinning may wait on the disk, so fs_lock is let go
+        fs_unlock();
+        struct pagecache_page* page = pagecache_pin(desc->cache, desc->private, index);
+        fs_lock();
+        *pin = page;
+        return page ? page->data : NULL;
+    }
+
+    struct filesystem* fs = desc->filesystem;
+    return fs->map_page ? fs->map_page(desc->disk, desc->private, index) : NULL;
+}
+
+void fs_unmap_page(void* pin) {
+    if (pin) pagecache_unpin(pin);
+}
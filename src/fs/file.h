@@ -3,7 +3,9 @@
 
 #include <stdint.h>
 #include <stddef.h>
+#include <stdbool.h>
 #include "path_parser.h"
+#include "../drivers/disk.h"
 
 typedef enum {
     FILE_MODE_READ,
@@ -18,26 +20,63 @@ typedef enum {
     FILE_SEEK_END
 } FILE_SEEK_MODE;
 
-struct disk {
-    int id;
-    void* fs_private;
-};
-
 struct filesystem;
 
+struct pagecache_file;
+
+// One buffer of a scatter/gather transfer
+struct fs_iovec {
+    void* base;
+    uint32_t len;
+};
+
+// An open file. Descriptor tables point at it; dup and fork share it,
+// along with its position, and it is closed when the last one lets go.
 struct file_descriptor {
-    int index;
+    int refcount;
     struct filesystem* filesystem;
     void* private;
     struct disk* disk;
+    FILE_MODE mode;
+
+    // Files on filesystems with positional I/O go through the page cache,
+    // and the position is kept here rather than by the filesystem
+    struct pagecache_file* cache;
+    uint32_t pos;
+
+    // Directory handles keep their readdir cursor in pos
+    bool directory;
+};
+
+#define FILE_TABLE_SIZE 256
+#define FILE_TABLE_WORDS (FILE_TABLE_SIZE / 32) // At most 32
+
+// Descriptor numbers are slot + 1. A set bit in `free` marks a free slot
+// and a set bit in `free_words` a word of `free` that has one, so the
+// lowest free descriptor is two bit scans away.
+struct file_table {
+    struct file_descriptor* files[FILE_TABLE_SIZE];
+    uint32_t free[FILE_TABLE_WORDS];
+    uint32_t free_words;
 };
 
 typedef void* (*FS_OPEN_FUNCTION)(struct disk* disk, struct path_part* path, FILE_MODE mode);
 typedef int (*FS_READ_FUNCTION)(struct disk* disk, void* private, uint32_t size, uint32_t nmemb, char* out);
+typedef int (*FS_WRITE_FUNCTION)(struct disk* disk, void* private, uint32_t size, uint32_t nmemb, const char* in);
+typedef int (*FS_TRUNCATE_FUNCTION)(struct disk* disk, void* private, uint32_t size);
+typedef int (*FS_FALLOCATE_FUNCTION)(struct disk* disk, void* private, uint32_t length);
+typedef int (*FS_UNLINK_FUNCTION)(struct disk* disk, struct path_part* path);
+typedef int (*FS_MKDIR_FUNCTION)(struct disk* disk, struct path_part* path);
+typedef int (*FS_PREAD_FUNCTION)(struct disk* disk, void* private, char* out, uint32_t count, uint32_t offset);
+typedef int (*FS_PWRITE_FUNCTION)(struct disk* disk, void* private, const char* in, uint32_t count, uint32_t offset);
+typedef int (*FS_PREADV_FUNCTION)(struct disk* disk, void* private, const struct fs_iovec* iov, int iovcnt, uint32_t offset);
+typedef int (*FS_PWRITEV_FUNCTION)(struct disk* disk, void* private, const struct fs_iovec* iov, int iovcnt, uint32_t offset);
 typedef int (*FS_SEEK_FUNCTION)(void* private, int offset, FILE_SEEK_MODE whence);
 typedef int (*FS_CLOSE_FUNCTION)(void* private);
 typedef int (*FS_TELL_FUNCTION)(void* private);
-typedef int (*FS_LIST_FUNCTION)(struct disk* disk, struct path_part* path);
+// Memory the file's page `index` lives in, for filesystems that keep file
+// data page-aligned in RAM; NULL when it isn't.
+typedef void* (*FS_MAP_PAGE_FUNCTION)(struct disk* disk, void* private, uint32_t index);
 
 typedef uint32_t FILE_STAT_FLAGS;
 #define FILE_STAT_READ_ONLY 0x01
@@ -50,34 +89,112 @@ typedef uint32_t FILE_STAT_FLAGS;
 struct file_stat {
     FILE_STAT_FLAGS flags;
     uint32_t filesize;
+    uint32_t ino; // Identifies the file within its filesystem
 };
 
 typedef int (*FS_STAT_FUNCTION)(struct disk* disk, void* private, struct file_stat* stat);
 
+#define FS_DIRENT_NAME_LEN 32
+
+struct fs_dirent {
+    char name[FS_DIRENT_NAME_LEN];
+    uint32_t size;
+    FILE_STAT_FLAGS flags;
+    uint32_t first_cluster; // Filesystem specific location (FAT16: first cluster)
+};
+
+// readdir fills up to `count` entries starting at *cursor and advances the
+// cursor past them. It returns the number filled, 0 at the end.
+typedef void* (*FS_OPENDIR_FUNCTION)(struct disk* disk, struct path_part* path);
+typedef int (*FS_READDIR_FUNCTION)(struct disk* disk, void* private, uint32_t* cursor, struct fs_dirent* entries, uint32_t count);
+typedef int (*FS_CLOSEDIR_FUNCTION)(void* private);
+
 typedef int (*FS_RESOLVE_FUNCTION)(struct disk* disk);
+typedef int (*FS_UNMOUNT_FUNCTION)(struct disk* disk);
+
+// File data already lives in memory; the VFS skips the page cache
+#define FS_FLAG_MEMORY 0x01
 
 struct filesystem {
     char name[20];
+    uint32_t flags;
     FS_RESOLVE_FUNCTION resolve;
+    FS_UNMOUNT_FUNCTION unmount;
     FS_OPEN_FUNCTION open;
     FS_READ_FUNCTION read;
     FS_SEEK_FUNCTION seek;
     FS_TELL_FUNCTION tell;
     FS_CLOSE_FUNCTION close;
     FS_STAT_FUNCTION stat;
-    FS_LIST_FUNCTION list;
+    FS_OPENDIR_FUNCTION opendir;
+    FS_READDIR_FUNCTION readdir;
+    FS_CLOSEDIR_FUNCTION closedir;
+    FS_WRITE_FUNCTION write;
+    FS_TRUNCATE_FUNCTION truncate;
+    FS_FALLOCATE_FUNCTION fallocate;
+    FS_UNLINK_FUNCTION unlink;
+    FS_PREAD_FUNCTION pread;
+    FS_PWRITE_FUNCTION pwrite;
+    FS_MKDIR_FUNCTION mkdir;
+    FS_PREADV_FUNCTION preadv;
+    FS_PWRITEV_FUNCTION pwritev;
+    FS_MAP_PAGE_FUNCTION map_page;
 };
 
 void fs_init();
 int fs_insert_filesystem(struct filesystem* fs);
 struct filesystem* fs_resolve(struct disk* disk);
+int fs_mount(int drive_no);
+int fs_unmount(int drive_no);
+struct filesystem* fs_get_mount(struct disk* disk);
+struct filesystem* fs_get_mounted(int drive_no);
+
+void file_table_init(struct file_table* table);
+int file_table_copy(struct file_table* dst, struct file_table* src);
+void file_table_close_all(struct file_table* table);
+void fs_set_file_table(struct file_table* table);
+
+// Serializes the calls that change files or the namespace, and the
+// filesystems without a page cache in front of them. Tasks that can reach
+// them concurrently (the shell, faults on file mappings) hold this around
+// them. Reads of cached files let it go for the transfer; the page cache
+// has its own lock.
+void fs_lock();
+void fs_unlock();
 
 int fopen(const char* filename, const char* mode_str);
 int fread(void* ptr, uint32_t size, uint32_t nmemb, int fd);
+int fwrite(const void* ptr, uint32_t size, uint32_t nmemb, int fd);
+int pread(int fd, void* buf, uint32_t count, uint32_t offset);
+int pwrite(int fd, const void* buf, uint32_t count, uint32_t offset);
+int preadv(int fd, const struct fs_iovec* iov, int iovcnt, uint32_t offset);
+int pwritev(int fd, const struct fs_iovec* iov, int iovcnt, uint32_t offset);
+int readv(int fd, const struct fs_iovec* iov, int iovcnt);
+int writev(int fd, const struct fs_iovec* iov, int iovcnt);
+int ftruncate(int fd, uint32_t size);
+int fallocate(int fd, uint32_t length);
+int funlink(const char* filename);
+int mkdir(const char* path);
 int fseek(int fd, int offset, FILE_SEEK_MODE whence);
 int ftell(int fd);
 int fstat(int fd, struct file_stat* stat);
 int fclose(int fd);
-int fs_list(const char* path);
+int dup(int fd);
+int dup2(int fd, int new_fd);
+int fsync(int fd);
+int fs_sync();
+int opendir(const char* path);
+int readdir(int dd, struct fs_dirent* entries, uint32_t count);
+int telldir(int dd);
+int seekdir(int dd, uint32_t cursor);
+int closedir(int dd);
+
+// Memory mappings hold the open file itself rather than a descriptor, so
+// a mapping outlives fclose
+struct file_descriptor* fs_hold(int fd);
+void fs_put(struct file_descriptor* desc);
+int fs_pread_file(struct file_descriptor* desc, void* buf, uint32_t count, uint32_t offset);
+void* fs_map_page(struct file_descriptor* desc, uint32_t index, void** pin);
+void fs_unmap_page(void* pin);
 
 #endif
@@ -0,0 +1,315 @@
+#include "initramfs.h"
+#include "../memory/heap/kheap.h"
+#include "../string/string.h"
+#include <stddef.h>
+
+struct filesystem* initramfs_init_vfs() {
+    static struct filesystem initramfs_fs = {
+        .name = "initramfs",
+        .flags = FS_FLAG_MEMORY,
+        .resolve = initramfs_resolve,
+        .open = initramfs_open,
+        .read = (FS_READ_FUNCTION)initramfs_read,
+        .seek = (FS_SEEK_FUNCTION)initramfs_seek,
+        .tell = (FS_TELL_FUNCTION)initramfs_tell,
+        .close = (FS_CLOSE_FUNCTION)initramfs_close,
+        .stat = (FS_STAT_FUNCTION)initramfs_stat,
+        .opendir = (FS_OPENDIR_FUNCTION)initramfs_opendir,
+        .readdir = (FS_READDIR_FUNCTION)initramfs_readdir,
+        .closedir = (FS_CLOSEDIR_FUNCTION)initramfs_closedir,
+        .pread = (FS_PREAD_FUNCTION)initramfs_pread,
+        .map_page = (FS_MAP_PAGE_FUNCTION)initramfs_map_page
+    };
+    return &initramfs_fs;
+}
+
+static uint32_t initramfs_hex(const char* str) {
+    uint32_t value = 0;
+    for (int i = 0; i < 8; i++) {
+        char c = str[i];
+        value <<= 4;
+        if (c >= '0' && c <= '9') value |= c - '0';
+        else if (c >= 'A' && c <= 'F') value |= c - 'A' + 10;
+        else if (c >= 'a' && c <= 'f') value |= c - 'a' + 10;
+    }
+    return value;
+}
+
+// Header field n, counting from c_ino
+static uint32_t initramfs_field(const char* header, int n) {
+    return initramfs_hex(header + 6 + n * 8);
+}
+
+// Walk the archive, filling `entries` when it isn't NULL. Returns the number
+// of files and directories, or -1 if the archive is malformed.
+static int initramfs_scan(const char* archive, uint32_t max_size, struct initramfs_entry* entries) {
+    uint32_t offset = 0;
+    int count = 0;
+
+    while (offset + CPIO_HEADER_SIZE <= max_size) {
+        const char* header = archive + offset;
+        if (strncmp(header, CPIO_NEWC_MAGIC, 6) != 0) return -1;
+
+        uint32_t mode = initramfs_field(header, 1);
+        uint32_t filesize = initramfs_field(header, 6);
+        uint32_t namesize = initramfs_field(header, 11);
+
+        uint32_t name_offset = offset + CPIO_HEADER_SIZE;
+        uint32_t data_offset = (name_offset + namesize + 3) & ~3;
+        if (namesize == 0 || data_offset > max_size || filesize > max_size - data_offset) return -1;
+
+        // The name may be padded with extra NULs to page-align the data
+        const char* name = archive + name_offset;
+        uint32_t name_len = 0;
+        while (name_len < namesize && name[name_len]) {
+            name_len++;
+        }
+
+        if (name_len == sizeof(CPIO_TRAILER) - 1 && strncmp(name, CPIO_TRAILER, name_len) == 0) {
+            return count;
+        }
+
+        while (name_len >= 2 && name[0] == '.' && name[1] == '/') {
+            name += 2;
+            name_len -= 2;
+        }
+        while (name_len > 0 && name[0] == '/') {
+            name++;
+            name_len--;
+        }
+
+        uint32_t type = mode & CPIO_MODE_TYPE;
+        bool keep = name_len > 0 && !(name_len == 1 && name[0] == '.') &&
+                    (type == CPIO_MODE_FILE || type == CPIO_MODE_DIRECTORY);
+        if (keep) {
+            if (entries) {
+                entries[count].name = name;
+                entries[count].name_len = name_len;
+                entries[count].data = archive + data_offset;
+                entries[count].size = type == CPIO_MODE_FILE ? filesize : 0;
+                entries[count].directory = type == CPIO_MODE_DIRECTORY;
+            }
+            count++;
+        }
+
+        offset = (data_offset + filesize + 3) & ~3;
+    }
+
+    return -1; // Ran off the end without a trailer
+}
+
+struct disk* initramfs_create(const void* archive, uint32_t max_size) {
+    int count = initramfs_scan(archive, max_size, NULL);
+    if (count < 0) return NULL;
+
+    struct initramfs* initramfs = kmalloc(sizeof(struct initramfs));
+    if (!initramfs) return NULL;
+    memset(initramfs, 0, sizeof(struct initramfs));
+
+    initramfs->archive = archive;
+    initramfs->archive_size = max_size;
+    initramfs->count = count;
+    if (count > 0) {
+        initramfs->entries = kmalloc(count * sizeof(struct initramfs_entry));
+        if (!initramfs->entries) {
+            kfree(initramfs);
+            return NULL;
+        }
+        initramfs_scan(archive, max_size, initramfs->entries);
+    }
+
+    initramfs->disk.type = DISK_TYPE_INITRAMFS;
+    initramfs->disk.sector_size = DISK_SECTOR_SIZE;
+    initramfs->disk.private = initramfs;
+    if (disk_register(&initramfs->disk) < 0) {
+        if (initramfs->entries) kfree(initramfs->entries);
+        kfree(initramfs);
+        return NULL;
+    }
+
+    return &initramfs->disk;
+}
+
+int initramfs_resolve(struct disk* disk) {
+    if (disk->type != DISK_TYPE_INITRAMFS) return -1;
+    disk->fs_private = disk->private;
+    return 0;
+}
+
+// Length of the "a/b/c" prefix `path` names, or -1 if `name` doesn't start
+// with it. Compares in place so lookups never allocate.
+static int initramfs_match_prefix(const char* name, uint32_t name_len, struct path_part* path) {
+    uint32_t matched = 0;
+    for (struct path_part* part = path; part; part = part->next) {
+        uint32_t len = part->len;
+        if (matched > 0) {
+            if (matched >= name_len || name[matched] != '/') return -1;
+            matched++;
+        }
+        if (len > name_len - matched || strncmp(name + matched, part->part, len) != 0) return -1;
+        matched += len;
+    }
+    return matched;
+}
+
+static struct initramfs_entry* initramfs_lookup(struct initramfs* initramfs, struct path_part* path) {
+    for (uint32_t i = 0; i < initramfs->count; i++) {
+        struct initramfs_entry* entry = &initramfs->entries[i];
+        if (initramfs_match_prefix(entry->name, entry->name_len, path) == (int)entry->name_len) {
+            return entry;
+        }
+    }
+    return NULL;
+}
+
+static struct initramfs_file_descriptor* initramfs_new_descriptor(struct initramfs_entry* entry) {
+    struct initramfs_file_descriptor* desc = kmalloc(sizeof(struct initramfs_file_descriptor));
+    if (!desc) return NULL;
+    desc->entry = entry;
+    desc->pos = 0;
+    return desc;
+}
+
+void* initramfs_open(struct disk* disk, struct path_part* path, FILE_MODE mode) {
+    if (mode != FILE_MODE_READ) return NULL; // Read-only
+
+    struct initramfs_entry* entry = initramfs_lookup(disk->fs_private, path);
+    if (!entry || entry->directory) return NULL;
+
+    return initramfs_new_descriptor(entry);
+}
+
+int initramfs_pread(struct disk* disk, void* private, char* out, uint32_t count, uint32_t offset) {
+    struct initramfs_file_descriptor* desc = (struct initramfs_file_descriptor*)private;
+    struct initramfs_entry* entry = desc->entry;
+
+    if (offset >= entry->size) return 0;
+    if (count > entry->size - offset) count = entry->size - offset;
+
+    // Straight out of the archive; there is nothing to cache
+    memcpy(out, entry->data + offset, count);
+    return count;
+}
+
+// mkinitramfs page-aligns file data, so whole pages can be mapped straight
+// out of the archive. The tail page is left to the caller, which zeroes
+// what lies past the end of the file.
+void* initramfs_map_page(struct disk* disk, void* private, uint32_t index) {
+    struct initramfs_file_descriptor* desc = (struct initramfs_file_descriptor*)private;
+    struct initramfs_entry* entry = desc->entry;
+
+    if (((uint32_t)entry->data & 0xFFF) != 0) return NULL;
+    if (index >= entry->size >> 12) return NULL;
+    return (void*)(entry->data + (index << 12));
+}
+
+int initramfs_read(struct disk* disk, void* private, uint32_t size, uint32_t nmemb, char* out) {
+    struct initramfs_file_descriptor* desc = (struct initramfs_file_descriptor*)private;
+    int res = initramfs_pread(disk, desc, out, size * nmemb, desc->pos);
+    if (res < 0) return res;
+
+    desc->pos += res;
+    return res / size;
+}
+
+int initramfs_seek(void* private, int offset, FILE_SEEK_MODE whence) {
+    struct initramfs_file_descriptor* desc = (struct initramfs_file_descriptor*)private;
+    uint32_t new_pos = desc->pos;
+
+    switch (whence) {
+        case FILE_SEEK_SET:
+            new_pos = offset;
+            break;
+        case FILE_SEEK_CUR:
+            new_pos += offset;
+            break;
+        case FILE_SEEK_END:
+            new_pos = desc->entry->size + offset;
+            break;
+    }
+
+    if (new_pos > desc->entry->size) {
+        return -1;
+    }
+
+    desc->pos = new_pos;
+    return 0;
+}
+
+int initramfs_tell(void* private) {
+    struct initramfs_file_descriptor* desc = (struct initramfs_file_descriptor*)private;
+    return desc->pos;
+}
+
+int initramfs_close(void* private) {
+    kfree(private);
+    return 0;
+}
+
+int initramfs_stat(struct disk* disk, void* private, struct file_stat* stat) {
+    struct initramfs_file_descriptor* desc = (struct initramfs_file_descriptor*)private;
+    struct initramfs* initramfs = disk->fs_private;
+
+    stat->filesize = desc->entry->size;
+    stat->ino = desc->entry - initramfs->entries + 1;
+    stat->flags = FILE_STAT_READ_ONLY;
+    if (desc->entry->directory) {
+        stat->flags |= FILE_STAT_DIRECTORY;
+    }
+    return 0;
+}
+
+void* initramfs_opendir(struct disk* disk, struct path_part* path) {
+    struct initramfs_entry* entry = NULL;
+    if (path) {
+        entry = initramfs_lookup(disk->fs_private, path);
+        if (!entry || !entry->directory) return NULL;
+    }
+
+    return initramfs_new_descriptor(entry);
+}
+
+int initramfs_readdir(struct disk* disk, void* private, uint32_t* cursor, struct fs_dirent* entries, uint32_t count) {
+    struct initramfs_file_descriptor* desc = (struct initramfs_file_descriptor*)private;
+    struct initramfs* initramfs = disk->fs_private;
+
+    // Children of the directory are the entries whose names continue its
+    // own with "/<name>" and no further slash. The cursor is an entry index.
+    const char* dir = desc->entry ? desc->entry->name : "";
+    uint32_t dir_len = desc->entry ? desc->entry->name_len : 0;
+
+    uint32_t filled = 0;
+    uint32_t i = *cursor;
+    for (; i < initramfs->count && filled < count; i++) {
+        struct initramfs_entry* entry = &initramfs->entries[i];
+        const char* name = entry->name;
+        uint32_t name_len = entry->name_len;
+
+        if (dir_len > 0) {
+            if (name_len <= dir_len + 1 || strncmp(name, dir, dir_len) != 0 || name[dir_len] != '/') continue;
+            name += dir_len + 1;
+            name_len -= dir_len + 1;
+        }
+
+        uint32_t len = 0;
+        while (len < name_len && name[len] != '/') {
+            len++;
+        }
+        if (len != name_len) continue;
+
+        struct fs_dirent* dirent = &entries[filled++];
+        if (len > FS_DIRENT_NAME_LEN - 1) len = FS_DIRENT_NAME_LEN - 1;
+        memcpy(dirent->name, name, len);
+        dirent->name[len] = 0;
+        dirent->size = entry->size;
+        dirent->flags = FILE_STAT_READ_ONLY | (entry->directory ? FILE_STAT_DIRECTORY : 0);
+        dirent->first_cluster = i + 1;
+    }
+
+    *cursor = i;
+    return filled;
+}
+
+int initramfs_closedir(void* private) {
+    return initramfs_close(private);
+}
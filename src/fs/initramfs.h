@@ -0,0 +1,59 @@
+#ifndef INITRAMFS_H
+#define INITRAMFS_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "file.h"
+#include "../drivers/disk.h"
+
+// Where the boot loader leaves the archive; must match INITRAMFS_OFFSET
+// and INITRAMFS_SECTORS in src/boot/boot.asm
+#define INITRAMFS_ADDRESS 0x48000
+#define INITRAMFS_MAX_SIZE (256 * 512)
+
+#define CPIO_NEWC_MAGIC "070701"
+#define CPIO_HEADER_SIZE 110
+#define CPIO_TRAILER "TRAILER!!!"
+#define CPIO_MODE_TYPE 0170000
+#define CPIO_MODE_DIRECTORY 0040000
+#define CPIO_MODE_FILE 0100000
+
+struct initramfs_entry {
+    // Both point into the archive; names have no leading "./"
+    const char* name;
+    uint32_t name_len;
+    const char* data;
+    uint32_t size;
+    bool directory;
+};
+
+struct initramfs {
+    struct disk disk;
+    const char* archive;
+    uint32_t archive_size;
+    struct initramfs_entry* entries;
+    uint32_t count;
+};
+
+struct initramfs_file_descriptor {
+    struct initramfs_entry* entry; // NULL for the root directory
+    uint32_t pos;
+};
+
+struct filesystem* initramfs_init_vfs();
+struct disk* initramfs_create(const void* archive, uint32_t max_size);
+
+int initramfs_resolve(struct disk* disk);
+void* initramfs_open(struct disk* disk, struct path_part* path, FILE_MODE mode);
+int initramfs_read(struct disk* disk, void* private, uint32_t size, uint32_t nmemb, char* out);
+void* initramfs_map_page(struct disk* disk, void* private, uint32_t index);
+int initramfs_pread(struct disk* disk, void* private, char* out, uint32_t count, uint32_t offset);
+int initramfs_seek(void* private, int offset, FILE_SEEK_MODE whence);
+int initramfs_tell(void* private);
+int initramfs_close(void* private);
+int initramfs_stat(struct disk* disk, void* private, struct file_stat* stat);
+void* initramfs_opendir(struct disk* disk, struct path_part* path);
+int initramfs_readdir(struct disk* disk, void* private, uint32_t* cursor, struct fs_dirent* entries, uint32_t count);
+int initramfs_closedir(void* private);
+
+#endif
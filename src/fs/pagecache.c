@@ -0,0 +1,713 @@
+#include "pagecache.h"
+#include "file.h"
+#include "../memory/heap/kheap.h"
+#include "../string/string.h"
+#include "../drivers/clocksource.h"
+#include "../drivers/timer.h"
+#include "../task/task.h"
+#include "../task/wait.h"
+#include "../task/lock.h"
+#include "../cpu/cpu.h"
+#include <stddef.h>
+
+static struct pagecache_file files[PAGECACHE_FILES];
+static struct pagecache_page pages[PAGECACHE_PAGES];
+static struct pagecache_page* buckets[PAGECACHE_BUCKETS];
+
+// Most recently used at the head, eviction from the tail
+static struct pagecache_page* lru_head = NULL;
+static struct pagecache_page* lru_tail = NULL;
+
+// Guards everything here. Readers come in without fs_lock and let this go
+// while the disk fills their pages; anything that writes, truncates or
+// flushes also holds fs_lock, so only one of those runs at a time.
+static struct mutex pagecache_mutex;
+
+// Tasks waiting for a page another task is reading in
+static struct wait_queue pagecache_io;
+
+// Staging buffer for write-back, used under fs_lock
+static char* batch_buffer = NULL;
+
+// Staging buffer for batched reads. A miss that finds it taken reads
+// just the one page, straight into the page.
+static char* read_buffer = NULL;
+static bool read_busy = false;
+
+static uint32_t dirty_total = 0;
+static struct pagecache_stats stats;
+
+static uint32_t pagecache_hash(struct pagecache_file* file, uint32_t index) {
+    return ((uint32_t)(file - files) * 31 + index) % PAGECACHE_BUCKETS;
+}
+
+static void pagecache_lru_unlink(struct pagecache_page* page) {
+    if (page->lru_prev) page->lru_prev->lru_next = page->lru_next;
+    if (page->lru_next) page->lru_next->lru_prev = page->lru_prev;
+    if (page == lru_head) lru_head = page->lru_next;
+    if (page == lru_tail) lru_tail = page->lru_prev;
+    page->lru_prev = NULL;
+    page->lru_next = NULL;
+}
+
+static void pagecache_lru_push_front(struct pagecache_page* page) {
+    page->lru_prev = NULL;
+    page->lru_next = lru_head;
+    if (lru_head) lru_head->lru_prev = page;
+    lru_head = page;
+    if (!lru_tail) lru_tail = page;
+}
+
+static void pagecache_lru_push_back(struct pagecache_page* page) {
+    page->lru_next = NULL;
+    page->lru_prev = lru_tail;
+    if (lru_tail) lru_tail->lru_next = page;
+    lru_tail = page;
+    if (!lru_head) lru_head = page;
+}
+
+static struct pagecache_page* pagecache_find(struct pagecache_file* file, uint32_t index) {
+    struct pagecache_page* page = buckets[pagecache_hash(file, index)];
+    while (page) {
+        if (page->file == file && page->index == index) {
+            return page;
+        }
+        page = page->hash_next;
+    }
+    return NULL;
+}
+
+// Free a file slot once nothing refers to it any more
+static void pagecache_put_file(struct pagecache_file* file) {
+    if (file->refcount == 0 && file->pages == 0 && !file->writer) {
+        file->disk = NULL;
+    }
+}
+
+// Close the handle the cache kept for write-back once the file is clean
+static void pagecache_release_writer(struct pagecache_file* file) {
+    if (file->dirty_pages > 0 || !file->writer_owned) return;
+
+    FS_CLOSE_FUNCTION close = file->fs->close;
+    void* writer = file->writer;
+    file->writer = NULL;
+    file->writer_owned = false;
+    if (close) close(writer);
+    pagecache_put_file(file);
+}
+
+// Drop a page from its file, discarding its contents even if dirty
+static void pagecache_drop_page(struct pagecache_page* page) {
+    struct pagecache_file* file = page->file;
+
+    struct pagecache_page** link = &buckets[pagecache_hash(file, page->index)];
+    while (*link) {
+        if (*link == page) {
+            *link = page->hash_next;
+            break;
+        }
+        link = &(*link)->hash_next;
+    }
+    page->hash_next = NULL;
+
+    if (page->dirty) {
+        page->dirty = false;
+        file->dirty_pages--;
+        dirty_total--;
+    }
+    page->file = NULL;
+    page->uptodate = false;
+    file->pages--;
+
+    // Unused pages are reused first
+    pagecache_lru_unlink(page);
+    pagecache_lru_push_back(page);
+}
+
+static int pagecache_flush(struct pagecache_file* file);
+
+static bool pagecache_busy(struct pagecache_page* page) {
+    return page->mapcount > 0 || page->locked;
+}
+
+// Take the least recently used clean page. Only if every page is dirty does
+// allocation have to wait for a write-back, which only callers holding
+// fs_lock may start (`may_flush`). Mapped pages and pages being read in
+// stay put.
+static struct pagecache_page* pagecache_alloc_page(bool may_flush) {
+    struct pagecache_page* page;
+    while (1) {
+        page = lru_tail;
+        while (page && (page->dirty || pagecache_busy(page))) {
+            page = page->lru_prev;
+        }
+        if (page) break;
+        if (!may_flush) return NULL;
+
+        page = lru_tail;
+        while (page && pagecache_busy(page)) {
+            page = page->lru_prev;
+        }
+        // The flush lets the cache go, so look again once it is done
+        if (!page || pagecache_flush(page->file) != 0) return NULL;
+    }
+
+    if (!page->data) {
+        page->data = kmalloc_a(PAGECACHE_PAGE_SIZE);
+        if (!page->data) return NULL;
+    }
+
+    if (page->file) {
+        struct pagecache_file* file = page->file;
+        pagecache_drop_page(page);
+        pagecache_put_file(file);
+    }
+    return page;
+}
+
+static void pagecache_insert_page(struct pagecache_file* file, struct pagecache_page* page, uint32_t index) {
+    uint32_t hash = pagecache_hash(file, index);
+    page->file = file;
+    page->index = index;
+    page->dirty = false;
+    page->uptodate = false;
+    page->locked = false;
+    page->hash_next = buckets[hash];
+    buckets[hash] = page;
+    file->pages++;
+
+    pagecache_lru_unlink(page);
+    pagecache_lru_push_front(page);
+}
+
+// Sleep until `page` has been read in. Interrupts go off before the cache
+// is let go, so the reader can't finish and wake us in between.
+static void pagecache_wait_page(struct pagecache_page* page) {
+    uint32_t flags = interrupts_save();
+    mutex_unlock(&pagecache_mutex);
+    while (page->locked) {
+        wait_sleep(&pagecache_io);
+    }
+    interrupts_restore(flags);
+    mutex_lock(&pagecache_mutex);
+}
+
+// The cached page holding `index`, waiting out a read already under way for
+// it. NULL if it isn't cached, including when that read failed.
+static struct pagecache_page* pagecache_lookup(struct pagecache_file* file, uint32_t index) {
+    struct pagecache_page* page;
+    while ((page = pagecache_find(file, index)) && !page->uptodate) {
+        pagecache_wait_page(page);
+    }
+    return page;
+}
+
+// Bring `index` into the cache, reading ahead over the following pages
+// that are missing so a sequential reader costs one transfer per batch.
+// The pages are inserted locked and read with the cache let go, so other
+// misses on them wait for this read instead of starting their own.
+// Returns the number of pages read in, 0 if another task got to `index`
+// first, or -1.
+static int pagecache_fill(struct pagecache_file* file, void* handle, uint32_t index, bool may_flush) {
+    uint32_t file_pages = (file->size + PAGECACHE_PAGE_SIZE - 1) >> PAGECACHE_PAGE_SHIFT;
+    struct pagecache_page* batch[PAGECACHE_BATCH_PAGES];
+    uint32_t count = 0;
+
+    char* buffer = NULL;
+    uint32_t max = 1;
+    if (!read_busy) {
+        read_busy = true;
+        buffer = read_buffer;
+        max = PAGECACHE_BATCH_PAGES;
+    }
+
+    while (count < max) {
+        if (count > 0 && index + count >= file_pages) break;
+
+        struct pagecache_page* page = pagecache_alloc_page(may_flush);
+        if (!page) break;
+        // Allocating may have flushed, and let another task in meanwhile
+        if (pagecache_find(file, index + count)) break;
+
+        pagecache_insert_page(file, page, index + count);
+        page->locked = true;
+        batch[count++] = page;
+    }
+
+    int res = 0;
+    if (count > 0) {
+        if (!buffer) buffer = batch[0]->data;
+
+        uint32_t offset = index << PAGECACHE_PAGE_SHIFT;
+        uint32_t bytes = count << PAGECACHE_PAGE_SHIFT;
+        if (offset < file->size) {
+            if (bytes > file->size - offset) bytes = file->size - offset;
+            mutex_unlock(&pagecache_mutex);
+            res = file->fs->pread(file->disk, handle, buffer, bytes, offset);
+            mutex_lock(&pagecache_mutex);
+        }
+
+        // Anything the filesystem didn't return lies past its end of file
+        if (res >= 0) memset(buffer + res, 0, (count << PAGECACHE_PAGE_SHIFT) - res);
+    }
+
+    for (uint32_t i = 0; i < count; i++) {
+        struct pagecache_page* page = batch[i];
+        page->locked = false;
+
+        // Truncate or invalidate may have dropped the page while it was read
+        if (page->file != file || page->index != index + i) continue;
+
+        if (res < 0) {
+            pagecache_drop_page(page);
+            continue;
+        }
+
+        if (buffer != page->data) {
+            memcpy(page->data, buffer + (i << PAGECACHE_PAGE_SHIFT), PAGECACHE_PAGE_SIZE);
+        }
+        // A truncate that raced the read left its zeros where the disk's
+        // older contents have just landed
+        uint32_t start = page->index << PAGECACHE_PAGE_SHIFT;
+        if (file->size < start + PAGECACHE_PAGE_SIZE) {
+            uint32_t valid = file->size > start ? file->size - start : 0;
+            memset(page->data + valid, 0, PAGECACHE_PAGE_SIZE - valid);
+        }
+        page->uptodate = true;
+    }
+
+    if (buffer == read_buffer) read_busy = false;
+    if (count > 0) wait_wake_all(&pagecache_io);
+    if (res < 0) {
+        pagecache_put_file(file);
+        return -1;
+    }
+    if (count == 0) return pagecache_find(file, index) ? 0 : -1;
+    return count;
+}
+
+// The page holding `index`, read in if it isn't cached
+static struct pagecache_page* pagecache_get(struct pagecache_file* file, void* handle, uint32_t index, bool may_flush) {
+    struct pagecache_page* page;
+    while (!(page = pagecache_lookup(file, index))) {
+        if (pagecache_fill(file, handle, index, may_flush) < 0) return NULL;
+    }
+    return page;
+}
+
+static void pagecache_mark_dirty(struct pagecache_page* page) {
+    if (page->dirty) return;
+
+    struct pagecache_file* file = page->file;
+    page->dirty = true;
+    if (file->dirty_pages++ == 0) {
+        file->dirtied_at = ktime_get_ns();
+    }
+    dirty_total++;
+}
+
+// Write back one file's dirty pages. Call with fs_lock held; the cache is
+// let go during each write so readers aren't held up behind the disk.
+static int pagecache_flush(struct pagecache_file* file) {
+    uint32_t file_pages = (file->size + PAGECACHE_PAGE_SIZE - 1) >> PAGECACHE_PAGE_SHIFT;
+    uint32_t index = 0;
+
+    if (file->dirty_pages > 0 && !file->writer) return -1;
+
+    // Write back in file order, gathering consecutive dirty pages so the
+    // filesystem sees (and can allocate for) one larger write
+    while (file->dirty_pages > 0 && index < file_pages) {
+        struct pagecache_page* batch[PAGECACHE_BATCH_PAGES];
+        uint32_t count = 0;
+
+        while (count < PAGECACHE_BATCH_PAGES && index + count < file_pages) {
+            struct pagecache_page* page = pagecache_find(file, index + count);
+            if (!page || !page->dirty) break;
+            batch[count++] = page;
+        }
+        if (count == 0) {
+            index++;
+            continue;
+        }
+
+        uint32_t offset = index << PAGECACHE_PAGE_SHIFT;
+        uint32_t bytes = count << PAGECACHE_PAGE_SHIFT;
+        if (bytes > file->size - offset) bytes = file->size - offset;
+
+        for (uint32_t i = 0; i < count; i++) {
+            memcpy(batch_buffer + (i << PAGECACHE_PAGE_SHIFT), batch[i]->data, PAGECACHE_PAGE_SIZE);
+        }
+
+        // Dirty pages can't be evicted, and only fs_lock holders write
+        // or drop them, so the batch is still ours afterwards
+        mutex_unlock(&pagecache_mutex);
+        int res = file->fs->pwrite(file->disk, file->writer, batch_buffer, bytes, offset);
+        mutex_lock(&pagecache_mutex);
+        if (res != (int)bytes) return -1;
+
+        for (uint32_t i = 0; i < count; i++) {
+            batch[i]->dirty = false;
+        }
+        file->dirty_pages -= count;
+        dirty_total -= count;
+        stats.writebacks += count;
+        index += count;
+    }
+
+    pagecache_release_writer(file);
+    return 0;
+}
+
+// Flush the files that have been dirty longest until the cache is back
+// under the background ratio
+static int pagecache_balance() {
+    while (dirty_total * 100 > PAGECACHE_DIRTY_BACKGROUND_RATIO * PAGECACHE_PAGES) {
+        struct pagecache_file* oldest = NULL;
+        for (int i = 0; i < PAGECACHE_FILES; i++) {
+            if (files[i].disk && files[i].dirty_pages > 0 &&
+                (!oldest || files[i].dirtied_at < oldest->dirtied_at)) {
+                oldest = &files[i];
+            }
+        }
+        if (!oldest || pagecache_flush(oldest) != 0) return -1;
+    }
+    return 0;
+}
+
+// Forget every page of `file`. Pages still being read in are dropped too;
+// their reader sees that and leaves them be.
+static void pagecache_drop_file(struct pagecache_file* file) {
+    for (int j = 0; j < PAGECACHE_PAGES && file->pages > 0; j++) {
+        if (pages[j].file == file) pagecache_drop_page(&pages[j]);
+    }
+    pagecache_release_writer(file);
+    pagecache_put_file(file);
+}
+
+void pagecache_init() {
+    memset(files, 0, sizeof(files));
+    memset(pages, 0, sizeof(pages));
+    memset(buckets, 0, sizeof(buckets));
+    memset(&stats, 0, sizeof(stats));
+    lru_head = NULL;
+    lru_tail = NULL;
+    dirty_total = 0;
+    read_busy = false;
+    mutex_init(&pagecache_mutex);
+    wait_queue_init(&pagecache_io);
+
+    batch_buffer = kmalloc(PAGECACHE_BATCH_PAGES * PAGECACHE_PAGE_SIZE);
+    read_buffer = kmalloc(PAGECACHE_BATCH_PAGES * PAGECACHE_PAGE_SIZE);
+
+    // Page data is allocated on first use
+    for (int i = 0; i < PAGECACHE_PAGES; i++) {
+        pagecache_lru_push_back(&pages[i]);
+    }
+}
+
+struct pagecache_file* pagecache_open(struct disk* disk, struct filesystem* fs, uint32_t ino, uint32_t size) {
+    struct pagecache_file* free_slot = NULL;
+    struct pagecache_file* idle = NULL;
+    struct pagecache_file* res = NULL;
+
+    mutex_lock(&pagecache_mutex);
+    for (int i = 0; i < PAGECACHE_FILES; i++) {
+        struct pagecache_file* file = &files[i];
+        if (!file->disk) {
+            if (!free_slot) free_slot = file;
+            continue;
+        }
+
+        if (file->disk == disk && file->fs == fs && file->ino == ino) {
+            // Without dirty pages the filesystem's size is the current one
+            if (file->dirty_pages == 0) file->size = size;
+            file->refcount++;
+            res = file;
+            goto out;
+        }
+
+        if (file->refcount == 0 && file->dirty_pages == 0 && !file->writer && !idle) {
+            idle = file;
+        }
+    }
+
+    // Out of slots: forget a closed file's clean pages to make room
+    if (!free_slot && idle) {
+        pagecache_drop_file(idle);
+        free_slot = idle;
+    }
+    if (!free_slot || !batch_buffer || !read_buffer) goto out;
+
+    memset(free_slot, 0, sizeof(struct pagecache_file));
+    free_slot->disk = disk;
+    free_slot->fs = fs;
+    free_slot->ino = ino;
+    free_slot->size = size;
+    free_slot->refcount = 1;
+    res = free_slot;
+
+out:
+    mutex_unlock(&pagecache_mutex);
+    return res;
+}
+
+// Called as a descriptor closes. Returns 1 if the cache took over the
+// handle to write dirty pages back later, 0 if the caller should close it.
+int pagecache_release(struct pagecache_file* file, void* handle) {
+    int res = 0;
+    mutex_lock(&pagecache_mutex);
+    file->refcount--;
+
+    if (file->writer == handle) {
+        if (file->dirty_pages > 0) {
+            file->writer_owned = true;
+            res = 1;
+            goto out;
+        }
+        file->writer = NULL;
+    }
+
+    pagecache_put_file(file);
+
+out:
+    mutex_unlock(&pagecache_mutex);
+    return res;
+}
+
+// Needs no fs_lock. A page that can't be had without a write-back, which
+// is left to writers, is read past the cache.
+int pagecache_read(struct pagecache_file* file, void* handle, char* out, uint32_t count, uint32_t offset) {
+    mutex_lock(&pagecache_mutex);
+    if (offset >= file->size) count = 0;
+    else if (count > file->size - offset) count = file->size - offset;
+
+    uint32_t done = 0;
+    while (done < count) {
+        uint32_t pos = offset + done;
+        uint32_t index = pos >> PAGECACHE_PAGE_SHIFT;
+        uint32_t in_page = pos & (PAGECACHE_PAGE_SIZE - 1);
+        uint32_t chunk = PAGECACHE_PAGE_SIZE - in_page;
+        if (chunk > count - done) chunk = count - done;
+
+        struct pagecache_page* page = pagecache_lookup(file, index);
+        if (page) {
+            stats.hits++;
+            pagecache_lru_unlink(page);
+            pagecache_lru_push_front(page);
+        } else {
+            stats.misses++;
+            page = pagecache_get(file, handle, index, false);
+        }
+
+        if (page) {
+            memcpy(out + done, page->data + in_page, chunk);
+        } else {
+            mutex_unlock(&pagecache_mutex);
+            int res = file->fs->pread(file->disk, handle, out + done, chunk, pos);
+            mutex_lock(&pagecache_mutex);
+            if (res < 0) break;
+            // Short of the cached size: the rest hasn't reached the disk
+            memset(out + done + res, 0, chunk - res);
+        }
+        done += chunk;
+    }
+    mutex_unlock(&pagecache_mutex);
+
+    if (done == 0 && count > 0) return -1;
+    return done;
+}
+
+int pagecache_write(struct pagecache_file* file, void* handle, const char* in, uint32_t count, uint32_t offset) {
+    if (!file->fs->pwrite) return -1;
+
+    int res = -2;
+    mutex_lock(&pagecache_mutex);
+    if (offset > file->size) goto out;
+    if (!file->writer) file->writer = handle;
+
+    uint32_t done = 0;
+    while (done < count) {
+        uint32_t pos = offset + done;
+        uint32_t index = pos >> PAGECACHE_PAGE_SHIFT;
+        uint32_t in_page = pos & (PAGECACHE_PAGE_SIZE - 1);
+        uint32_t chunk = PAGECACHE_PAGE_SIZE - in_page;
+        if (chunk > count - done) chunk = count - done;
+
+        struct pagecache_page* page = pagecache_lookup(file, index);
+        if (page) {
+            pagecache_lru_unlink(page);
+            pagecache_lru_push_front(page);
+        } else if (in_page == 0 && (chunk == PAGECACHE_PAGE_SIZE || pos + chunk >= file->size)) {
+            // Everything the write leaves untouched is past the end of file
+            page = pagecache_alloc_page(true);
+            if (!page) break;
+            if (pagecache_find(file, index)) continue;
+            pagecache_insert_page(file, page, index);
+            memset(page->data, 0, PAGECACHE_PAGE_SIZE);
+            page->uptodate = true;
+        } else {
+            page = pagecache_get(file, handle, index, true);
+            if (!page) break;
+        }
+
+        memcpy(page->data + in_page, in + done, chunk);
+        pagecache_mark_dirty(page);
+        done += chunk;
+        if (pos + chunk > file->size) {
+            file->size = pos + chunk;
+        }
+    }
+    res = done;
+
+    // Writers that push the cache past the dirty ratio pay for the flush
+    if (dirty_total * 100 > PAGECACHE_DIRTY_RATIO * PAGECACHE_PAGES) {
+        stats.throttled++;
+        if (pagecache_balance() != 0 && done == 0) res = -3;
+    }
+
+    if (done == 0 && count > 0) res = -3;
+
+out:
+    mutex_unlock(&pagecache_mutex);
+    return res;
+}
+
+void pagecache_truncate(struct pagecache_file* file, uint32_t size) {
+    uint32_t keep = (size + PAGECACHE_PAGE_SIZE - 1) >> PAGECACHE_PAGE_SHIFT;
+
+    mutex_lock(&pagecache_mutex);
+    for (int i = 0; i < PAGECACHE_PAGES; i++) {
+        struct pagecache_page* page = &pages[i];
+        if (page->file != file) continue;
+
+        if (page->index >= keep) {
+            pagecache_drop_page(page);
+        } else if (page->index == keep - 1 && (size & (PAGECACHE_PAGE_SIZE - 1))) {
+            // The new last page must read as zeros past the end of file
+            uint32_t tail = size & (PAGECACHE_PAGE_SIZE - 1);
+            memset(page->data + tail, 0, PAGECACHE_PAGE_SIZE - tail);
+        }
+    }
+
+    file->size = size;
+    pagecache_release_writer(file);
+    mutex_unlock(&pagecache_mutex);
+}
+
+// Hand out the page holding `index` for a memory mapping. It stays resident
+// until unpinned; writes through the cache show up in it directly. Needs
+// no fs_lock.
+struct pagecache_page* pagecache_pin(struct pagecache_file* file, void* handle, uint32_t index) {
+    struct pagecache_page* page = NULL;
+    mutex_lock(&pagecache_mutex);
+
+    uint32_t file_pages = (file->size + PAGECACHE_PAGE_SIZE - 1) >> PAGECACHE_PAGE_SHIFT;
+    if (index >= file_pages) goto out;
+
+    page = pagecache_lookup(file, index);
+    if (page) {
+        stats.hits++;
+        pagecache_lru_unlink(page);
+        pagecache_lru_push_front(page);
+    } else {
+        stats.misses++;
+        page = pagecache_get(file, handle, index, false);
+        if (!page) goto out;
+    }
+
+    page->mapcount++;
+
+out:
+    mutex_unlock(&pagecache_mutex);
+    return page;
+}
+
+// A page dropped while mapped (truncate, unlink) is only reused once the
+// last mapping lets go of it
+void pagecache_unpin(struct pagecache_page* page) {
+    mutex_lock(&pagecache_mutex);
+    page->mapcount--;
+    mutex_unlock(&pagecache_mutex);
+}
+
+int pagecache_flush_file(struct pagecache_file* file) {
+    mutex_lock(&pagecache_mutex);
+    int res = pagecache_flush(file);
+    mutex_unlock(&pagecache_mutex);
+    return res;
+}
+
+int pagecache_flush_disk(struct disk* disk) {
+    int res = 0;
+    mutex_lock(&pagecache_mutex);
+    for (int i = 0; i < PAGECACHE_FILES; i++) {
+        if (files[i].disk && (!disk || files[i].disk == disk) && files[i].dirty_pages > 0) {
+            if (pagecache_flush(&files[i]) != 0) res = -1;
+        }
+    }
+    mutex_unlock(&pagecache_mutex);
+    return res;
+}
+
+int pagecache_sync() {
+    return pagecache_flush_disk(NULL);
+}
+
+// Periodic flusher: write back files whose dirty data has aged out, or
+// everything dirty once the cache is over the background ratio
+void pagecache_writeback() {
+    mutex_lock(&pagecache_mutex);
+    if (dirty_total == 0) goto out;
+
+    uint64_t now = ktime_get_ns();
+    bool background = dirty_total * 100 > PAGECACHE_DIRTY_BACKGROUND_RATIO * PAGECACHE_PAGES;
+
+    for (int i = 0; i < PAGECACHE_FILES; i++) {
+        struct pagecache_file* file = &files[i];
+        if (!file->disk || file->dirty_pages == 0) continue;
+        if (background || now - file->dirtied_at >= (uint64_t)PAGECACHE_WRITEBACK_MS * NSEC_PER_MSEC) {
+            pagecache_flush(file);
+        }
+    }
+
+out:
+    mutex_unlock(&pagecache_mutex);
+}
+
+static void pagecache_writeback_thread() {
+    while (1) {
+        sleep_ticks(timer_ms_to_ticks(PAGECACHE_WRITEBACK_INTERVAL_MS));
+        fs_lock();
+        pagecache_writeback();
+        fs_unlock();
+    }
+}
+
+// Needs the scheduler and timer running, so comes later than pagecache_init
+int pagecache_start_writeback() {
+    return task_new_thread(pagecache_writeback_thread) ? 0 : -1;
+}
+
+void pagecache_invalidate(struct disk* disk, uint32_t ino) {
+    mutex_lock(&pagecache_mutex);
+    for (int i = 0; i < PAGECACHE_FILES; i++) {
+        struct pagecache_file* file = &files[i];
+        if (file->disk == disk && file->ino == ino) pagecache_drop_file(file);
+    }
+    mutex_unlock(&pagecache_mutex);
+}
+
+void pagecache_invalidate_disk(struct disk* disk) {
+    mutex_lock(&pagecache_mutex);
+    for (int i = 0; i < PAGECACHE_FILES; i++) {
+        if (files[i].disk == disk) pagecache_drop_file(&files[i]);
+    }
+    mutex_unlock(&pagecache_mutex);
+}
+
+void pagecache_get_stats(struct pagecache_stats* out) {
+    mutex_lock(&pagecache_mutex);
+    *out = stats;
+    out->dirty = dirty_total;
+    mutex_unlock(&pagecache_mutex);
+}
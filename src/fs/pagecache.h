@@ -0,0 +1,89 @@
+#ifndef PAGECACHE_H
+#define PAGECACHE_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "../drivers/disk.h"
+
+#define PAGECACHE_PAGE_SIZE 4096
+#define PAGECACHE_PAGE_SHIFT 12
+#define PAGECACHE_PAGES 256 // 1MB of file data
+#define PAGECACHE_BUCKETS 128
+#define PAGECACHE_FILES 32
+
+// Misses read up to this many pages in one transfer, and write-back
+// gathers up to this many consecutive dirty pages into one write
+#define PAGECACHE_BATCH_PAGES 16
+
+// Writers flush synchronously once this percentage of the cache is dirty.
+// Above the background ratio the flusher writes back without waiting for
+// dirty data to expire.
+#define PAGECACHE_DIRTY_RATIO 40
+#define PAGECACHE_DIRTY_BACKGROUND_RATIO 10
+
+// Age at which dirty data is written back, and how often the flusher
+// task looks for it; nothing stays dirty much longer than their sum
+#define PAGECACHE_WRITEBACK_MS 2000
+#define PAGECACHE_WRITEBACK_INTERVAL_MS 500
+
+struct filesystem;
+
+// Cached state of one file, shared by every descriptor open on it
+struct pagecache_file {
+    struct disk* disk;
+    struct filesystem* fs;
+    uint32_t ino;
+    uint32_t size; // Includes writes not yet on disk
+    int refcount;  // Open descriptors
+
+    // Handle dirty pages are written back through. If its descriptor is
+    // closed while pages are still dirty the cache keeps the handle open
+    // until the file is clean.
+    void* writer;
+    bool writer_owned;
+
+    uint32_t pages;
+    uint32_t dirty_pages;
+    uint64_t dirtied_at; // ktime_get_ns when the file went from clean to dirty
+};
+
+struct pagecache_page {
+    struct pagecache_file* file;
+    uint32_t index;
+    char* data;
+    bool dirty;
+    bool uptodate; // data holds the file's contents
+    bool locked;   // Being read in with the cache unlocked; never evicted
+    int mapcount;  // Memory mappings using data in place; never evicted
+
+    struct pagecache_page* hash_next;
+    struct pagecache_page* lru_prev;
+    struct pagecache_page* lru_next;
+};
+
+struct pagecache_stats {
+    uint32_t hits;
+    uint32_t misses;
+    uint32_t writebacks; // Pages written back
+    uint32_t throttled;  // Writes that had to flush synchronously
+    uint32_t dirty;
+};
+
+void pagecache_init();
+struct pagecache_file* pagecache_open(struct disk* disk, struct filesystem* fs, uint32_t ino, uint32_t size);
+int pagecache_release(struct pagecache_file* file, void* handle);
+int pagecache_read(struct pagecache_file* file, void* handle, char* out, uint32_t count, uint32_t offset);
+int pagecache_write(struct pagecache_file* file, void* handle, const char* in, uint32_t count, uint32_t offset);
+void pagecache_truncate(struct pagecache_file* file, uint32_t size);
+struct pagecache_page* pagecache_pin(struct pagecache_file* file, void* handle, uint32_t index);
+void pagecache_unpin(struct pagecache_page* page);
+int pagecache_flush_file(struct pagecache_file* file);
+int pagecache_flush_disk(struct disk* disk);
+int pagecache_sync();
+void pagecache_writeback();
+int pagecache_start_writeback();
+void pagecache_invalidate(struct disk* disk, uint32_t ino);
+void pagecache_invalidate_disk(struct disk* disk);
+void pagecache_get_stats(struct pagecache_stats* stats);
+
+#endif
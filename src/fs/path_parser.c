@@ -1,8 +1,6 @@
 #include "path_parser.h"
 #include "../string/string.h"
-#include "../memory/heap/kheap.h"
-#include "../memory/paging/paging.h" // For any alignment/paging needs if any, though kheap is enough
-#include "../drivers/serial.h"
+#include <stddef.h>
 
 static int path_parser_get_drive_no(const char** path) {
     if (!isdigit((*path)[0]) || (*path)[1] != ':' || (*path)[2] != '/') {
@@ -14,53 +12,34 @@ static int path_parser_get_drive_no(const char** path) {
     return drive_no;
 }
 
-static struct path_root* path_parser_create_root(int drive_no) {
-    struct path_root* root = kmalloc(sizeof(struct path_root));
+int path_parser_parse(struct path_root* root, const char* path) {
+    int drive_no = path_parser_get_drive_no(&path);
+    if (drive_no < 0) return -1;
+
     root->drive_no = drive_no;
     root->first = NULL;
-    return root;
-}
-
-static const char* path_parser_get_next_part(const char** path) {
-    char* result = kmalloc(256); // Max path part length
-    int i = 0;
-    while (**path && **path != '/') {
-        result[i++] = **path;
-        (*path)++;
-    }
-
-    if (**path == '/') {
-        (*path)++; // Skip '/'
-    }
-
-    if (i == 0) {
-        kfree(result);
-        return NULL;
-    }
-
-    result[i] = '\0';
-    return result;
-}
-
-struct path_root* path_parser_parse(const char* path, const char* current_directory_path) {
-    const char* tmp_path = path;
-    int drive_no = path_parser_get_drive_no(&tmp_path);
-    if (drive_no < 0) return NULL;
 
-    struct path_root* root = path_parser_create_root(drive_no);
-    struct path_part* first_part = NULL;
     struct path_part* last_part = NULL;
+    int count = 0;
+    while (*path) {
+        const char* start = path;
+        while (*path && *path != '/') {
+            path++;
+        }
 
-    while (1) {
-        const char* part_str = path_parser_get_next_part(&tmp_path);
-        if (!part_str) break;
+        uint32_t len = path - start;
+        if (*path == '/') {
+            path++; // Skip '/'
+        }
+        if (len == 0) continue; // Repeated or trailing '/'
 
-        struct path_part* part = kmalloc(sizeof(struct path_part));
-        part->part = part_str;
+        if (count == PATH_MAX_PARTS) return -2;
+        struct path_part* part = &root->parts[count++];
+        part->part = start;
+        part->len = len;
         part->next = NULL;
 
-        if (!first_part) {
-            first_part = part;
+        if (!last_part) {
             root->first = part;
         } else {
             last_part->next = part;
@@ -68,16 +47,9 @@ struct path_root* path_parser_parse(const char* path, const char* current_direct
         last_part = part;
     }
 
-    return root;
+    return 0;
 }
 
-void path_parser_free(struct path_root* root) {
-    struct path_part* part = root->first;
-    while (part) {
-        struct path_part* next = part->next;
-        kfree((void*)part->part);
-        kfree(part);
-        part = next;
-    }
-    kfree(root);
+bool path_part_is(const struct path_part* part, const char* name) {
+    return strncmp(part->part, name, part->len) == 0 && name[part->len] == '\0';
 }
@@ -1,19 +1,30 @@
 #ifndef PATHPARSER_H
 #define PATHPARSER_H
 
-struct path_root
-{
-    int drive_no;
-    struct path_part* first;
-};
+#include <stdint.h>
+#include <stdbool.h>
+
+// Deepest path the parser accepts, counting the file name
+#define PATH_MAX_PARTS 16
 
 struct path_part
 {
+    // Slice of the caller's path string; not NUL terminated
     const char* part;
+    uint32_t len;
     struct path_part* next;
 };
 
-struct path_root* path_parser_parse(const char* path, const char* current_directory_path);
-void path_parser_free(struct path_root* root);
+// Lives on the caller's stack and borrows the path string, so parsing and
+// lookup never touch the heap
+struct path_root
+{
+    int drive_no;
+    struct path_part* first;
+    struct path_part parts[PATH_MAX_PARTS];
+};
+
+int path_parser_parse(struct path_root* root, const char* path);
+bool path_part_is(const struct path_part* part, const char* name);
 
 #endif
@@ -0,0 +1,350 @@
+#include "procfs.h"
+#include "pagecache.h"
+#include "dcache.h"
+#include "../cpu/isr.h"
+#include "../memory/heap/kheap.h"
+#include "../memory/mmap/mmap.h"
+#include "../task/process.h"
+#include "../string/string.h"
+#include <stddef.h>
+
+struct filesystem* procfs_init_vfs() {
+    static struct filesystem procfs_fs = {
+        .name = "procfs",
+        .flags = FS_FLAG_MEMORY,
+        .resolve = procfs_resolve,
+        .open = procfs_open,
+        .read = (FS_READ_FUNCTION)procfs_read,
+        .seek = (FS_SEEK_FUNCTION)procfs_seek,
+        .tell = (FS_TELL_FUNCTION)procfs_tell,
+        .close = (FS_CLOSE_FUNCTION)procfs_close,
+        .stat = (FS_STAT_FUNCTION)procfs_stat,
+        .opendir = (FS_OPENDIR_FUNCTION)procfs_opendir,
+        .readdir = (FS_READDIR_FUNCTION)procfs_readdir,
+        .closedir = (FS_CLOSEDIR_FUNCTION)procfs_closedir,
+        .pread = (FS_PREAD_FUNCTION)procfs_pread
+    };
+    return &procfs_fs;
+}
+
+static void procfs_put(struct procfs_buffer* out, const char* str, uint32_t len) {
+    if (out->len + len > out->capacity) {
+        uint32_t capacity = out->capacity ? out->capacity : 256;
+        while (capacity < out->len + len) {
+            capacity *= 2;
+        }
+
+        char* data = kmalloc(capacity);
+        if (!data) return; // Truncated output beats none
+        if (out->data) {
+            memcpy(data, out->data, out->len);
+            kfree(out->data);
+        }
+        out->data = data;
+        out->capacity = capacity;
+    }
+
+    memcpy(out->data + out->len, str, len);
+    out->len += len;
+}
+
+static void procfs_put_string(struct procfs_buffer* out, const char* str) {
+    procfs_put(out, str, strlen(str));
+}
+
+static void procfs_put_uint(struct procfs_buffer* out, uint32_t value) {
+    char digits[10];
+    int n = 0;
+    do {
+        digits[n++] = '0' + value % 10;
+        value /= 10;
+    } while (value);
+
+    char str[10];
+    for (int i = 0; i < n; i++) {
+        str[i] = digits[n - 1 - i];
+    }
+    procfs_put(out, str, n);
+}
+
+static void procfs_put_int(struct procfs_buffer* out, int value) {
+    if (value < 0) {
+        procfs_put_string(out, "-");
+        value = -value;
+    }
+    procfs_put_uint(out, value);
+}
+
+// "name: value\n"
+static void procfs_put_field(struct procfs_buffer* out, const char* name, uint32_t value) {
+    procfs_put_string(out, name);
+    procfs_put_string(out, ": ");
+    procfs_put_uint(out, value);
+    procfs_put_string(out, "\n");
+}
+
+// Percentage of hits among all lookups, 0 before the first one. Stays in
+// 32 bits; there is no libgcc for 64-bit division.
+static void procfs_put_rate(struct procfs_buffer* out, const char* name, uint32_t hits, uint32_t total) {
+    uint32_t rate = 0;
+    if (total >= 100 && hits > 0xFFFFFFFF / 100) {
+        rate = hits / (total / 100);
+    } else if (total) {
+        rate = hits * 100 / total;
+    }
+    procfs_put_field(out, name, rate);
+}
+
+static void procfs_meminfo(struct procfs_buffer* out) {
+    struct kheap_stats heap;
+    kheap_get_stats(&heap);
+
+    procfs_put_field(out, "heap_start", heap.start);
+    procfs_put_field(out, "heap_end", heap.end);
+    procfs_put_field(out, "used_bytes", heap.used_bytes);
+    procfs_put_field(out, "used_blocks", heap.used_blocks);
+    procfs_put_field(out, "free_bytes", heap.free_bytes);
+    procfs_put_field(out, "free_blocks", heap.free_blocks);
+}
+
+static void procfs_pagecache(struct procfs_buffer* out) {
+    struct pagecache_stats stats;
+    pagecache_get_stats(&stats);
+
+    procfs_put_field(out, "hits", stats.hits);
+    procfs_put_field(out, "misses", stats.misses);
+    procfs_put_rate(out, "hit_rate", stats.hits, stats.hits + stats.misses);
+    procfs_put_field(out, "dirty", stats.dirty);
+    procfs_put_field(out, "writebacks", stats.writebacks);
+    procfs_put_field(out, "throttled", stats.throttled);
+}
+
+static void procfs_dcache(struct procfs_buffer* out) {
+    struct dcache_stats stats;
+    dcache_get_stats(&stats);
+
+    uint32_t hits = stats.hits + stats.negative_hits;
+    procfs_put_field(out, "hits", stats.hits);
+    procfs_put_field(out, "negative_hits", stats.negative_hits);
+    procfs_put_field(out, "misses", stats.misses);
+    procfs_put_rate(out, "hit_rate", hits, hits + stats.misses);
+}
+
+static void procfs_processes(struct procfs_buffer* out) {
+    procfs_put_string(out, "pid files mapped level nice name\n");
+
+    for (struct process* proc = process_first(); proc; proc = proc->next) {
+        uint32_t files = 0;
+        for (int i = 0; i < FILE_TABLE_SIZE; i++) {
+            if (proc->files.files[i]) files++;
+        }
+
+        uint32_t mapped = 0;
+        for (struct mmap_region* region = proc->mappings; region; region = region->next) {
+            mapped += region->end - region->start;
+        }
+
+        procfs_put_uint(out, proc->id);
+        procfs_put_string(out, " ");
+        procfs_put_uint(out, files);
+        procfs_put_string(out, " ");
+        procfs_put_uint(out, mapped);
+        procfs_put_string(out, " ");
+        if (proc->task) {
+            procfs_put_uint(out, proc->task->level);
+            procfs_put_string(out, " ");
+            procfs_put_int(out, proc->task->nice);
+        } else {
+            procfs_put_string(out, "- -");
+        }
+        procfs_put_string(out, " ");
+        procfs_put_string(out, proc->name);
+        procfs_put_string(out, "\n");
+    }
+}
+
+static void procfs_interrupts(struct procfs_buffer* out) {
+    procfs_put_string(out, "irq count\n");
+    for (int irq = 0; irq < 16; irq++) {
+        procfs_put_uint(out, irq);
+        procfs_put_string(out, " ");
+        procfs_put_uint(out, isr_get_irq_count(irq));
+        procfs_put_string(out, "\n");
+    }
+}
+
+static void procfs_diskstats(struct procfs_buffer* out) {
+    procfs_put_string(out, "drive reads read_sectors writes write_sectors errors fs\n");
+    for (int i = 0; i < MAX_DISKS; i++) {
+        // Only what is already mounted; looking a filesystem up by
+        // fs_get_mount would probe and mount the drive
+        struct disk* disk = disk_get(i);
+        struct filesystem* fs = fs_get_mounted(i);
+        if (!disk || !fs) continue;
+
+        procfs_put_uint(out, disk->id);
+        procfs_put_string(out, " ");
+        procfs_put_uint(out, disk->stats.reads);
+        procfs_put_string(out, " ");
+        procfs_put_uint(out, disk->stats.read_sectors);
+        procfs_put_string(out, " ");
+        procfs_put_uint(out, disk->stats.writes);
+        procfs_put_string(out, " ");
+        procfs_put_uint(out, disk->stats.write_sectors);
+        procfs_put_string(out, " ");
+        procfs_put_uint(out, disk->stats.errors);
+        procfs_put_string(out, " ");
+        procfs_put_string(out, fs->name);
+        procfs_put_string(out, "\n");
+    }
+}
+
+static const struct procfs_entry procfs_entries[] = {
+    { "meminfo", procfs_meminfo },
+    { "pagecache", procfs_pagecache },
+    { "dcache", procfs_dcache },
+    { "processes", procfs_processes },
+    { "interrupts", procfs_interrupts },
+    { "diskstats", procfs_diskstats },
+};
+
+#define PROCFS_ENTRY_COUNT (sizeof(procfs_entries) / sizeof(procfs_entries[0]))
+
+struct disk* procfs_create() {
+    struct procfs* procfs = kmalloc(sizeof(struct procfs));
+    if (!procfs) return NULL;
+    memset(procfs, 0, sizeof(struct procfs));
+
+    procfs->disk.type = DISK_TYPE_PROCFS;
+    procfs->disk.sector_size = DISK_SECTOR_SIZE;
+    procfs->disk.private = procfs;
+    if (disk_register(&procfs->disk) < 0) {
+        kfree(procfs);
+        return NULL;
+    }
+
+    return &procfs->disk;
+}
+
+int procfs_resolve(struct disk* disk) {
+    if (disk->type != DISK_TYPE_PROCFS) return -1;
+    disk->fs_private = disk->private;
+    return 0;
+}
+
+static struct procfs_file_descriptor* procfs_new_descriptor(const struct procfs_entry* entry) {
+    struct procfs_file_descriptor* desc = kmalloc(sizeof(struct procfs_file_descriptor));
+    if (!desc) return NULL;
+    memset(desc, 0, sizeof(struct procfs_file_descriptor));
+    desc->entry = entry;
+    return desc;
+}
+
+static void procfs_generate(struct procfs_file_descriptor* desc) {
+    if (desc->generated) return;
+    desc->entry->generate(&desc->content);
+    desc->generated = true;
+}
+
+void* procfs_open(struct disk* disk, struct path_part* path, FILE_MODE mode) {
+    if (mode != FILE_MODE_READ || !path || path->next) return NULL;
+
+    for (uint32_t i = 0; i < PROCFS_ENTRY_COUNT; i++) {
+        if (path_part_is(path, procfs_entries[i].name)) {
+            return procfs_new_descriptor(&procfs_entries[i]);
+        }
+    }
+    return NULL;
+}
+
+int procfs_pread(struct disk* disk, void* private, char* out, uint32_t count, uint32_t offset) {
+    struct procfs_file_descriptor* desc = (struct procfs_file_descriptor*)private;
+    procfs_generate(desc);
+
+    if (offset >= desc->content.len) return 0;
+    if (count > desc->content.len - offset) count = desc->content.len - offset;
+
+    memcpy(out, desc->content.data + offset, count);
+    return count;
+}
+
+int procfs_read(struct disk* disk, void* private, uint32_t size, uint32_t nmemb, char* out) {
+    struct procfs_file_descriptor* desc = (struct procfs_file_descriptor*)private;
+    int res = procfs_pread(disk, desc, out, size * nmemb, desc->pos);
+    if (res < 0) return res;
+
+    desc->pos += res;
+    return res / size;
+}
+
+int procfs_seek(void* private, int offset, FILE_SEEK_MODE whence) {
+    struct procfs_file_descriptor* desc = (struct procfs_file_descriptor*)private;
+    procfs_generate(desc);
+    uint32_t new_pos = desc->pos;
+
+    switch (whence) {
+        case FILE_SEEK_SET:
+            new_pos = offset;
+            break;
+        case FILE_SEEK_CUR:
+            new_pos += offset;
+            break;
+        case FILE_SEEK_END:
+            new_pos = desc->content.len + offset;
+            break;
+    }
+
+    if (new_pos > desc->content.len) {
+        return -1;
+    }
+
+    desc->pos = new_pos;
+    return 0;
+}
+
+int procfs_tell(void* private) {
+    struct procfs_file_descriptor* desc = (struct procfs_file_descriptor*)private;
+    return desc->pos;
+}
+
+int procfs_close(void* private) {
+    struct procfs_file_descriptor* desc = (struct procfs_file_descriptor*)private;
+    if (desc->content.data) kfree(desc->content.data);
+    kfree(desc);
+    return 0;
+}
+
+int procfs_stat(struct disk* disk, void* private, struct file_stat* stat) {
+    struct procfs_file_descriptor* desc = (struct procfs_file_descriptor*)private;
+    procfs_generate(desc);
+
+    stat->filesize = desc->content.len;
+    stat->ino = desc->entry - procfs_entries + 1;
+    stat->flags = FILE_STAT_READ_ONLY;
+    return 0;
+}
+
+void* procfs_opendir(struct disk* disk, struct path_part* path) {
+    if (path) return NULL; // Only the root directory
+    return procfs_new_descriptor(NULL);
+}
+
+// Sizes aren't known until a file is generated, so listings show 0
+int procfs_readdir(struct disk* disk, void* private, uint32_t* cursor, struct fs_dirent* entries, uint32_t count) {
+    uint32_t filled = 0;
+    uint32_t i = *cursor;
+    for (; i < PROCFS_ENTRY_COUNT && filled < count; i++) {
+        struct fs_dirent* dirent = &entries[filled++];
+        memset(dirent, 0, sizeof(struct fs_dirent));
+        strncpy(dirent->name, procfs_entries[i].name, FS_DIRENT_NAME_LEN - 1);
+        dirent->flags = FILE_STAT_READ_ONLY;
+        dirent->first_cluster = i + 1;
+    }
+
+    *cursor = i;
+    return filled;
+}
+
+int procfs_closedir(void* private) {
+    return procfs_close(private);
+}
@@ -0,0 +1,51 @@
+#ifndef PROCFS_H
+#define PROCFS_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "file.h"
+#include "../drivers/disk.h"
+
+// Text being generated for a file
+struct procfs_buffer {
+    char* data;
+    uint32_t len;
+    uint32_t capacity;
+};
+
+typedef void (*PROCFS_GENERATE_FUNCTION)(struct procfs_buffer* out);
+
+struct procfs_entry {
+    const char* name;
+    PROCFS_GENERATE_FUNCTION generate;
+};
+
+struct procfs {
+    struct disk disk;
+};
+
+// Files are generated from live kernel state on first read, so a
+// descriptor sees one consistent snapshot and reopening refreshes it
+struct procfs_file_descriptor {
+    const struct procfs_entry* entry; // NULL for the root directory
+    struct procfs_buffer content;
+    bool generated;
+    uint32_t pos;
+};
+
+struct filesystem* procfs_init_vfs();
+struct disk* procfs_create();
+
+int procfs_resolve(struct disk* disk);
+void* procfs_open(struct disk* disk, struct path_part* path, FILE_MODE mode);
+int procfs_read(struct disk* disk, void* private, uint32_t size, uint32_t nmemb, char* out);
+int procfs_pread(struct disk* disk, void* private, char* out, uint32_t count, uint32_t offset);
+int procfs_seek(void* private, int offset, FILE_SEEK_MODE whence);
+int procfs_tell(void* private);
+int procfs_close(void* private);
+int procfs_stat(struct disk* disk, void* private, struct file_stat* stat);
+void* procfs_opendir(struct disk* disk, struct path_part* path);
+int procfs_readdir(struct disk* disk, void* private, uint32_t* cursor, struct fs_dirent* entries, uint32_t count);
+int procfs_closedir(void* private);
+
+#endif
@@ -0,0 +1,447 @@
+#include "tmpfs.h"
+#include "../memory/heap/kheap.h"
+#include "../string/string.h"
+#include <stddef.h>
+
+struct filesystem* tmpfs_init_vfs() {
+    static struct filesystem tmpfs_fs = {
+        .name = "tmpfs",
+        .flags = FS_FLAG_MEMORY,
+        .resolve = tmpfs_resolve,
+        .unmount = tmpfs_unmount,
+        .open = tmpfs_open,
+        .read = (FS_READ_FUNCTION)tmpfs_read,
+        .seek = (FS_SEEK_FUNCTION)tmpfs_seek,
+        .tell = (FS_TELL_FUNCTION)tmpfs_tell,
+        .close = (FS_CLOSE_FUNCTION)tmpfs_close,
+        .stat = (FS_STAT_FUNCTION)tmpfs_stat,
+        .opendir = (FS_OPENDIR_FUNCTION)tmpfs_opendir,
+        .readdir = (FS_READDIR_FUNCTION)tmpfs_readdir,
+        .closedir = (FS_CLOSEDIR_FUNCTION)tmpfs_closedir,
+        .write = (FS_WRITE_FUNCTION)tmpfs_write,
+        .truncate = (FS_TRUNCATE_FUNCTION)tmpfs_truncate,
+        .fallocate = (FS_FALLOCATE_FUNCTION)tmpfs_fallocate,
+        .unlink = (FS_UNLINK_FUNCTION)tmpfs_unlink,
+        .pread = (FS_PREAD_FUNCTION)tmpfs_pread,
+        .pwrite = (FS_PWRITE_FUNCTION)tmpfs_pwrite,
+        .mkdir = (FS_MKDIR_FUNCTION)tmpfs_mkdir
+    };
+    return &tmpfs_fs;
+}
+
+static struct tmpfs_node* tmpfs_new_node(struct tmpfs* tmpfs, struct tmpfs_node* parent, const char* name, uint32_t len, bool directory) {
+    if (len >= TMPFS_NAME_LEN) return NULL;
+
+    struct tmpfs_node* node = kmalloc(sizeof(struct tmpfs_node));
+    if (!node) return NULL;
+    memset(node, 0, sizeof(struct tmpfs_node));
+    memcpy(node->name, name, len);
+    node->name[len] = '\0';
+    node->ino = tmpfs->next_ino++;
+    node->directory = directory;
+    node->parent = parent;
+
+    if (parent) {
+        struct tmpfs_node** link = &parent->children;
+        while (*link) {
+            link = &(*link)->next;
+        }
+        *link = node;
+    }
+    return node;
+}
+
+static void tmpfs_free_pages(struct tmpfs* tmpfs, struct tmpfs_node* node, uint32_t first) {
+    for (uint32_t i = first; i < node->page_slots; i++) {
+        if (node->pages[i]) {
+            kfree(node->pages[i]);
+            node->pages[i] = NULL;
+            tmpfs->pages_used--;
+        }
+    }
+}
+
+static void tmpfs_free_node(struct tmpfs* tmpfs, struct tmpfs_node* node) {
+    tmpfs_free_pages(tmpfs, node, 0);
+    if (node->pages) kfree(node->pages);
+    kfree(node);
+}
+
+static struct tmpfs_node* tmpfs_lookup(struct tmpfs_node* dir, const struct path_part* name) {
+    for (struct tmpfs_node* child = dir->children; child; child = child->next) {
+        if (path_part_is(name, child->name)) {
+            return child;
+        }
+    }
+    return NULL;
+}
+
+// Follow every component but the last, which is returned with *parent set
+// to the directory that should hold it
+static struct path_part* tmpfs_walk_parent(struct tmpfs* tmpfs, struct path_part* path, struct tmpfs_node** parent) {
+    struct tmpfs_node* dir = tmpfs->root;
+    while (path && path->next) {
+        dir = tmpfs_lookup(dir, path);
+        if (!dir || !dir->directory) return NULL;
+        path = path->next;
+    }
+    *parent = dir;
+    return path;
+}
+
+// Make sure there is a page slot for every page below `pages`
+static int tmpfs_reserve_slots(struct tmpfs_node* node, uint32_t pages) {
+    if (pages <= node->page_slots) return 0;
+
+    uint32_t slots = node->page_slots ? node->page_slots : 4;
+    while (slots < pages) {
+        slots *= 2;
+    }
+
+    char** array = kmalloc(slots * sizeof(char*));
+    if (!array) return -1;
+    memset(array, 0, slots * sizeof(char*));
+    if (node->pages) {
+        memcpy(array, node->pages, node->page_slots * sizeof(char*));
+        kfree(node->pages);
+    }
+    node->pages = array;
+    node->page_slots = slots;
+    return 0;
+}
+
+static char* tmpfs_get_page(struct tmpfs* tmpfs, struct tmpfs_node* node, uint32_t index) {
+    if (node->pages[index]) return node->pages[index];
+    if (tmpfs->pages_used >= tmpfs->max_pages) return NULL;
+
+    char* page = kmalloc_a(TMPFS_PAGE_SIZE);
+    if (!page) return NULL;
+    memset(page, 0, TMPFS_PAGE_SIZE);
+    node->pages[index] = page;
+    tmpfs->pages_used++;
+    return page;
+}
+
+struct disk* tmpfs_create(uint32_t max_pages) {
+    struct tmpfs* tmpfs = kmalloc(sizeof(struct tmpfs));
+    if (!tmpfs) return NULL;
+    memset(tmpfs, 0, sizeof(struct tmpfs));
+
+    tmpfs->next_ino = 1;
+    tmpfs->max_pages = max_pages ? max_pages : TMPFS_DEFAULT_PAGES;
+    tmpfs->root = tmpfs_new_node(tmpfs, NULL, "", 0, true);
+    if (!tmpfs->root) {
+        kfree(tmpfs);
+        return NULL;
+    }
+
+    // A drive with no sector I/O; only tmpfs_resolve will accept it
+    tmpfs->disk.type = DISK_TYPE_TMPFS;
+    tmpfs->disk.sector_size = TMPFS_PAGE_SIZE;
+    tmpfs->disk.private = tmpfs;
+    if (disk_register(&tmpfs->disk) < 0) {
+        tmpfs_free_node(tmpfs, tmpfs->root);
+        kfree(tmpfs);
+        return NULL;
+    }
+
+    return &tmpfs->disk;
+}
+
+int tmpfs_resolve(struct disk* disk) {
+    if (disk->type != DISK_TYPE_TMPFS) return -1;
+    disk->fs_private = disk->private;
+    return 0;
+}
+
+int tmpfs_unmount(struct disk* disk) {
+    // The contents belong to the drive, so they survive a remount
+    disk->fs_private = NULL;
+    return 0;
+}
+
+void* tmpfs_open(struct disk* disk, struct path_part* path, FILE_MODE mode) {
+    struct tmpfs* tmpfs = disk->fs_private;
+    struct tmpfs_node* parent;
+    struct path_part* last = tmpfs_walk_parent(tmpfs, path, &parent);
+    if (!last) return NULL;
+
+    struct tmpfs_node* node = tmpfs_lookup(parent, last);
+    if (!node) {
+        if (mode == FILE_MODE_READ) return NULL;
+        if (path_part_is(last, ".") || path_part_is(last, "..")) return NULL;
+        node = tmpfs_new_node(tmpfs, parent, last->part, last->len, false);
+        if (!node) return NULL;
+    }
+    if (node->directory) return NULL;
+
+    struct tmpfs_file_descriptor* desc = kmalloc(sizeof(struct tmpfs_file_descriptor));
+    if (!desc) return NULL;
+    desc->tmpfs = tmpfs;
+    desc->node = node;
+    desc->pos = 0;
+    desc->mode = mode;
+    node->refcount++;
+
+    if (mode == FILE_MODE_WRITE) {
+        tmpfs_free_pages(tmpfs, node, 0);
+        node->size = 0;
+    } else if (mode == FILE_MODE_APPEND) {
+        desc->pos = node->size;
+    }
+    return desc;
+}
+
+int tmpfs_pread(struct disk* disk, void* private, char* out, uint32_t count, uint32_t offset) {
+    struct tmpfs_file_descriptor* desc = (struct tmpfs_file_descriptor*)private;
+    struct tmpfs_node* node = desc->node;
+
+    if (offset >= node->size) return 0;
+    if (count > node->size - offset) count = node->size - offset;
+
+    uint32_t done = 0;
+    while (done < count) {
+        uint32_t pos = offset + done;
+        uint32_t index = pos >> TMPFS_PAGE_SHIFT;
+        uint32_t in_page = pos & (TMPFS_PAGE_SIZE - 1);
+        uint32_t chunk = TMPFS_PAGE_SIZE - in_page;
+        if (chunk > count - done) chunk = count - done;
+
+        if (index < node->page_slots && node->pages[index]) {
+            memcpy(out + done, node->pages[index] + in_page, chunk);
+        } else {
+            memset(out + done, 0, chunk);
+        }
+        done += chunk;
+    }
+
+    return done;
+}
+
+int tmpfs_pwrite(struct disk* disk, void* private, const char* in, uint32_t count, uint32_t offset) {
+    struct tmpfs_file_descriptor* desc = (struct tmpfs_file_descriptor*)private;
+    struct tmpfs* tmpfs = disk->fs_private;
+    struct tmpfs_node* node = desc->node;
+    if (desc->mode == FILE_MODE_READ) return -1;
+    if (count == 0) return 0;
+
+    uint32_t end = offset + count;
+    if (end < offset) return -2;
+    if (tmpfs_reserve_slots(node, (end + TMPFS_PAGE_SIZE - 1) >> TMPFS_PAGE_SHIFT) != 0) return -3;
+
+    uint32_t done = 0;
+    while (done < count) {
+        uint32_t pos = offset + done;
+        uint32_t in_page = pos & (TMPFS_PAGE_SIZE - 1);
+        uint32_t chunk = TMPFS_PAGE_SIZE - in_page;
+        if (chunk > count - done) chunk = count - done;
+
+        char* page = tmpfs_get_page(tmpfs, node, pos >> TMPFS_PAGE_SHIFT);
+        if (!page) break; // Out of space
+        memcpy(page + in_page, in + done, chunk);
+        done += chunk;
+    }
+
+    if (offset + done > node->size) {
+        node->size = offset + done;
+    }
+    if (done == 0) return -4;
+    return done;
+}
+
+int tmpfs_read(struct disk* disk, void* private, uint32_t size, uint32_t nmemb, char* out) {
+    struct tmpfs_file_descriptor* desc = (struct tmpfs_file_descriptor*)private;
+    int res = tmpfs_pread(disk, desc, out, size * nmemb, desc->pos);
+    if (res < 0) return res;
+
+    desc->pos += res;
+    return res / size;
+}
+
+int tmpfs_write(struct disk* disk, void* private, uint32_t size, uint32_t nmemb, const char* in) {
+    struct tmpfs_file_descriptor* desc = (struct tmpfs_file_descriptor*)private;
+    if (desc->mode == FILE_MODE_APPEND) {
+        desc->pos = desc->node->size;
+    }
+
+    int res = tmpfs_pwrite(disk, desc, in, size * nmemb, desc->pos);
+    if (res < 0) return res;
+
+    desc->pos += res;
+    return res / size;
+}
+
+int tmpfs_seek(void* private, int offset, FILE_SEEK_MODE whence) {
+    struct tmpfs_file_descriptor* desc = (struct tmpfs_file_descriptor*)private;
+    uint32_t new_pos = desc->pos;
+
+    switch (whence) {
+        case FILE_SEEK_SET:
+            new_pos = offset;
+            break;
+        case FILE_SEEK_CUR:
+            new_pos += offset;
+            break;
+        case FILE_SEEK_END:
+            new_pos = desc->node->size + offset;
+            break;
+    }
+
+    if (new_pos > desc->node->size) {
+        return -1;
+    }
+
+    desc->pos = new_pos;
+    return 0;
+}
+
+int tmpfs_tell(void* private) {
+    struct tmpfs_file_descriptor* desc = (struct tmpfs_file_descriptor*)private;
+    return desc->pos;
+}
+
+static void tmpfs_put_node(struct tmpfs* tmpfs, struct tmpfs_node* node) {
+    if (--node->refcount == 0 && node->unlinked) {
+        tmpfs_free_node(tmpfs, node);
+    }
+}
+
+int tmpfs_close(void* private) {
+    struct tmpfs_file_descriptor* desc = (struct tmpfs_file_descriptor*)private;
+    tmpfs_put_node(desc->tmpfs, desc->node);
+    kfree(desc);
+    return 0;
+}
+
+int tmpfs_stat(struct disk* disk, void* private, struct file_stat* stat) {
+    struct tmpfs_file_descriptor* desc = (struct tmpfs_file_descriptor*)private;
+    stat->filesize = desc->node->size;
+    stat->ino = desc->node->ino;
+    stat->flags = desc->node->directory ? FILE_STAT_DIRECTORY : 0;
+    return 0;
+}
+
+int tmpfs_truncate(struct disk* disk, void* private, uint32_t size) {
+    struct tmpfs_file_descriptor* desc = (struct tmpfs_file_descriptor*)private;
+    struct tmpfs* tmpfs = disk->fs_private;
+    struct tmpfs_node* node = desc->node;
+    if (desc->mode == FILE_MODE_READ) return -1;
+
+    if (size < node->size) {
+        uint32_t keep = (size + TMPFS_PAGE_SIZE - 1) >> TMPFS_PAGE_SHIFT;
+        tmpfs_free_pages(tmpfs, node, keep);
+
+        // The new last page must read as zeros past the end of file. It
+        // may have no slot at all if the file was only ever grown.
+        uint32_t tail = size & (TMPFS_PAGE_SIZE - 1);
+        if (tail && node->pages && keep - 1 < node->page_slots && node->pages[keep - 1]) {
+            memset(node->pages[keep - 1] + tail, 0, TMPFS_PAGE_SIZE - tail);
+        }
+        if (desc->pos > size) {
+            desc->pos = size;
+        }
+    }
+
+    // Growing leaves the new range unbacked, reading as zeros
+    node->size = size;
+    return 0;
+}
+
+int tmpfs_fallocate(struct disk* disk, void* private, uint32_t length) {
+    struct tmpfs_file_descriptor* desc = (struct tmpfs_file_descriptor*)private;
+    struct tmpfs* tmpfs = disk->fs_private;
+    struct tmpfs_node* node = desc->node;
+    if (desc->mode == FILE_MODE_READ) return -1;
+
+    uint32_t pages = (length + TMPFS_PAGE_SIZE - 1) >> TMPFS_PAGE_SHIFT;
+    if (tmpfs_reserve_slots(node, pages) != 0) return -2;
+
+    for (uint32_t i = 0; i < pages; i++) {
+        if (!tmpfs_get_page(tmpfs, node, i)) return -3;
+    }
+    return 0;
+}
+
+int tmpfs_unlink(struct disk* disk, struct path_part* path) {
+    struct tmpfs* tmpfs = disk->fs_private;
+    struct tmpfs_node* parent;
+    struct path_part* last = tmpfs_walk_parent(tmpfs, path, &parent);
+    if (!last) return -1;
+
+    struct tmpfs_node* node = tmpfs_lookup(parent, last);
+    if (!node) return -1;
+    if (node->directory && node->children) return -2; // Not empty
+
+    struct tmpfs_node** link = &parent->children;
+    while (*link != node) {
+        link = &(*link)->next;
+    }
+    *link = node->next;
+    node->next = NULL;
+    node->parent = NULL;
+
+    // Open handles keep the data until they close
+    if (node->refcount > 0) {
+        node->unlinked = true;
+        return 0;
+    }
+
+    tmpfs_free_node(tmpfs, node);
+    return 0;
+}
+
+int tmpfs_mkdir(struct disk* disk, struct path_part* path) {
+    struct tmpfs* tmpfs = disk->fs_private;
+    struct tmpfs_node* parent;
+    struct path_part* last = tmpfs_walk_parent(tmpfs, path, &parent);
+    if (!last) return -1;
+    if (tmpfs_lookup(parent, last)) return -2; // Exists
+
+    if (path_part_is(last, ".") || path_part_is(last, "..")) return -3;
+    return tmpfs_new_node(tmpfs, parent, last->part, last->len, true) ? 0 : -3;
+}
+
+void* tmpfs_opendir(struct disk* disk, struct path_part* path) {
+    struct tmpfs* tmpfs = disk->fs_private;
+    struct tmpfs_node* dir = tmpfs->root;
+
+    for (struct path_part* part = path; part; part = part->next) {
+        dir = tmpfs_lookup(dir, part);
+        if (!dir || !dir->directory) return NULL;
+    }
+
+    struct tmpfs_file_descriptor* desc = kmalloc(sizeof(struct tmpfs_file_descriptor));
+    if (!desc) return NULL;
+    desc->tmpfs = tmpfs;
+    desc->node = dir;
+    desc->pos = 0;
+    desc->mode = FILE_MODE_READ;
+    dir->refcount++;
+    return desc;
+}
+
+int tmpfs_readdir(struct disk* disk, void* private, uint32_t* cursor, struct fs_dirent* entries, uint32_t count) {
+    struct tmpfs_file_descriptor* desc = (struct tmpfs_file_descriptor*)private;
+
+    // The cursor counts children in creation order
+    struct tmpfs_node* child = desc->node->children;
+    for (uint32_t i = 0; child && i < *cursor; i++) {
+        child = child->next;
+    }
+
+    uint32_t filled = 0;
+    for (; child && filled < count; child = child->next) {
+        struct fs_dirent* entry = &entries[filled++];
+        strcpy(entry->name, child->name);
+        entry->size = child->size;
+        entry->flags = child->directory ? FILE_STAT_DIRECTORY : 0;
+        entry->first_cluster = child->ino;
+    }
+
+    *cursor += filled;
+    return filled;
+}
+
+int tmpfs_closedir(void* private) {
+    return tmpfs_close(private);
+}
@@ -0,0 +1,71 @@
+#ifndef TMPFS_H
+#define TMPFS_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "file.h"
+#include "../drivers/disk.h"
+
+#define TMPFS_PAGE_SIZE 4096
+#define TMPFS_PAGE_SHIFT 12
+#define TMPFS_NAME_LEN FS_DIRENT_NAME_LEN
+#define TMPFS_DEFAULT_PAGES 256 // 1MB
+
+struct tmpfs_node {
+    char name[TMPFS_NAME_LEN];
+    uint32_t ino;
+    bool directory;
+
+    // File data, one page per slot. Pages never written are NULL and
+    // read as zeros.
+    uint32_t size;
+    char** pages;
+    uint32_t page_slots;
+
+    struct tmpfs_node* parent;
+    struct tmpfs_node* children; // Kept in creation order
+    struct tmpfs_node* next;
+
+    // Open handles; an unlinked node is freed when the last one closes
+    int refcount;
+    bool unlinked;
+};
+
+struct tmpfs {
+    struct disk disk;
+    struct tmpfs_node* root;
+    uint32_t next_ino;
+    uint32_t pages_used;
+    uint32_t max_pages;
+};
+
+struct tmpfs_file_descriptor {
+    struct tmpfs* tmpfs;
+    struct tmpfs_node* node;
+    uint32_t pos;
+    FILE_MODE mode;
+};
+
+struct filesystem* tmpfs_init_vfs();
+struct disk* tmpfs_create(uint32_t max_pages);
+
+int tmpfs_resolve(struct disk* disk);
+int tmpfs_unmount(struct disk* disk);
+void* tmpfs_open(struct disk* disk, struct path_part* path, FILE_MODE mode);
+int tmpfs_read(struct disk* disk, void* private, uint32_t size, uint32_t nmemb, char* out);
+int tmpfs_write(struct disk* disk, void* private, uint32_t size, uint32_t nmemb, const char* in);
+int tmpfs_pread(struct disk* disk, void* private, char* out, uint32_t count, uint32_t offset);
+int tmpfs_pwrite(struct disk* disk, void* private, const char* in, uint32_t count, uint32_t offset);
+int tmpfs_seek(void* private, int offset, FILE_SEEK_MODE whence);
+int tmpfs_tell(void* private);
+int tmpfs_close(void* private);
+int tmpfs_stat(struct disk* disk, void* private, struct file_stat* stat);
+int tmpfs_truncate(struct disk* disk, void* private, uint32_t size);
+int tmpfs_fallocate(struct disk* disk, void* private, uint32_t length);
+int tmpfs_unlink(struct disk* disk, struct path_part* path);
+int tmpfs_mkdir(struct disk* disk, struct path_part* path);
+void* tmpfs_opendir(struct disk* disk, struct path_part* path);
+int tmpfs_readdir(struct disk* disk, void* private, uint32_t* cursor, struct fs_dirent* entries, uint32_t count);
+int tmpfs_closedir(void* private);
+
+#endif
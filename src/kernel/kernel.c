@@ -3,10 +3,13 @@
 #include "../cpu/idt.h"
 #include "../drivers/serial.h"
 #include "../drivers/ata.h"
+#include "../drivers/disk.h"
+#include "../drivers/raid0.h"
 #include "../fs/path_parser.h"
 
 #include "../memory/heap/kheap.h"
 #include "../memory/paging/paging.h"
+#include "../memory/mmap/mmap.h"
 
 #include "../cpu/gdt.h"
 #include "../string/string.h"
@@ -14,11 +17,20 @@
 #include "../drivers/disk_stream.h"
 #include "../fs/fat16.h"
 #include "../fs/file.h"
+#include "../fs/pagecache.h"
+#include "../fs/tmpfs.h"
+#include "../fs/initramfs.h"
+#include "../fs/procfs.h"
 #include "panic.h"
 #include "../task/task.h"
 #include "../task/process.h"
+#include "../task/syscall.h"
+#include "../task/fpu.h"
 #include "../drivers/keyboard.h"
+#include "../drivers/timer.h"
+#include "../drivers/clocksource.h"
 #include "command.h"
+#include "../cpu/cpu.h"
 
 void idt_init() {
     isr_install();
@@ -43,13 +55,17 @@ void echo_handler(int argc, char** argv) {
 }
 
 void run_handler(int argc, char** argv) {
-    if (argc < 2) {
-        print_string("Usage: run <filename>\n");
+    bool background = argc > 2 && strcmp(argv[2], "&") == 0;
+    if (argc < 2 || (argc > 2 && !background)) {
+        print_string("Usage: run <filename> [&]\n");
         return;
     }
 
     struct process* process = NULL;
-    if (process_load(argv[1], &process) < 0) {
+    fs_lock();
+    int res = process_load(argv[1], &process);
+    fs_unlock();
+    if (res < 0) {
         print_string("Failed to load process: ");
         print_string(argv[1]);
         print_string("\n");
@@ -58,15 +74,24 @@ void run_handler(int argc, char** argv) {
 
     struct task* task = task_new(process);
     if (!task) {
+        fs_lock();
+        process_free(process);
+        fs_unlock();
         print_string("Failed to create task\n");
         return;
     }
 
-    print_string("Starting process: ");
+    // A foreground process has the keyboard until it exits; the shell
+    // waits in keyboard_getc until then. It can't have run yet, as the
+    // shell isn't preempted.
+    if (!background) keyboard_set_owner(task);
+
+    char num[12];
+    print_string("Started process ");
+    print_string(itoa(process->id, num));
+    print_string(": ");
     print_string(argv[1]);
     print_string("\n");
-
-    task_switch(task);
 }
 
 void ls_handler(int argc, char** argv) {
@@ -75,10 +100,546 @@ void ls_handler(int argc, char** argv) {
         path = argv[1];
     }
 
-    if (fs_list(path) != 0) {
+    fs_lock();
+    int dd = opendir(path);
+    if (dd <= 0) {
+        fs_unlock();
         print_string("ls: Failed to list directory: ");
         print_string(path);
         print_string("\n");
+        return;
+    }
+
+    struct fs_dirent entries[16];
+    int count;
+    while ((count = readdir(dd, entries, 16)) > 0) {
+        for (int i = 0; i < count; i++) {
+            print_string(entries[i].name);
+            if (entries[i].flags & FILE_STAT_DIRECTORY) print_string("/");
+            print_string("\n");
+        }
+    }
+    closedir(dd);
+    fs_unlock();
+}
+
+void cat_handler(int argc, char** argv) {
+    if (argc < 2) {
+        print_string("Usage: cat <file>\n");
+        return;
+    }
+
+    fs_lock();
+    int fd = fopen(argv[1], "r");
+    if (fd <= 0) {
+        fs_unlock();
+        print_string("cat: Failed to open file: ");
+        print_string(argv[1]);
+        print_string("\n");
+        return;
+    }
+
+    char buf[257];
+    int n;
+    while ((n = fread(buf, 1, sizeof(buf) - 1, fd)) > 0) {
+        buf[n] = 0;
+        print_string(buf);
+    }
+    fclose(fd);
+    fs_unlock();
+}
+
+void write_handler(int argc, char** argv) {
+    if (argc < 2) {
+        print_string("Usage: write <file> [text...]\n");
+        return;
+    }
+
+    fs_lock();
+    int fd = fopen(argv[1], "w");
+    if (fd <= 0) {
+        fs_unlock();
+        print_string("write: Failed to open file: ");
+        print_string(argv[1]);
+        print_string("\n");
+        return;
+    }
+
+    int res = 0;
+    for (int i = 2; i < argc && res >= 0; i++) {
+        res = fwrite(argv[i], 1, strlen(argv[i]), fd);
+        if (res >= 0) res = fwrite(i < argc - 1 ? " " : "\n", 1, 1, fd);
+    }
+    if (fclose(fd) != 0) res = -1;
+    fs_unlock();
+
+    if (res < 0) {
+        print_string("write: Failed to write file: ");
+        print_string(argv[1]);
+        print_string("\n");
+    }
+}
+
+void rm_handler(int argc, char** argv) {
+    if (argc < 2) {
+        print_string("Usage: rm <file>\n");
+        return;
+    }
+
+    fs_lock();
+    int res = funlink(argv[1]);
+    fs_unlock();
+    if (res != 0) {
+        print_string("rm: Failed to remove file: ");
+        print_string(argv[1]);
+        print_string("\n");
+    }
+}
+
+void mkdir_handler(int argc, char** argv) {
+    if (argc < 2) {
+        print_string("Usage: mkdir <path>\n");
+        return;
+    }
+
+    fs_lock();
+    int res = mkdir(argv[1]);
+    fs_unlock();
+    if (res != 0) {
+        print_string("mkdir: Failed to create directory: ");
+        print_string(argv[1]);
+        print_string("\n");
+    }
+}
+
+void tmpfs_handler(int argc, char** argv) {
+    uint32_t pages = argc > 1 ? atoi(argv[1]) : TMPFS_DEFAULT_PAGES;
+    fs_lock();
+    struct disk* disk = tmpfs_create(pages);
+    int res = disk ? fs_mount(disk->id) : -1;
+    fs_unlock();
+    if (!disk) {
+        print_string("tmpfs: Failed to create filesystem\n");
+        return;
+    }
+
+    if (res != 0) {
+        print_string("tmpfs: Failed to mount\n");
+        return;
+    }
+
+    char num[12];
+    print_string("Mounted tmpfs on drive ");
+    print_string(itoa(disk->id, num));
+    print_string("\n");
+}
+
+void sync_handler(int argc, char** argv) {
+    fs_lock();
+    int res = fs_sync();
+    fs_unlock();
+    if (res != 0) {
+        print_string("sync: Write-back failed\n");
+    }
+}
+
+void raid0_handler(int argc, char** argv) {
+    if (argc < 3) {
+        print_string("Usage: raid0 <chunk_sectors> <drive> [drive...]\n");
+        return;
+    }
+
+    struct raid0_member members[RAID0_MAX_MEMBERS];
+    int count = 0;
+    fs_lock();
+    for (int i = 2; i < argc && count < RAID0_MAX_MEMBERS; i++) {
+        members[count].disk = disk_get(atoi(argv[i]));
+        members[count].start_lba = 0;
+        count++;
+    }
+
+    struct disk* disk = raid0_create(members, count, atoi(argv[1]));
+    fs_unlock();
+    if (!disk) {
+        print_string("raid0: Failed to create volume\n");
+        return;
+    }
+
+    char num[12];
+    print_string("Created RAID-0 volume on drive ");
+    print_string(itoa(disk->id, num));
+    print_string("\n");
+}
+
+#define RAIDBENCH_CHUNK_SECTORS 128
+#define RAIDBENCH_REQUEST_SECTORS 128
+#define RAIDBENCH_MEMBER_STRIDE 4096
+
+void raidbench_handler(int argc, char** argv) {
+    int total_kb = argc > 1 ? atoi(argv[1]) : 1024;
+    struct disk* drives[RAID0_MAX_MEMBERS];
+    int drive_count = 0;
+    for (int i = 2; i < argc; i++) {
+        if (drive_count == RAID0_MAX_MEMBERS || !(drives[drive_count] = disk_get(atoi(argv[i])))) {
+            drive_count = -1;
+            break;
+        }
+        drive_count++;
+    }
+
+    // Drive 1 alone by default
+    if (argc <= 2) {
+        drives[0] = disk_get(1);
+        drive_count = drives[0] ? 1 : 0;
+    }
+
+    if (drive_count <= 0 || total_kb <= 0) {
+        print_string("Usage: raidbench [kb] [drive...]\n");
+        return;
+    }
+
+    char* buf = kmalloc(RAIDBENCH_REQUEST_SECTORS * DISK_SECTOR_SIZE);
+    if (!buf) {
+        print_string("raidbench: Out of memory\n");
+        return;
+    }
+    uint32_t total_sectors = (uint32_t)total_kb * 2;
+    char num[12];
+
+    // Given several drives, stripe across the first 1, 2, ... of them.
+    // Given one, members are slices of it spaced RAIDBENCH_MEMBER_STRIDE
+    // sectors apart: the array shape changes but the device does not.
+    bool slices = drive_count == 1;
+    int max_width = slices ? 4 : drive_count;
+    if (slices) {
+        print_string("One drive: members are slices of it, so this shows chunking overhead, not striping gain\n");
+    }
+
+    for (int width = 1; width <= max_width; width = slices ? width * 2 : width + 1) {
+        struct raid0_member members[RAID0_MAX_MEMBERS];
+        for (int m = 0; m < width; m++) {
+            members[m].disk = slices ? drives[0] : drives[m];
+            members[m].start_lba = slices ? m * RAIDBENCH_MEMBER_STRIDE : 0;
+        }
+
+        struct raid0 raid;
+        if (raid0_init(&raid, members, width, RAIDBENCH_CHUNK_SECTORS) != 0) break;
+
+        uint64_t start = ktime_get_ns();
+        int res = 0;
+        for (uint32_t lba = 0; lba < total_sectors && res == 0; lba += RAIDBENCH_REQUEST_SECTORS) {
+            uint32_t count = total_sectors - lba;
+            if (count > RAIDBENCH_REQUEST_SECTORS) count = RAIDBENCH_REQUEST_SECTORS;
+            res = disk_read_sectors(&raid.disk, lba, count, buf);
+        }
+        uint32_t us = clocksource_div(ktime_get_ns() - start, NSEC_PER_USEC);
+
+        print_string("members: ");
+        print_string(itoa(width, num));
+        if (res != 0) {
+            print_string("  read error\n");
+            continue;
+        }
+        print_string("  us: ");
+        print_string(itoa(us, num));
+        print_string("  KB/s: ");
+        print_string(itoa(us ? clocksource_div((uint64_t)total_kb * USEC_PER_SEC, us) : 0, num));
+        print_string("\n");
+    }
+
+    kfree(buf);
+}
+
+void timer_handler(int argc, char** argv) {
+    if (argc > 1 && timer_set_frequency(atoi(argv[1])) != 0) {
+        print_string("Usage: timer [hz] (19 to 10000)\n");
+        return;
+    }
+
+    struct task_stats stats;
+    task_get_stats(&stats);
+
+    char num[12];
+    print_string("hz: ");
+    print_string(itoa(timer_get_frequency(), num));
+    print_string("  ticks: ");
+    print_string(itoa(timer_get_ticks(), num));
+    print_string("  switches: ");
+    print_string(itoa(stats.switches, num));
+    print_string("  preemptions: ");
+    print_string(itoa(stats.preemptions, num));
+    print_string("  wakeups: ");
+    print_string(itoa(stats.wakeups, num));
+    print_string("  deadline misses: ");
+    print_string(itoa(stats.deadline_misses, num));
+    print_string("\n");
+}
+
+void uptime_handler(int argc, char** argv) {
+    uint32_t ms = ktime_get_ms();
+    uint32_t khz = clocksource_get_tsc_khz();
+
+    char num[12];
+    print_string("up ");
+    print_string(itoa(ms / 1000, num));
+    print_string(".");
+    uint32_t frac = ms % 1000;
+    if (frac < 100) print_string("0");
+    if (frac < 10) print_string("0");
+    print_string(itoa(frac, num));
+    print_string(" s  tsc: ");
+    print_string(itoa(khz / 1000, num));
+    print_string(" MHz  calibrated against: ");
+    print_string(clocksource_get_reference());
+    print_string("\n");
+}
+
+void sleep_handler(int argc, char** argv) {
+    int ms = argc > 1 ? atoi(argv[1]) : 0;
+    if (ms <= 0) {
+        print_string("Usage: sleep <milliseconds>\n");
+        return;
+    }
+    sleep_ticks(timer_ms_to_ticks(ms));
+}
+
+void nice_handler(int argc, char** argv) {
+    if (argc < 3) {
+        print_string("Usage: nice <pid> <value> (-20 to 19)\n");
+        return;
+    }
+
+    // Processes are freed under fs_lock when they exit
+    fs_lock();
+    struct process* process = process_get(atoi(argv[1]));
+    bool found = process && process->task;
+    int res = found ? task_set_nice(process->task, atoi(argv[2])) : 0;
+    fs_unlock();
+
+    if (!found) {
+        print_string("nice: No such process: ");
+        print_string(argv[1]);
+        print_string("\n");
+        return;
+    }
+
+    if (res != 0) {
+        print_string("Usage: nice <pid> <value> (-20 to 19)\n");
+    }
+}
+
+// Periodic jobs for edftest, in ticks: runtime, deadline, period
+static const uint32_t edftest_params[][3] = {
+    { 1, 4, 4 },
+    { 2, 6, 8 },
+    { 4, 16, 16 },
+    { 4, 8, 8 },  // Pushes the total past what can be promised
+};
+
+#define EDFTEST_TASKS (sizeof(edftest_params) / sizeof(edftest_params[0]))
+
+struct edftest_result {
+    struct task* task;
+    uint32_t jobs;
+    uint32_t misses;
+};
+
+static struct edftest_result edftest_results[EDFTEST_TASKS];
+static volatile bool edftest_done;
+static volatile int edftest_running;
+static struct wait_queue edftest_exits;
+
+static void edftest_exit() {
+    edftest_running--;
+    wait_wake_all(&edftest_exits);
+}
+
+// Each job spins until its budget is gone, then waits for the next period
+static void edftest_thread() {
+    struct task* self = task_current();
+    while (!edftest_done) {
+        while (self->dl_active && !edftest_done) {
+            task_yield(); // Kernel tasks aren't preempted; offer the CPU
+        }
+        task_wait_period();
+    }
+
+    for (int i = 0; i < EDFTEST_TASKS; i++) {
+        if (edftest_results[i].task == self) {
+            edftest_results[i].jobs = self->dl_jobs;
+            edftest_results[i].misses = self->dl_misses;
+        }
+    }
+    edftest_exit();
+}
+
+// Normal-class load the deadline tasks have to cut through
+static void edftest_hog() {
+    while (!edftest_done) {
+        task_yield();
+    }
+    edftest_exit();
+}
+
+// Run the periodic tasks against a CPU hog for a while and report how
+// many of their jobs finished late
+void edftest_handler(int argc, char** argv) {
+    int seconds = argc > 1 ? atoi(argv[1]) : 5;
+    if (seconds <= 0) {
+        print_string("Usage: edftest [seconds]\n");
+        return;
+    }
+
+    char num[12];
+    edftest_done = false;
+    edftest_running = 0;
+    wait_queue_init(&edftest_exits);
+    memset(edftest_results, 0, sizeof(edftest_results));
+
+    if (task_new_thread(edftest_hog)) edftest_running++;
+
+    for (int i = 0; i < EDFTEST_TASKS; i++) {
+        const uint32_t* params = edftest_params[i];
+        struct task* task = task_new_thread(edftest_thread);
+        if (!task) break;
+
+        if (task_set_deadline(task, params[0], params[1], params[2]) != 0) {
+            // It hasn't run yet, so it can simply go
+            task_free(task);
+            print_string("task ");
+            print_string(itoa(i, num));
+            print_string(": not admitted\n");
+            continue;
+        }
+        edftest_results[i].task = task;
+        edftest_running++;
+    }
+
+    sleep_ticks(seconds * timer_get_frequency());
+
+    edftest_done = true;
+    __asm__ __volatile__("cli");
+    while (edftest_running > 0) {
+        wait_sleep(&edftest_exits);
+    }
+    __asm__ __volatile__("sti");
+
+    for (int i = 0; i < EDFTEST_TASKS; i++) {
+        if (!edftest_results[i].task) continue;
+
+        struct edftest_result* result = &edftest_results[i];
+        print_string("task ");
+        print_string(itoa(i, num));
+        print_string(": runtime ");
+        print_string(itoa(edftest_params[i][0], num));
+        print_string(" deadline ");
+        print_string(itoa(edftest_params[i][1], num));
+        print_string(" period ");
+        print_string(itoa(edftest_params[i][2], num));
+        print_string("  jobs: ");
+        print_string(itoa(result->jobs, num));
+        print_string("  misses: ");
+        print_string(itoa(result->misses, num));
+        print_string("  miss rate: ");
+        print_string(itoa(result->jobs ? result->misses * 100 / result->jobs : 0, num));
+        print_string("%\n");
+    }
+}
+
+#define SWITCHBENCH_ROUNDS 10000
+
+static volatile bool switchbench_done;
+
+// The other half of switchbench: hands the CPU straight back until told
+// to stop
+static void switchbench_thread() {
+    while (!switchbench_done) {
+        task_yield();
+    }
+}
+
+// Ping-pong between the shell and a kernel task. Any user tasks running
+// take their turns too, so the figure is only clean on an idle system.
+void switchbench_handler(int argc, char** argv) {
+    int rounds = argc > 1 ? atoi(argv[1]) : SWITCHBENCH_ROUNDS;
+    if (rounds <= 0) {
+        print_string("Usage: switchbench [rounds]\n");
+        return;
+    }
+
+    switchbench_done = false;
+    if (!task_new_thread(switchbench_thread)) {
+        print_string("switchbench: Failed to create task\n");
+        return;
+    }
+
+    struct task_stats before, after;
+    task_get_stats(&before);
+    uint64_t start = rdtsc();
+    for (int i = 0; i < rounds; i++) {
+        task_yield();
+    }
+    uint64_t cycles = rdtsc() - start;
+    task_get_stats(&after);
+
+    switchbench_done = true;
+    task_yield(); // Let it see the flag and exit
+
+    uint32_t switches = after.switches - before.switches;
+    if (switches == 0) switches = 1;
+
+    uint64_t ns = clocksource_cycles_to_ns(cycles);
+
+    char num[12];
+    print_string("switches: ");
+    print_string(itoa(switches, num));
+    print_string("  us: ");
+    print_string(itoa(clocksource_div(ns, NSEC_PER_USEC), num));
+    print_string("  cycles/switch: ");
+    print_string(itoa(clocksource_div(cycles, switches), num));
+    print_string("  ns/switch: ");
+    print_string(itoa(clocksource_div(ns, switches), num));
+    print_string("\n");
+}
+
+void mount_handler(int argc, char** argv) {
+    char num[12];
+    fs_lock();
+    if (argc > 1) {
+        int res = fs_mount(atoi(argv[1]));
+        fs_unlock();
+        if (res != 0) {
+            print_string("mount: No filesystem found on drive ");
+            print_string(argv[1]);
+            print_string("\n");
+        }
+        return;
+    }
+
+    for (int i = 0; i < MAX_DISKS; i++) {
+        struct filesystem* fs = fs_get_mounted(i);
+        if (!fs) continue;
+        print_string(itoa(i, num));
+        print_string(":/ ");
+        print_string(fs->name);
+        print_string("\n");
+    }
+    fs_unlock();
+}
+
+void umount_handler(int argc, char** argv) {
+    if (argc < 2) {
+        print_string("Usage: umount <drive>\n");
+        return;
+    }
+
+    fs_lock();
+    int res = fs_unmount(atoi(argv[1]));
+    fs_unlock();
+    if (res != 0) {
+        print_string("umount: Failed to unmount drive ");
+        print_string(argv[1]);
+        print_string("\n");
     }
 }
 
@@ -98,18 +659,56 @@ void main() {
     
     idt_init();
     kheap_init();
+    clocksource_init();
+    disk_init();
     fs_init();
     fs_insert_filesystem(fat16_init_vfs());
+    fs_insert_filesystem(tmpfs_init_vfs());
+    fs_insert_filesystem(initramfs_init_vfs());
+    fs_insert_filesystem(procfs_init_vfs());
+
+    // The boot loader leaves the archive in low memory; files are read
+    // from it in place
+    struct disk* initramfs = initramfs_create((const void*)INITRAMFS_ADDRESS, INITRAMFS_MAX_SIZE);
+    if (initramfs) {
+        char num[12];
+        print_string("initramfs on drive ");
+        print_string(itoa(initramfs->id, num));
+        print_string("\n");
+    }
+
+    // Kernel statistics as files, e.g. "cat <drive>:/meminfo"
+    struct disk* procfs = procfs_create();
+    if (procfs) {
+        char num[12];
+        print_string("procfs on drive ");
+        print_string(itoa(procfs->id, num));
+        print_string("\n");
+    }
     
     kernel_chunk = paging_new_4gb(PAGING_IS_WRITEABLE | PAGING_IS_PRESENT | PAGING_ACCESS_FROM_ALL);
     paging_switch(paging_4gb_chunk_get_directory(kernel_chunk));
     enable_paging();
+    mmap_init();
+    syscall_init();
+    fpu_init();
+    task_init_kernel(paging_4gb_chunk_get_directory(kernel_chunk));
     set_idt();
     __asm__ __volatile__("sti");
 
     keyboard_init();
+    timer_init(TIMER_HZ);
     command_init();
 
+    if (pagecache_start_writeback() != 0) {
+        print_string("Failed to start page cache write-back\n");
+    }
+
+    // Mount whatever we can recognise now so the first fopen doesn't probe
+    for (int i = 0; i < MAX_DISKS; i++) {
+        if (disk_get(i)) fs_mount(i);
+    }
+
     // Register basic commands
     extern void help_handler(int argc, char** argv);
     command_register("help", "Display this help message", help_handler);
@@ -119,6 +718,22 @@ void main() {
     command_register("print", "Display text on the screen", print_handler);
     command_register("run", "Execute a binary or ELF file", run_handler);
     command_register("ls", "List directory contents", ls_handler);
+    command_register("cat", "Print the contents of a file", cat_handler);
+    command_register("write", "Write text to a file", write_handler);
+    command_register("rm", "Delete a file", rm_handler);
+    command_register("mkdir", "Create a directory", mkdir_handler);
+    command_register("tmpfs", "Create and mount a RAM filesystem", tmpfs_handler);
+    command_register("sync", "Write cached file data to disk", sync_handler);
+    command_register("mount", "List mounts or mount a drive", mount_handler);
+    command_register("umount", "Unmount a drive", umount_handler);
+    command_register("raid0", "Stripe drives into a RAID-0 volume", raid0_handler);
+    command_register("raidbench", "Compare RAID-0 read throughput", raidbench_handler);
+    command_register("timer", "Show or set the timer tick rate", timer_handler);
+    command_register("uptime", "Show time since boot and the clock source", uptime_handler);
+    command_register("sleep", "Sleep for a number of milliseconds", sleep_handler);
+    command_register("nice", "Set the nice value of a process", nice_handler);
+    command_register("edftest", "Measure deadline misses of periodic tasks", edftest_handler);
+    command_register("switchbench", "Measure task switch latency", switchbench_handler);
 
     char echo_msg[] = "echo VibeKernel is ready.";
     command_run(echo_msg);
@@ -128,6 +743,8 @@ void main() {
     char cmd_buf[128];
     int cmd_idx = 0;
 
+    // Commands take fs_lock around their own filesystem calls, so one that
+    // sleeps or spins doesn't hold up processes' page faults and syscalls
     while(1) {
         print_string("> ");
         cmd_idx = 0;
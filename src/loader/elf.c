@@ -4,6 +4,7 @@
 #include "../string/string.h"
 #include "../task/process.h"
 #include "../memory/paging/paging.h"
+#include "../memory/mmap/mmap.h"
 #include <stddef.h>
 
 bool elf_is_valid_header(Elf32_Ehdr* header) {
@@ -21,10 +22,12 @@ void* elf_get_entry_point(Elf32_Ehdr* header) {
 int elf_load(const char* filename, struct process** process) {
     int res = 0;
     int fd = fopen(filename, "r");
-    if (fd < 0) return -1;
+    if (fd <= 0) return -1;
 
     Elf32_Ehdr header;
-    if (fread(&header, sizeof(Elf32_Ehdr), 1, fd) != 1) {
+    Elf32_Phdr* phdrs = NULL;
+    struct process* proc = NULL;
+    if (pread(fd, &header, sizeof(Elf32_Ehdr), 0) != sizeof(Elf32_Ehdr)) {
         res = -1;
         goto out;
     }
@@ -34,43 +37,75 @@ int elf_load(const char* filename, struct process** process) {
         goto out;
     }
 
-    struct process* proc = NULL;
+    if (header.e_phnum == 0 || header.e_phnum > ELF_MAX_PHNUM) {
+        res = -1;
+        goto out;
+    }
+
     res = process_alloc(&proc);
     if (res < 0) goto out;
 
     strcpy(proc->name, filename);
     proc->paging_chunk = paging_new_4gb(PAGING_IS_PRESENT | PAGING_IS_WRITEABLE);
+    if (!proc->paging_chunk) {
+        res = -1;
+        goto out;
+    }
 
     // Map VGA
     paging_set(proc->paging_chunk->directory_entry, (void*)0xB8000, 0xB8000 | PAGING_IS_PRESENT | PAGING_IS_WRITEABLE | PAGING_ACCESS_FROM_ALL);
 
+    // Read the whole program header table in one go, then each segment
+    // straight from its offset; nothing depends on the file position
+    uint32_t phdrs_size = header.e_phnum * sizeof(Elf32_Phdr);
+    phdrs = kmalloc(phdrs_size);
+    if (!phdrs || pread(fd, phdrs, phdrs_size, header.e_phoff) != (int)phdrs_size) {
+        res = -1;
+        goto out;
+    }
+
     // Load program segments
-    fseek(fd, header.e_phoff, FILE_SEEK_SET);
     for (int i = 0; i < header.e_phnum; i++) {
-        Elf32_Phdr phdr;
-        if (fread(&phdr, sizeof(Elf32_Phdr), 1, fd) != 1) {
+        Elf32_Phdr phdr = phdrs[i];
+
+        if (phdr.p_type != PT_LOAD || phdr.p_memsz == 0) continue;
+
+        // Segments laid out page-for-page as in the file are mapped private
+        // and faulted in on first touch: read-only pages are shared with the
+        // page cache by every process running the program, and only pages
+        // written to (or partly bss) get copies of their own
+        uint32_t delta = phdr.p_vaddr & (PAGING_PAGE_SIZE - 1);
+        if (delta == (phdr.p_offset & (PAGING_PAGE_SIZE - 1)) && phdr.p_filesz <= phdr.p_memsz) {
+            int prot = MMAP_PROT_READ | ((phdr.p_flags & PF_W) ? MMAP_PROT_WRITE : 0);
+            if (mmap_map(proc, phdr.p_vaddr - delta, delta + phdr.p_memsz, prot, MMAP_PRIVATE,
+                         fd, phdr.p_offset - delta, delta + phdr.p_filesz) == 0) {
+                continue;
+            }
+        }
+
+        // Otherwise copy it in whole
+        void* phys_ptr = kmalloc_a(phdr.p_memsz);
+        if (!phys_ptr) {
             res = -1;
             goto out;
         }
+        memset(phys_ptr, 0, phdr.p_memsz);
 
-        if (phdr.p_type == PT_LOAD) {
-            void* phys_ptr = kmalloc_a(phdr.p_memsz);
-            memset(phys_ptr, 0, phdr.p_memsz);
+        if (process_add_segment(proc, phys_ptr) != 0) {
+            kfree(phys_ptr);
+            res = -1;
+            goto out;
+        }
 
-            long current_pos = ftell(fd);
-            fseek(fd, phdr.p_offset, FILE_SEEK_SET);
-            if (fread(phys_ptr, phdr.p_filesz, 1, fd) != 1) {
-                kfree(phys_ptr);
-                res = -1;
-                goto out;
-            }
-            fseek(fd, current_pos, FILE_SEEK_SET);
+        if (pread(fd, phys_ptr, phdr.p_filesz, phdr.p_offset) != (int)phdr.p_filesz) {
+            res = -1;
+            goto out;
+        }
 
-            // Map segment
-            for (int b = 0; b < phdr.p_memsz; b += PAGING_PAGE_SIZE) {
-                uint32_t val = ((uint32_t)phys_ptr + b) | PAGING_IS_PRESENT | PAGING_IS_WRITEABLE | PAGING_ACCESS_FROM_ALL;
-                paging_set(proc->paging_chunk->directory_entry, (void*)((uint32_t)phdr.p_vaddr + b), val);
-            }
+        // Map segment
+        for (int b = 0; b < phdr.p_memsz; b += PAGING_PAGE_SIZE) {
+            uint32_t val = ((uint32_t)phys_ptr + b) | PAGING_IS_PRESENT | PAGING_IS_WRITEABLE | PAGING_ACCESS_FROM_ALL;
+            paging_set(proc->paging_chunk->directory_entry, (void*)((uint32_t)phdr.p_vaddr + b), val);
         }
     }
 
@@ -78,6 +113,10 @@ int elf_load(const char* filename, struct process** process) {
     *process = proc;
 
 out:
+    if (phdrs) kfree(phdrs);
     fclose(fd);
+
+    // Mapped segments hold the file open; dropping them releases it
+    if (res < 0 && proc) process_free(proc);
     return res;
 }
@@ -37,6 +37,15 @@ typedef struct {
 #define PT_SHLIB   5
 #define PT_PHDR    6
 
+// Segment permissions
+#define PF_X 0x1
+#define PF_W 0x2
+#define PF_R 0x4
+
+// Most program headers a loadable file may have; the table is read into
+// kernel memory whole
+#define ELF_MAX_PHNUM 64
+
 typedef struct {
     Elf32_Word p_type;
     Elf32_Off  p_offset;
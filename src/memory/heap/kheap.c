@@ -5,6 +5,7 @@ extern uint32_t end; // Defined in linker.ld
 uint32_t placement_address = (uint32_t)&end;
 
 #define HEAP_SIZE 1024 * 1024 * 4 // 4MB Heap (Enough for Paging Structures)
+#define HEAP_START 0x100000 // Above the kernel image, its stack and the BIOS area
 
 typedef struct block_meta {
     size_t size;
@@ -20,7 +21,11 @@ block_meta_t *find_free_block(block_meta_t **last, size_t size);
 
 void kheap_init() {
     print_string("Initializing Heap...\n");
-    // placement_address is already set to &end
+    // The kernel image now reaches far enough that a heap starting at &end
+    // would run into the boot stack at 0x80000, so start above 1MB instead
+    if (placement_address < HEAP_START) {
+        placement_address = HEAP_START;
+    }
 }
 
 // Internal function to handle allocation logic
@@ -130,3 +135,23 @@ void kfree(void *ptr) {
     if (block->magic != 0x12345678 && block->magic != 0x77777777) return;
     block->free = 1;
 }
+
+// Walk the block list; nothing is counted as allocations happen
+void kheap_get_stats(struct kheap_stats* stats) {
+    stats->start = HEAP_START;
+    stats->end = placement_address;
+    stats->used_bytes = 0;
+    stats->used_blocks = 0;
+    stats->free_bytes = 0;
+    stats->free_blocks = 0;
+
+    for (block_meta_t *block = global_base; block; block = block->next) {
+        if (block->free) {
+            stats->free_bytes += block->size;
+            stats->free_blocks++;
+        } else {
+            stats->used_bytes += block->size;
+            stats->used_blocks++;
+        }
+    }
+}
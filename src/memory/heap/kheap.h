@@ -12,4 +12,15 @@ void *kmalloc_p(uint32_t size, uint32_t *phys);
 void *kmalloc_ap(uint32_t size, uint32_t *phys);
 void kfree(void *ptr);
 
+struct kheap_stats {
+    uint32_t start;
+    uint32_t end; // Next address the heap grows into
+    uint32_t used_bytes;
+    uint32_t used_blocks;
+    uint32_t free_bytes;
+    uint32_t free_blocks;
+};
+
+void kheap_get_stats(struct kheap_stats* stats);
+
 #endif
@@ -0,0 +1,288 @@
+#include "mmap.h"
+#include "../heap/kheap.h"
+#include "../paging/paging.h"
+#include "../../cpu/isr.h"
+#include "../../task/process.h"
+#include "../../task/syscall.h"
+#include "../../string/string.h"
+#include <stddef.h>
+
+#define MMAP_PAGE_SIZE PAGING_PAGE_SIZE
+#define MMAP_PAGE_MASK (MMAP_PAGE_SIZE - 1)
+
+// Page fault error code bits
+#define MMAP_FAULT_PRESENT 0x01
+#define MMAP_FAULT_WRITE 0x02
+
+static uint32_t* mmap_directory(struct process* process) {
+    return paging_4gb_chunk_get_directory(process->paging_chunk);
+}
+
+static struct mmap_region* mmap_find(struct process* process, uint32_t addr) {
+    for (struct mmap_region* region = process->mappings; region; region = region->next) {
+        if (addr >= region->start && addr < region->end) return region;
+    }
+    return NULL;
+}
+
+static bool mmap_overlaps(struct process* process, uint32_t start, uint32_t end) {
+    for (struct mmap_region* region = process->mappings; region; region = region->next) {
+        if (start < region->end && region->start < end) return true;
+    }
+    return false;
+}
+
+int mmap_map(struct process* process, uint32_t addr, uint32_t length, int prot, int flags, int fd, uint32_t offset, uint32_t file_size) {
+    if (!process || !process->paging_chunk) return -1;
+    if ((addr & MMAP_PAGE_MASK) || (offset & MMAP_PAGE_MASK) || length == 0) return -1;
+    if (flags != MMAP_SHARED && flags != MMAP_PRIVATE) return -1;
+
+    // Shared mappings would need their writes carried back to the file
+    if (flags == MMAP_SHARED && (prot & MMAP_PROT_WRITE)) return -1;
+
+    uint32_t end = addr + ((length + MMAP_PAGE_MASK) & ~MMAP_PAGE_MASK);
+    if (end <= addr || mmap_overlaps(process, addr, end)) return -1;
+    if (file_size > length) file_size = length;
+
+    int res = 0;
+    struct mmap_region* region = kmalloc(sizeof(struct mmap_region));
+    if (!region) {
+        res = -2;
+        goto out;
+    }
+    memset(region, 0, sizeof(struct mmap_region));
+
+    uint32_t pages = (end - addr) / MMAP_PAGE_SIZE;
+    region->pages = kmalloc(pages * sizeof(struct mmap_page));
+    if (!region->pages) {
+        res = -2;
+        goto out;
+    }
+    memset(region->pages, 0, pages * sizeof(struct mmap_page));
+
+    region->file = fs_hold(fd);
+    if (!region->file) {
+        res = -3;
+        goto out;
+    }
+
+    region->start = addr;
+    region->end = end;
+    region->prot = prot;
+    region->flags = flags;
+    region->offset = offset;
+    region->file_size = file_size;
+
+    // Nothing is read until it is touched; leave the range unmapped so the
+    // first access faults, whatever the directory had there before
+    uint32_t* directory = mmap_directory(process);
+    for (uint32_t page = addr; page < end; page += MMAP_PAGE_SIZE) {
+        paging_set(directory, (void*)page, 0);
+    }
+    paging_flush(directory);
+
+    region->next = process->mappings;
+    process->mappings = region;
+
+out:
+    if (res < 0 && region) {
+        if (region->pages) kfree(region->pages);
+        kfree(region);
+    }
+    return res;
+}
+
+static void mmap_free_region(struct process* process, struct mmap_region* region) {
+    uint32_t* directory = mmap_directory(process);
+    uint32_t pages = (region->end - region->start) / MMAP_PAGE_SIZE;
+
+    for (uint32_t i = 0; i < pages; i++) {
+        if (region->pages[i].data) paging_set(directory, (void*)(region->start + i * MMAP_PAGE_SIZE), 0);
+    }
+
+    // No stale translation may reach a page once it is back on the heap
+    paging_flush(directory);
+
+    for (uint32_t i = 0; i < pages; i++) {
+        struct mmap_page* page = &region->pages[i];
+        if (!page->data) continue;
+
+        if (page->private) {
+            kfree(page->data);
+        } else {
+            fs_unmap_page(page->pin);
+        }
+    }
+
+    fs_put(region->file);
+    kfree(region->pages);
+    kfree(region);
+}
+
+int mmap_unmap(struct process* process, uint32_t addr) {
+    struct mmap_region** link = &process->mappings;
+    while (*link && (*link)->start != addr) {
+        link = &(*link)->next;
+    }
+
+    struct mmap_region* region = *link;
+    if (!region) return -1;
+
+    *link = region->next;
+    mmap_free_region(process, region);
+    return 0;
+}
+
+void mmap_unmap_all(struct process* process) {
+    while (process->mappings) {
+        struct mmap_region* region = process->mappings;
+        process->mappings = region->next;
+        mmap_free_region(process, region);
+    }
+}
+
+// Give page `index` of the region its first contents. Whole pages of the
+// file are shared with the page cache (or wherever the filesystem keeps
+// them) unless they are about to be written; the tail page and anything
+// past it get a zero-filled private copy.
+static int mmap_fill(struct mmap_region* region, uint32_t index, bool write) {
+    struct mmap_page* page = &region->pages[index];
+    uint32_t file_offset = index * MMAP_PAGE_SIZE;
+    bool whole = region->file_size >= MMAP_PAGE_SIZE && file_offset <= region->file_size - MMAP_PAGE_SIZE;
+
+    if (whole && !write) {
+        void* pin;
+        char* data = fs_map_page(region->file, (region->offset + file_offset) / MMAP_PAGE_SIZE, &pin);
+        if (data) {
+            page->data = data;
+            page->pin = pin;
+            page->private = false;
+            return 0;
+        }
+    }
+
+    char* data = kmalloc_a(MMAP_PAGE_SIZE);
+    if (!data) return -1;
+    memset(data, 0, MMAP_PAGE_SIZE);
+
+    if (file_offset < region->file_size) {
+        uint32_t count = region->file_size - file_offset;
+        if (count > MMAP_PAGE_SIZE) count = MMAP_PAGE_SIZE;
+        if (fs_pread_file(region->file, data, count, region->offset + file_offset) < 0) {
+            kfree(data);
+            return -1;
+        }
+    }
+
+    page->data = data;
+    page->pin = NULL;
+    page->private = true;
+    return 0;
+}
+
+// Break the sharing of a page the mapping is writing to
+static int mmap_copy_on_write(struct mmap_page* page) {
+    char* data = kmalloc_a(MMAP_PAGE_SIZE);
+    if (!data) return -1;
+    memcpy(data, page->data, MMAP_PAGE_SIZE);
+
+    fs_unmap_page(page->pin);
+    page->data = data;
+    page->pin = NULL;
+    page->private = true;
+    return 0;
+}
+
+static int mmap_handle_fault(struct process* process, uint32_t addr, uint32_t error) {
+    struct mmap_region* region = mmap_find(process, addr);
+    if (!region) return -1;
+
+    bool write = error & MMAP_FAULT_WRITE;
+    if (write && !(region->prot & MMAP_PROT_WRITE)) return -1;
+
+    uint32_t page_addr = addr & ~MMAP_PAGE_MASK;
+    uint32_t index = (page_addr - region->start) / MMAP_PAGE_SIZE;
+    struct mmap_page* page = &region->pages[index];
+
+    if (!page->data) {
+        if (mmap_fill(region, index, write) < 0) return -1;
+    } else if (write && !page->private) {
+        if (mmap_copy_on_write(page) < 0) return -1;
+    }
+
+    // Shared pages stay read-only so the first write to them comes back here
+    uint32_t val = (uint32_t)page->data | PAGING_IS_PRESENT | PAGING_ACCESS_FROM_ALL;
+    if (page->private && (region->prot & MMAP_PROT_WRITE)) {
+        val |= PAGING_IS_WRITEABLE;
+    }
+    return paging_set(mmap_directory(process), (void*)page_addr, val);
+}
+
+// Bring in the page under `addr` ahead of a kernel access to it, as the
+// process touching it would. Call with fs_lock held.
+int mmap_fault_in(struct process* process, uint32_t addr, bool write) {
+    return mmap_handle_fault(process, addr, write ? MMAP_FAULT_WRITE : 0);
+}
+
+static void mmap_page_fault(registers_t* regs) {
+    uint32_t addr;
+    __asm__ __volatile__("mov %%cr2, %0" : "=r" (addr));
+
+    // The kernel faults in what it touches up front, so a fault in kernel
+    // mode is a bug; report it before taking a lock its holder may have
+    if ((regs->cs & 3) == 0) {
+        isr_fatal(regs);
+        return;
+    }
+
+    // Filling a page may read the file, and so sleep
+    fs_lock();
+    struct process* process = process_current();
+    int res = process && process->paging_chunk ? mmap_handle_fault(process, addr, regs->err_code) : -1;
+    fs_unlock();
+
+    // A bad access only ends the process that made it
+    if (res < 0) syscall_kill(regs);
+}
+
+void mmap_init() {
+    register_interrupt_handler(14, mmap_page_fault);
+}
+
+void* mmap(void* addr, uint32_t length, int prot, int flags, int fd, uint32_t offset) {
+    struct process* process = process_current();
+    if (!process || length == 0 || length > MMAP_LIMIT - MMAP_BASE) return NULL;
+
+    struct file_stat stat;
+    if (fstat(fd, &stat) != 0) return NULL;
+
+    uint32_t file_size = offset < stat.filesize ? stat.filesize - offset : 0;
+    uint32_t start = (uint32_t)addr;
+    uint32_t size = (length + MMAP_PAGE_MASK) & ~MMAP_PAGE_MASK;
+
+    // Without a hint, take fresh address space; it is never handed out twice
+    if (!start) {
+        if (process->mmap_next < MMAP_BASE) process->mmap_next = MMAP_BASE;
+        start = process->mmap_next;
+    }
+    if (start < MMAP_BASE || start > MMAP_LIMIT - size) return NULL;
+
+    if (mmap_map(process, start, length, prot, flags, fd, offset, file_size) < 0) return NULL;
+
+    if (start + size > process->mmap_next) {
+        process->mmap_next = start + size;
+    }
+    return (void*)start;
+}
+
+// Mappings are removed whole
+int munmap(void* addr, uint32_t length) {
+    struct process* process = process_current();
+    if (!process) return -1;
+
+    struct mmap_region* region = mmap_find(process, (uint32_t)addr);
+    if (!region || region->start != (uint32_t)addr) return -1;
+    if (((length + MMAP_PAGE_MASK) & ~MMAP_PAGE_MASK) != region->end - region->start) return -1;
+
+    return mmap_unmap(process, (uint32_t)addr);
+}
@@ -0,0 +1,58 @@
+#ifndef MMAP_H
+#define MMAP_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "../../fs/file.h"
+
+// Where mmap places mappings when the caller doesn't ask for an address
+#define MMAP_BASE 0x10000000
+#define MMAP_LIMIT 0x40000000
+
+#define MMAP_PROT_READ 0x01
+#define MMAP_PROT_WRITE 0x02
+
+// Shared mappings see the file as it is (read-only here); private ones
+// start from the file and copy a page on the first write to it
+#define MMAP_SHARED 0x01
+#define MMAP_PRIVATE 0x02
+
+struct process;
+
+// One page of a mapping, filled in on first touch
+struct mmap_page {
+    char* data;
+    void* pin;    // Page cache pin when data is shared with the file
+    bool private; // data belongs to this mapping alone
+};
+
+struct mmap_region {
+    uint32_t start;
+    uint32_t end;
+    int prot;
+    int flags;
+
+    // Bytes [offset, offset + file_size) of the file back the start of the
+    // region; the rest of it reads as zeros
+    struct file_descriptor* file;
+    uint32_t offset;
+    uint32_t file_size;
+
+    struct mmap_page* pages;
+    struct mmap_region* next;
+};
+
+void mmap_init();
+
+// Kernel interface: map `file_size` bytes of `fd` from `offset` (page aligned)
+// at `addr` in `process`, padded with zeros up to `length`
+int mmap_map(struct process* process, uint32_t addr, uint32_t length, int prot, int flags, int fd, uint32_t offset, uint32_t file_size);
+int mmap_unmap(struct process* process, uint32_t addr);
+void mmap_unmap_all(struct process* process);
+int mmap_fault_in(struct process* process, uint32_t addr, bool write);
+
+// The same for the current process, sized from the file
+void* mmap(void* addr, uint32_t length, int prot, int flags, int fd, uint32_t offset);
+int munmap(void* addr, uint32_t length);
+
+#endif
@@ -36,6 +36,24 @@ struct paging_4gb_chunk* paging_new_4gb(uint8_t flags)
     return chunk_4gb;
 }
 
+// Free the directory and every page table in it, but not the pages they
+// map. It must not be the one loaded.
+void paging_free_4gb(struct paging_4gb_chunk* chunk)
+{
+    uint32_t* directory = chunk->directory_entry;
+    for (int i = 0; i < PAGING_TOTAL_ENTRIES_PER_TABLE_SIZE; i++)
+    {
+        uint32_t* table = (uint32_t*)(directory[i] & 0xFFFFF000);
+        if (table)
+        {
+            kfree(table);
+        }
+    }
+
+    kfree(directory);
+    kfree(chunk);
+}
+
 void paging_switch(uint32_t* directory)
 {
     paging_load_directory(directory);
@@ -70,6 +88,16 @@ void paging_flush_tlb_single(uint32_t addr)
     __asm__ __volatile__("invlpg (%0)" :: "r" (addr) : "memory");
 }
 
+// Drop every cached translation of `directory` if it is the one loaded.
+// Any other directory has nothing cached: loading it flushes the TLB.
+void paging_flush(uint32_t* directory)
+{
+    if (directory == current_directory)
+    {
+        paging_load_directory(directory);
+    }
+}
+
 int paging_set(uint32_t* directory, void* virt, uint32_t val)
 {
     if (!paging_is_aligned(virt))
@@ -104,3 +132,18 @@ int paging_set(uint32_t* directory, void* virt, uint32_t val)
 
     return 0;
 }
+
+// Page table entry for `virt`, 0 if it has no table
+uint32_t paging_get(uint32_t* directory, void* virt)
+{
+    uint32_t directory_index = ((uint32_t)virt) >> 22;
+    uint32_t table_index = (((uint32_t)virt) >> 12) & 0x3FF;
+
+    uint32_t* table = (uint32_t*)(directory[directory_index] & 0xFFFFF000);
+    if (!table)
+    {
+        return 0;
+    }
+
+    return table[table_index];
+}
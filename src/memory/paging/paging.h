@@ -25,6 +25,8 @@ uint32_t* paging_4gb_chunk_get_directory(struct paging_4gb_chunk* chunk);
 void paging_free_4gb(struct paging_4gb_chunk* chunk);
 
 int paging_set(uint32_t* directory, void* virt, uint32_t val);
+uint32_t paging_get(uint32_t* directory, void* virt);
+void paging_flush(uint32_t* directory);
 int paging_is_aligned(void* addr);
 
 #endif
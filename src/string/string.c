@@ -100,6 +100,22 @@ void* memcpy(void* dest, const void* src, size_t n)
     return dest;
 }
 
+int memcmp(const void* s1, const void* s2, size_t n)
+{
+    const unsigned char* a = s1;
+    const unsigned char* b = s2;
+    while (n--)
+    {
+        if (*a != *b)
+        {
+            return *a - *b;
+        }
+        a++;
+        b++;
+    }
+    return 0;
+}
+
 char* strcpy(char* dest, const char* src) {
     char* d = dest;
     while ((*d++ = *src++));
@@ -113,3 +129,34 @@ int strcmp(const char* str1, const char* str2) {
     }
     return *(const unsigned char*)str1 - *(const unsigned char*)str2;
 }
+
+int atoi(const char* str) {
+    int res = 0;
+    int sign = 1;
+    if (*str == '-') {
+        sign = -1;
+        str++;
+    }
+    while (isdigit(*str)) {
+        res = res * 10 + (*str - '0');
+        str++;
+    }
+    return res * sign;
+}
+
+char* itoa(int value, char* out) {
+    char tmp[12];
+    int i = 0;
+    uint32_t v = value < 0 ? -(uint32_t)value : (uint32_t)value;
+
+    do {
+        tmp[i++] = '0' + (v % 10);
+        v /= 10;
+    } while (v);
+
+    char* p = out;
+    if (value < 0) *p++ = '-';
+    while (i > 0) *p++ = tmp[--i];
+    *p = '\0';
+    return out;
+}
@@ -3,6 +3,7 @@
 
 #include <stddef.h>
 #include <stdbool.h>
+#include <stdint.h>
 
 size_t strlen(const char* str);
 char* strncpy(char* dest, const char* src, size_t n);
@@ -14,8 +15,11 @@ int tolower(int c);
 int toupper(int c);
 int strncasecmp(const char *s1, const char *s2, size_t n);
 void* memcpy(void* dest, const void* src, size_t n);
+int memcmp(const void* s1, const void* s2, size_t n);
 
 char* strcpy(char* dest, const char* src);
 int strcmp(const char* str1, const char* str2);
+int atoi(const char* str);
+char* itoa(int value, char* out);
 
 #endif
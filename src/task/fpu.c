@@ -0,0 +1,146 @@
+#include "fpu.h"
+#include "task.h"
+#include "syscall.h"
+#include "../cpu/cpu.h"
+#include "../cpu/isr.h"
+#include "../memory/heap/kheap.h"
+#include "../string/string.h"
+#include <stddef.h>
+
+#define FPU_CR0_MP 0x02 // WAIT traps along with the FPU instructions
+#define FPU_CR0_EM 0x04 // No FPU; every FPU instruction traps
+#define FPU_CR0_TS 0x08 // The next FPU instruction raises #NM
+#define FPU_CR0_NE 0x20 // FPU errors raise #MF rather than IRQ 13
+#define FPU_CR4_OSFXSR 0x200     // FXSAVE/FXRSTOR and SSE are usable
+#define FPU_CR4_OSXMMEXCPT 0x400 // SSE errors raise #XM
+
+#define FPU_DEVICE_NOT_AVAILABLE 7
+#define FPU_MATH_FAULT 16 // #MF, x87
+#define FPU_SIMD_FAULT 19 // #XM, SSE
+
+// Whose registers are in the FPU, NULL if they belong to nobody
+static struct task* fpu_owner = NULL;
+
+static bool fpu_present = false;
+static bool fpu_fxsr = false;
+
+// What a task starts from the first time it uses the FPU
+static uint8_t fpu_initial_state[FPU_STATE_SIZE] __attribute__((aligned(FPU_STATE_ALIGN)));
+
+static inline uint32_t fpu_read_cr0() {
+    uint32_t cr0;
+    __asm__ __volatile__("mov %%cr0, %0" : "=r"(cr0));
+    return cr0;
+}
+
+static inline void fpu_write_cr0(uint32_t cr0) {
+    __asm__ __volatile__("mov %0, %%cr0" : : "r"(cr0) : "memory");
+}
+
+static inline uint32_t fpu_read_cr4() {
+    uint32_t cr4;
+    __asm__ __volatile__("mov %%cr4, %0" : "=r"(cr4));
+    return cr4;
+}
+
+static inline void fpu_write_cr4(uint32_t cr4) {
+    __asm__ __volatile__("mov %0, %%cr4" : : "r"(cr4) : "memory");
+}
+
+// fpu_area is allocated unaligned, with room to align it
+static inline void* fpu_state(struct task* task) {
+    return (void*)(((uint32_t)task->fpu_area + FPU_STATE_ALIGN - 1) & ~(FPU_STATE_ALIGN - 1));
+}
+
+static void fpu_save(void* state) {
+    if (fpu_fxsr) {
+        __asm__ __volatile__("fxsave (%0)" : : "r"(state) : "memory");
+    } else {
+        __asm__ __volatile__("fnsave (%0)" : : "r"(state) : "memory");
+    }
+}
+
+static void fpu_restore(void* state) {
+    if (fpu_fxsr) {
+        __asm__ __volatile__("fxrstor (%0)" : : "r"(state) : "memory");
+    } else {
+        __asm__ __volatile__("frstor (%0)" : : "r"(state) : "memory");
+    }
+}
+
+// #NM: the running task reached for the FPU while TS was set
+static void fpu_device_not_available(registers_t* regs) {
+    struct task* task = task_current();
+    __asm__ __volatile__("clts");
+    if (!task || task == fpu_owner) return;
+
+    if (!task->fpu_area) {
+        task->fpu_area = kmalloc(FPU_STATE_SIZE + FPU_STATE_ALIGN - 1);
+        if (!task->fpu_area) {
+            isr_fatal(regs);
+            return;
+        }
+        memcpy(fpu_state(task), fpu_initial_state, FPU_STATE_SIZE);
+    }
+
+    if (fpu_owner) fpu_save(fpu_state(fpu_owner));
+    fpu_restore(fpu_state(task));
+    fpu_owner = task;
+}
+
+// #MF and #XM: an FPU or SSE exception the task unmasked. The kernel
+// doesn't use the FPU, so it ends the task that did.
+static void fpu_error(registers_t* regs) {
+    if ((regs->cs & 3) == 0) {
+        isr_fatal(regs);
+        return;
+    }
+
+    // Its state goes with it; nothing pending may fire in the next owner
+    __asm__ __volatile__("fnclex");
+    syscall_kill(regs);
+}
+
+void fpu_init() {
+    uint32_t features = cpu_features();
+    if (!(features & CPU_FEATURE_FPU)) return;
+    fpu_present = true;
+    fpu_fxsr = features & CPU_FEATURE_FXSR;
+
+    uint32_t cr0 = (fpu_read_cr0() & ~(FPU_CR0_EM | FPU_CR0_TS)) | FPU_CR0_MP | FPU_CR0_NE;
+    fpu_write_cr0(cr0);
+    if (fpu_fxsr) {
+        uint32_t cr4 = fpu_read_cr4() | FPU_CR4_OSFXSR;
+        if (features & CPU_FEATURE_SSE) cr4 |= FPU_CR4_OSXMMEXCPT;
+        fpu_write_cr4(cr4);
+    }
+
+    // Keep a clean image for new tasks, then leave the FPU to them. The
+    // kernel itself is built not to use it.
+    __asm__ __volatile__("fninit");
+    fpu_save(fpu_initial_state);
+    register_interrupt_handler(FPU_DEVICE_NOT_AVAILABLE, fpu_device_not_available);
+    register_interrupt_handler(FPU_MATH_FAULT, fpu_error);
+    register_interrupt_handler(FPU_SIMD_FAULT, fpu_error);
+    fpu_write_cr0(cr0 | FPU_CR0_TS);
+}
+
+// Only the task whose registers are loaded may use the FPU without a trap
+void fpu_switch(struct task* task) {
+    if (!fpu_present) return;
+
+    uint32_t cr0 = fpu_read_cr0();
+    if (task == fpu_owner) {
+        if (cr0 & FPU_CR0_TS) __asm__ __volatile__("clts");
+    } else if (!(cr0 & FPU_CR0_TS)) {
+        fpu_write_cr0(cr0 | FPU_CR0_TS);
+    }
+}
+
+void fpu_release(struct task* task) {
+    if (task == fpu_owner) fpu_owner = NULL;
+    if (task->fpu_area) {
+        kfree(task->fpu_area);
+        task->fpu_area = NULL;
+    }
+}
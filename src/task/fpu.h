@@ -0,0 +1,20 @@
+#ifndef FPU_H
+#define FPU_H
+
+#include <stdint.h>
+
+// Room for an FXSAVE image, which wants 16 byte alignment; FNSAVE, on
+// CPUs without it, needs less
+#define FPU_STATE_SIZE 512
+#define FPU_STATE_ALIGN 16
+
+struct task;
+
+// The FPU is handed over lazily: a task switch only sets CR0.TS, and the
+// first FPU or SSE instruction after it traps (#NM) to save the previous
+// owner's registers and load the new one's
+void fpu_init();
+void fpu_switch(struct task* task);
+void fpu_release(struct task* task);
+
+#endif
@@ -0,0 +1,114 @@
+#include "lock.h"
+#include "task.h"
+#include <stddef.h>
+
+static inline uint32_t lock_save_flags() {
+    uint32_t flags;
+    __asm__ __volatile__("pushf; pop %0; cli" : "=r"(flags) : : "memory");
+    return flags;
+}
+
+static inline void lock_restore_flags(uint32_t flags) {
+    __asm__ __volatile__("push %0; popf" : : "r"(flags) : "memory", "cc");
+}
+
+static inline uint32_t lock_xchg(volatile uint32_t* addr, uint32_t value) {
+    __asm__ __volatile__("xchg %0, %1" : "+r"(value), "+m"(*addr) : : "memory");
+    return value;
+}
+
+void spinlock_init(struct spinlock* lock) {
+    lock->locked = 0;
+    lock->flags = 0;
+}
+
+void spin_lock(struct spinlock* lock) {
+    uint32_t flags = lock_save_flags();
+    while (lock_xchg(&lock->locked, 1) != 0) {
+        __asm__ __volatile__("pause");
+    }
+    lock->flags = flags;
+}
+
+void spin_unlock(struct spinlock* lock) {
+    uint32_t flags = lock->flags;
+    lock_xchg(&lock->locked, 0);
+    lock_restore_flags(flags);
+}
+
+void rwlock_init(struct rwlock* lock) {
+    spinlock_init(&lock->guard);
+    lock->readers = 0;
+    lock->writers_waiting = 0;
+    lock->writer = false;
+    wait_queue_init(&lock->wait);
+}
+
+// Waiters sleep with the guard dropped but interrupts still off, so the
+// release that would wake them can't get in before they are queued
+void rwlock_read_lock(struct rwlock* lock) {
+    uint32_t flags = lock_save_flags();
+    spin_lock(&lock->guard);
+    while (lock->writer || lock->writers_waiting > 0) {
+        spin_unlock(&lock->guard);
+        wait_sleep(&lock->wait);
+        spin_lock(&lock->guard);
+    }
+    lock->readers++;
+    spin_unlock(&lock->guard);
+    lock_restore_flags(flags);
+}
+
+void rwlock_read_unlock(struct rwlock* lock) {
+    spin_lock(&lock->guard);
+    if (--lock->readers == 0) wait_wake_all(&lock->wait);
+    spin_unlock(&lock->guard);
+}
+
+void rwlock_write_lock(struct rwlock* lock) {
+    uint32_t flags = lock_save_flags();
+    spin_lock(&lock->guard);
+    lock->writers_waiting++;
+    while (lock->writer || lock->readers > 0) {
+        spin_unlock(&lock->guard);
+        wait_sleep(&lock->wait);
+        spin_lock(&lock->guard);
+    }
+    lock->writers_waiting--;
+    lock->writer = true;
+    spin_unlock(&lock->guard);
+    lock_restore_flags(flags);
+}
+
+void rwlock_write_unlock(struct rwlock* lock) {
+    spin_lock(&lock->guard);
+    lock->writer = false;
+    wait_wake_all(&lock->wait);
+    spin_unlock(&lock->guard);
+}
+
+void mutex_init(struct mutex* lock) {
+    lock->owner = NULL;
+    lock->depth = 0;
+    wait_queue_init(&lock->wait);
+}
+
+void mutex_lock(struct mutex* lock) {
+    uint32_t flags = lock_save_flags();
+    struct task* self = task_current();
+    while (lock->depth > 0 && lock->owner != self) {
+        wait_sleep(&lock->wait);
+    }
+    lock->owner = self;
+    lock->depth++;
+    lock_restore_flags(flags);
+}
+
+void mutex_unlock(struct mutex* lock) {
+    uint32_t flags = lock_save_flags();
+    if (--lock->depth == 0) {
+        lock->owner = NULL;
+        wait_wake_one(&lock->wait);
+    }
+    lock_restore_flags(flags);
+}
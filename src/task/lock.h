@@ -0,0 +1,46 @@
+#ifndef LOCK_H
+#define LOCK_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "wait.h"
+
+// Short critical sections. Interrupts stay off while it is held, so the
+// holder can't be preempted or interrupted into taking it again.
+struct spinlock {
+    volatile uint32_t locked;
+    uint32_t flags; // EFLAGS of the holder before it took the lock
+};
+
+// Shared/exclusive lock for longer sections that may do I/O. A waiting
+// writer holds off new readers so a stream of them can't starve it.
+struct rwlock {
+    struct spinlock guard;
+    int readers;
+    int writers_waiting;
+    bool writer;
+    struct wait_queue wait;
+};
+
+// Sleeping lock for sections that may block. The holder may take it again.
+struct mutex {
+    struct task* owner;
+    int depth;
+    struct wait_queue wait;
+};
+
+void spinlock_init(struct spinlock* lock);
+void spin_lock(struct spinlock* lock);
+void spin_unlock(struct spinlock* lock);
+
+void rwlock_init(struct rwlock* lock);
+void rwlock_read_lock(struct rwlock* lock);
+void rwlock_read_unlock(struct rwlock* lock);
+void rwlock_write_lock(struct rwlock* lock);
+void rwlock_write_unlock(struct rwlock* lock);
+
+void mutex_init(struct mutex* lock);
+void mutex_lock(struct mutex* lock);
+void mutex_unlock(struct mutex* lock);
+
+#endif
@@ -22,6 +22,7 @@ int process_alloc(struct process** process) {
 
     memset(proc, 0, sizeof(struct process));
     proc->id = process_get_free_slot();
+    file_table_init(&proc->files);
 
     if (!process_head) {
         process_head = proc;
@@ -47,11 +48,12 @@ int process_load(const char* filename, struct process** process) {
     if (fd < 0) return -1;
 
     uint32_t magic = 0;
-    if (fread(&magic, 4, 1, fd) != 1) {
+    if (pread(fd, &magic, 4, 0) != 4) {
         fclose(fd);
         return -1;
     }
     fclose(fd);
+    fd = 0;
 
     if (magic == 0x464C457F) { // .ELF in little endian
         return elf_load(filename, process);
@@ -65,7 +67,7 @@ int process_load(const char* filename, struct process** process) {
     strcpy(proc->name, filename);
     
     fd = fopen(filename, "r");
-    if (fd < 0) {
+    if (fd <= 0) {
         res = -1;
         goto out;
     }
@@ -82,14 +84,13 @@ int process_load(const char* filename, struct process** process) {
         res = -1;
         goto out;
     }
+    process_add_segment(proc, proc->ptr);
 
     if (fread(proc->ptr, proc->size, 1, fd) != 1) {
         res = -1;
         goto out;
     }
 
-    fclose(fd);
-
     // Initial paging setup for process
     proc->paging_chunk = paging_new_4gb(PAGING_IS_PRESENT | PAGING_IS_WRITEABLE);
     if (!proc->paging_chunk) {
@@ -108,11 +109,33 @@ int process_load(const char* filename, struct process** process) {
     *process = proc;
 
 out:
+    if (fd > 0) fclose(fd);
+    if (res < 0 && proc) process_free(proc);
     return res;
 }
 
 void process_free(struct process* process) {
-    // Basic cleanup logic (to be expanded with paging and task cleanup)
+    // Descriptors are looked up in the current process, so make sure
+    // nothing resolves in this table once it is gone
+    file_table_close_all(&process->files);
+    if (process->paging_chunk) {
+        mmap_unmap_all(process);
+    }
+    if (process == current_process) {
+        process_switch(NULL);
+    }
+
+    // An exiting task is still running on the directory
+    if (process->task) {
+        task_drop_directory(process->task);
+    }
+    if (process->paging_chunk) {
+        paging_free_4gb(process->paging_chunk);
+    }
+    for (int i = 0; i < process->segment_count; i++) {
+        kfree(process->segments[i]);
+    }
+
     if (process == process_head) {
         process_head = process->next;
     } else {
@@ -130,6 +153,13 @@ void process_free(struct process* process) {
     kfree(process);
 }
 
+// Remember kernel memory holding part of the program, freed with it
+int process_add_segment(struct process* process, void* segment) {
+    if (process->segment_count == PROCESS_MAX_SEGMENTS) return -1;
+    process->segments[process->segment_count++] = segment;
+    return 0;
+}
+
 struct process* process_get(int process_id) {
     struct process* proc = process_head;
     while (proc) {
@@ -139,11 +169,17 @@ struct process* process_get(int process_id) {
     return NULL;
 }
 
+// Head of the list of all processes, linked through next
+struct process* process_first() {
+    return process_head;
+}
+
 struct process* process_current() {
     return current_process;
 }
 
 int process_switch(struct process* process) {
     current_process = process;
+    fs_set_file_table(process ? &process->files : NULL);
     return 0;
 }
@@ -3,25 +3,34 @@
 
 #include <stdint.h>
 #include "task.h"
+#include "../fs/file.h"
+#include "../memory/mmap/mmap.h"
 
-#define MAX_PROCESS_FILES 10
+// Kernel allocations a process's image may be copied into
+#define PROCESS_MAX_SEGMENTS 16
 
 struct process {
     uint16_t id;
     char name[32];
     struct task* task;
-    void* file_descriptors[MAX_PROCESS_FILES];
+    struct file_table files;
     struct paging_4gb_chunk* paging_chunk;
+    struct mmap_region* mappings;
+    uint32_t mmap_next; // Where the next unhinted mmap goes
     void* ptr;
     uint32_t size;
+    void* segments[PROCESS_MAX_SEGMENTS];
+    int segment_count;
     struct process* next;
 };
 
 int process_alloc(struct process** process);
 int process_load(const char* filename, struct process** process);
 void process_free(struct process* process);
+int process_add_segment(struct process* process, void* segment);
 struct process* process_get(int process_id);
 struct process* process_current();
+struct process* process_first();
 int process_switch(struct process* process);
 
 #endif
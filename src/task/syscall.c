@@ -0,0 +1,291 @@
+#include "syscall.h"
+#include "task.h"
+#include "process.h"
+#include "wait.h"
+#include "../cpu/cpu.h"
+#include "../cpu/idt.h"
+#include "../drivers/screen.h"
+#include "../drivers/keyboard.h"
+#include "../drivers/timer.h"
+#include "../fs/file.h"
+#include "../memory/mmap/mmap.h"
+#include "../memory/paging/paging.h"
+#include "../string/string.h"
+#include <stddef.h>
+
+#define SYSCALL_PAGE_MASK (PAGING_PAGE_SIZE - 1)
+#define SYSCALL_USER_PAGE (PAGING_IS_PRESENT | PAGING_ACCESS_FROM_ALL)
+
+void syscall_fast_entry();
+
+// The CPU has SYSENTER and it is set up
+static bool syscall_fast = false;
+
+// Is the page under `addr` mapped for the process to read (or write) now?
+static bool syscall_user_page(struct process* process, uint32_t addr, bool write) {
+    uint32_t entry = paging_get(paging_4gb_chunk_get_directory(process->paging_chunk), (void*)(addr & ~SYSCALL_PAGE_MASK));
+    if ((entry & SYSCALL_USER_PAGE) != SYSCALL_USER_PAGE) return false;
+    return !write || (entry & PAGING_IS_WRITEABLE);
+}
+
+// May the calling process read (or write) [addr, addr + count)? Pages of
+// its mappings it hasn't touched yet are brought in now, so the kernel's
+// own access can't fault halfway through a call. Call with fs_lock held.
+static bool syscall_user_range(uint32_t addr, uint32_t count, bool write) {
+    struct process* process = process_current();
+    if (!process || !process->paging_chunk) return false;
+    if (count == 0) return true;
+    if (addr + count - 1 < addr) return false;
+
+    uint32_t last = (addr + count - 1) & ~SYSCALL_PAGE_MASK;
+    for (uint32_t page = addr & ~SYSCALL_PAGE_MASK; ; page += PAGING_PAGE_SIZE) {
+        if (!syscall_user_page(process, page, write) && mmap_fault_in(process, page, write) < 0) return false;
+        if (page == last) break;
+    }
+    return true;
+}
+
+// Copy in a string from the caller, checking each page as it is reached.
+// Fails if the string isn't terminated within `max` bytes.
+static int syscall_copy_string(char* out, uint32_t addr, uint32_t max) {
+    for (uint32_t i = 0; i < max; i++) {
+        if (i == 0 || ((addr + i) & SYSCALL_PAGE_MASK) == 0) {
+            if (!syscall_user_range(addr + i, 1, false)) return -1;
+        }
+
+        out[i] = ((const char*)addr)[i];
+        if (!out[i]) return i;
+    }
+    return -1;
+}
+
+static int syscall_console_write(const char* buf, uint32_t count) {
+    char chunk[65];
+    for (uint32_t done = 0; done < count; ) {
+        uint32_t n = count - done;
+        if (n > sizeof(chunk) - 1) n = sizeof(chunk) - 1;
+        memcpy(chunk, buf + done, n);
+        chunk[n] = 0;
+        print_string(chunk);
+        done += n;
+    }
+    return count;
+}
+
+// Waits for the first key, then returns at the end of the line. Only the
+// foreground process may read; one started in the background gets -1.
+static int syscall_console_read(char* buf, uint32_t count) {
+    if (!keyboard_is_owner(task_current())) return -1;
+
+    uint32_t n = 0;
+    while (n < count) {
+        char c = keyboard_getc();
+        buf[n++] = c;
+        if (c == '\n') break;
+    }
+    return n;
+}
+
+static void syscall_exit(int status) __attribute__((noreturn));
+static void syscall_exit(int status) {
+    struct task* task = task_current();
+    struct process* process = process_current();
+    if (process) {
+        char num[12];
+        print_string("Process ");
+        print_string(itoa(process->id, num));
+        print_string(" exited with status ");
+        print_string(itoa(status, num));
+        print_string("\n");
+
+        fs_lock();
+        process_free(process);
+        fs_unlock();
+        task->process = NULL;
+    }
+    task_exit();
+}
+
+// End the running process for an exception it took in user mode, as if
+// it had called exit(-1). The rest of the system carries on.
+void syscall_kill(registers_t* regs) {
+    char num[12];
+    struct process* process = process_current();
+    print_string("Process ");
+    print_string(itoa(process ? process->id : 0, num));
+    print_string(" killed: ");
+    print_string(isr_exception_name(regs->int_no));
+    print_string("\n");
+
+    // Exiting may sleep on fs_lock; this is the task's own kernel stack
+    __asm__ __volatile__("sti");
+    syscall_exit(-1);
+}
+
+static int sys_exit(registers_t* regs) {
+    syscall_exit(regs->ebx);
+}
+
+static int sys_write(registers_t* regs) {
+    int fd = regs->ebx;
+    uint32_t buf = regs->ecx;
+    uint32_t count = regs->edx;
+
+    int res = -1;
+    fs_lock();
+    if (syscall_user_range(buf, count, false)) {
+        if (fd == SYSCALL_CONSOLE_FD) {
+            res = syscall_console_write((const char*)buf, count);
+        } else {
+            res = fwrite((const void*)buf, 1, count, fd);
+        }
+    }
+    fs_unlock();
+    return res;
+}
+
+static int sys_read(registers_t* regs) {
+    int fd = regs->ebx;
+    uint32_t buf = regs->ecx;
+    uint32_t count = regs->edx;
+
+    fs_lock();
+    if (!syscall_user_range(buf, count, true)) {
+        fs_unlock();
+        return -1;
+    }
+
+    // The shell shares the keyboard, and takes the lock between keys
+    if (fd == SYSCALL_CONSOLE_FD) {
+        fs_unlock();
+        return syscall_console_read((char*)buf, count);
+    }
+
+    int res = fread((void*)buf, 1, count, fd);
+    fs_unlock();
+    return res;
+}
+
+static int sys_open(registers_t* regs) {
+    char path[SYSCALL_PATH_MAX];
+    char mode[4];
+
+    int res = -1;
+    fs_lock();
+    if (syscall_copy_string(path, regs->ebx, sizeof(path)) < 0) goto out;
+    if (syscall_copy_string(mode, regs->ecx, sizeof(mode)) < 0) goto out;
+
+    res = fopen(path, mode);
+    if (res <= 0) res = -1;
+
+out:
+    fs_unlock();
+    return res;
+}
+
+static int sys_close(registers_t* regs) {
+    int fd = regs->ebx;
+    if (fd == SYSCALL_CONSOLE_FD) return -1;
+
+    fs_lock();
+    int res = fclose(fd);
+    fs_unlock();
+    return res;
+}
+
+static int sys_seek(registers_t* regs) {
+    int fd = regs->ebx;
+    int offset = regs->ecx;
+    uint32_t whence = regs->edx;
+    if (fd == SYSCALL_CONSOLE_FD || whence > FILE_SEEK_END) return -1;
+
+    fs_lock();
+    int res = fseek(fd, offset, (FILE_SEEK_MODE)whence);
+    if (res >= 0) res = ftell(fd);
+    fs_unlock();
+    return res;
+}
+
+static int sys_sleep(registers_t* regs) {
+    sleep_ticks(timer_ms_to_ticks(regs->ebx));
+    return 0;
+}
+
+static int sys_getpid(registers_t* regs) {
+    struct process* process = process_current();
+    return process ? process->id : -1;
+}
+
+static int sys_mmap(registers_t* regs) {
+    fs_lock();
+    void* addr = mmap((void*)regs->ebx, regs->ecx, regs->edx, regs->esi, regs->edi, regs->ebp);
+    fs_unlock();
+    return addr ? (int)addr : -1;
+}
+
+static int sys_munmap(registers_t* regs) {
+    fs_lock();
+    int res = munmap((void*)regs->ebx, regs->ecx);
+    fs_unlock();
+    return res;
+}
+
+static const SYSCALL_FUNCTION syscall_table[SYSCALL_COUNT] = {
+    [SYS_EXIT] = sys_exit,
+    [SYS_WRITE] = sys_write,
+    [SYS_READ] = sys_read,
+    [SYS_OPEN] = sys_open,
+    [SYS_CLOSE] = sys_close,
+    [SYS_SEEK] = sys_seek,
+    [SYS_SLEEP] = sys_sleep,
+    [SYS_GETPID] = sys_getpid,
+    [SYS_MMAP] = sys_mmap,
+    [SYS_MUNMAP] = sys_munmap,
+};
+
+static void syscall_handler(registers_t* regs) {
+    // Calls may sleep, and disk reads want their interrupt
+    __asm__ __volatile__("sti");
+
+    uint32_t number = regs->eax;
+    regs->eax = number < SYSCALL_COUNT ? syscall_table[number](regs) : -1;
+
+    __asm__ __volatile__("cli");
+}
+
+// Called from syscall_fast_entry. The caller's stack holds where to return
+// to and its ebp, which is also the sixth argument; a caller that got
+// those wrong has nowhere to go back to.
+void syscall_fast_handler(registers_t* regs) {
+    struct process* process = process_current();
+    uint32_t addr = regs->ebp;
+    if (!process || !process->paging_chunk || addr > 0xFFFFFFFF - 8 ||
+        !syscall_user_page(process, addr, false) || !syscall_user_page(process, addr + 7, false)) {
+        syscall_exit(-1);
+    }
+
+    uint32_t* stack = (uint32_t*)addr;
+    regs->eip = stack[0];
+    regs->ebp = stack[1];
+    regs->useresp = addr + 8;
+    syscall_handler(regs);
+}
+
+// SYSENTER comes in on the stack in IA32_SYSENTER_ESP, so it has to follow
+// the running task, as the TSS esp0 does
+void syscall_set_kernel_stack(uint32_t esp) {
+    if (syscall_fast) cpu_write_msr(CPU_MSR_SYSENTER_ESP, esp);
+}
+
+void syscall_init() {
+    register_interrupt_handler(SYSCALL_INTERRUPT, syscall_handler);
+
+    // The gate always works; SYSENTER is the fast path where there is one.
+    // It relies on the GDT order: kernel code and data, then user code and
+    // data.
+    if (cpu_features() & CPU_FEATURE_SEP) {
+        cpu_write_msr(CPU_MSR_SYSENTER_CS, KERNEL_CS);
+        cpu_write_msr(CPU_MSR_SYSENTER_EIP, (uint32_t)syscall_fast_entry);
+        syscall_fast = true;
+    }
+}
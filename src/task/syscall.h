@@ -0,0 +1,42 @@
+#ifndef SYSCALL_H
+#define SYSCALL_H
+
+#include <stdint.h>
+#include "../cpu/isr.h"
+
+#define SYSCALL_INTERRUPT 0x80
+
+// The call number goes in eax and arguments in ebx, ecx, edx, esi, edi
+// and ebp, in that order. The result comes back in eax; negative means
+// the call failed.
+//
+// The same calls can be made with SYSENTER where the CPU has it: push ebp
+// and then the return address, point ebp at them and SYSENTER. The kernel
+// returns there with the stack and ebp as they were before the pushes,
+// but ecx and edx clobbered.
+#define SYS_EXIT 0    // exit(status)
+#define SYS_WRITE 1   // write(fd, buf, count)
+#define SYS_READ 2    // read(fd, buf, count)
+#define SYS_OPEN 3    // open(path, mode), mode as for fopen
+#define SYS_CLOSE 4   // close(fd)
+#define SYS_SEEK 5    // seek(fd, offset, whence), returns the new position
+#define SYS_SLEEP 6   // sleep(milliseconds)
+#define SYS_GETPID 7  // getpid()
+#define SYS_MMAP 8    // mmap(addr, length, prot, flags, fd, offset)
+#define SYS_MUNMAP 9  // munmap(addr, length)
+#define SYSCALL_COUNT 10
+
+// The file table never hands out descriptor 0, so user programs get the
+// console there: keyboard for read, screen for write
+#define SYSCALL_CONSOLE_FD 0
+
+// Longest path open() takes, terminator included
+#define SYSCALL_PATH_MAX 128
+
+typedef int (*SYSCALL_FUNCTION)(registers_t* regs);
+
+void syscall_init();
+void syscall_set_kernel_stack(uint32_t esp);
+void syscall_kill(registers_t* regs) __attribute__((noreturn));
+
+#endif
@@ -3,6 +3,7 @@
 section .asm
 
 global task_return
+global task_context_switch
 
 ; void task_return(struct registers* regs)
 task_return:
@@ -42,3 +43,25 @@ task_return:
 
     ; Jump to User Mode
     iret
+
+; void task_context_switch(uint32_t* old_esp, uint32_t new_esp)
+; Park the caller's callee-saved registers and flags on its own stack, store
+; the stack pointer in *old_esp and resume whatever was parked at new_esp
+task_context_switch:
+    mov eax, [esp+4]
+    mov edx, [esp+8]
+
+    push ebp
+    push ebx
+    push esi
+    push edi
+    pushf
+    mov [eax], esp
+
+    mov esp, edx
+    popf
+    pop edi
+    pop esi
+    pop ebx
+    pop ebp
+    ret
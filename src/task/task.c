@@ -3,31 +3,122 @@
 #include "../string/string.h"
 #include "../kernel/panic.h"
 #include "process.h"
+#include "syscall.h"
+#include "fpu.h"
+#include "../drivers/timer.h"
+#include "../drivers/keyboard.h"
 #include <stddef.h>
 
 struct task* current_task = NULL;
 struct task* task_tail = NULL;
 struct task* task_head = NULL;
 
+// Page directory of the kernel's own tasks
+static uint32_t* kernel_directory = NULL;
+
+// A task that has exited, freed once something else is on the CPU
+static struct task* task_exited = NULL;
+
+static struct task_stats task_stats;
+
+static const uint32_t task_level_slices[TASK_LEVELS] = TASK_LEVEL_SLICES;
+
+// Ticks until the next aging pass
+static uint32_t task_age_countdown = TASK_AGE_TICKS;
+
+// CPU share promised to deadline tasks, out of 1024
+static uint32_t task_deadline_util = 0;
+
+static inline uint32_t task_save_flags() {
+    uint32_t flags;
+    __asm__ __volatile__("pushf; pop %0; cli" : "=r"(flags) : : "memory");
+    return flags;
+}
+
+static inline void task_restore_flags(uint32_t flags) {
+    __asm__ __volatile__("push %0; popf" : : "r"(flags) : "memory", "cc");
+}
+
+static void task_link(struct task* task) {
+    if (!task_head) {
+        task_head = task;
+        task_tail = task;
+    } else {
+        task_tail->next = task;
+        task->prev = task_tail;
+        task_tail = task;
+    }
+}
+
+static void task_unlink(struct task* task) {
+    if (task->prev) task->prev->next = task->next;
+    if (task->next) task->next->prev = task->prev;
+    if (task == task_head) task_head = task->next;
+    if (task == task_tail) task_tail = task->prev;
+    task->next = NULL;
+    task->prev = NULL;
+}
+
+static void task_reap() {
+    if (task_exited && task_exited != current_task) {
+        task_free(task_exited);
+        task_exited = NULL;
+    }
+}
+
+// First thing a new user task runs: drop to ring 3 at its entry point
+static void task_start_user() {
+    task_reap();
+    task_return(&current_task->regs);
+}
+
+static void task_start_thread(void (*entry)()) {
+    task_reap();
+    __asm__ __volatile__("sti");
+    entry();
+    task_exit();
+}
+
+// Lay out the kernel stack so the first task_context_switch into the task
+// pops zeroed registers and returns into `start(arg)` with interrupts off
+static void task_prepare_stack(struct task* task, void (*start)(), uint32_t arg) {
+    uint32_t* sp = (uint32_t*)((uint32_t)task->kstack + TASK_STACK_SIZE);
+    *--sp = arg;
+    *--sp = 0;                 // start never returns
+    *--sp = (uint32_t)start;
+    *--sp = 0;                 // ebp
+    *--sp = 0;                 // ebx
+    *--sp = 0;                 // esi
+    *--sp = 0;                 // edi
+    *--sp = 0x002;             // EFLAGS, IF clear
+    task->kesp = (uint32_t)sp;
+}
+
+static int task_alloc_kstack(struct task* task) {
+    task->kstack = kmalloc(TASK_STACK_SIZE);
+    if (!task->kstack) return -1;
+    memset(task->kstack, 0, TASK_STACK_SIZE);
+    return 0;
+}
+
 int task_init(struct task* task, struct process* process) {
     memset(task, 0, sizeof(struct task));
     task->process = process;
+    task->directory = process->paging_chunk->directory_entry;
 
     // Allocate User Stack (16KB)
-    task->user_stack = kmalloc(16384);
+    task->user_stack = kmalloc(TASK_STACK_SIZE);
     if (!task->user_stack) return -1;
 
-    memset(task->user_stack, 0, 16384);
+    memset(task->user_stack, 0, TASK_STACK_SIZE);
 
     // Allocate Kernel Stack (16KB)
-    task->kstack = kmalloc(16384);
-    if (!task->kstack) {
+    if (task_alloc_kstack(task) != 0) {
         kfree(task->user_stack);
         return -1;
     }
-    memset(task->kstack, 0, 16384);
 
-    uint32_t stack_top = (uint32_t)task->user_stack + 16383;
+    uint32_t stack_top = (uint32_t)task->user_stack + TASK_STACK_SIZE;
     
     // Initialize registers for User Mode
     task->regs.ss = 0x23; // User Data (0x20 | 3)
@@ -39,13 +130,28 @@ int task_init(struct task* task, struct process* process) {
     // Map user stack in the process's page directory
     // For now, identity map it but with User access
     uint32_t stack_page = (uint32_t)task->user_stack & 0xFFFFF000;
-    for (uint32_t i = 0; i < 16384; i += PAGING_PAGE_SIZE) {
+    for (uint32_t i = 0; i < TASK_STACK_SIZE; i += PAGING_PAGE_SIZE) {
         paging_set(process->paging_chunk->directory_entry, (void*)(stack_page + i), (stack_page + i) | PAGING_IS_PRESENT | PAGING_IS_WRITEABLE | PAGING_ACCESS_FROM_ALL);
     }
 
+    task_prepare_stack(task, task_start_user, 0);
+    process->task = task;
     return 0;
 }
 
+// Turn the code running now (the shell, on the boot stack) into the first
+// task, so the scheduler has somewhere to come back to
+void task_init_kernel(uint32_t* directory) {
+    static struct task kernel_task;
+    memset(&kernel_task, 0, sizeof(struct task));
+    kernel_task.directory = directory;
+    kernel_task.slice = task_level_slices[0];
+
+    kernel_directory = directory;
+    current_task = &kernel_task;
+    task_link(&kernel_task);
+}
+
 struct task* task_new(struct process* process) {
     struct task* task = kmalloc(sizeof(struct task));
     if (!task) return NULL;
@@ -55,17 +161,28 @@ struct task* task_new(struct process* process) {
         return NULL;
     }
 
-    if (!task_head) {
-        task_head = task;
-        task_tail = task;
-        current_task = task;
-        process_switch(process);
-    } else {
-        task_tail->next = task;
-        task->prev = task_tail;
-        task_tail = task;
+    uint32_t flags = task_save_flags();
+    task_link(task);
+    task_restore_flags(flags);
+    return task;
+}
+
+// A kernel task running entry(); it exits when entry returns
+struct task* task_new_thread(void (*entry)()) {
+    struct task* task = kmalloc(sizeof(struct task));
+    if (!task) return NULL;
+    memset(task, 0, sizeof(struct task));
+    task->directory = kernel_directory;
+
+    if (task_alloc_kstack(task) != 0) {
+        kfree(task);
+        return NULL;
     }
+    task_prepare_stack(task, (void (*)())task_start_thread, (uint32_t)entry);
 
+    uint32_t flags = task_save_flags();
+    task_link(task);
+    task_restore_flags(flags);
     return task;
 }
 
@@ -73,32 +190,337 @@ struct task* task_current() {
     return current_task;
 }
 
+// Not for the running task, whose stack this frees; it leaves by task_exit
 void task_free(struct task* task) {
-    if (task->prev) task->prev->next = task->next;
-    if (task->next) task->next->prev = task->prev;
-    if (task == task_head) task_head = task->next;
-    if (task == task_tail) task_tail = task->prev;
-    if (task == current_task) current_task = task_head;
+    uint32_t flags = task_save_flags();
+    if (task->prev || task->next || task == task_head) task_unlink(task);
+    task_set_deadline(task, 0, 0, 0);
+    fpu_release(task);
+    keyboard_release(task);
+    task_restore_flags(flags);
     
     if (task->user_stack) kfree(task->user_stack);
     if (task->kstack) kfree(task->kstack);
     kfree(task);
 }
 
+// Highest level a task may sit on, given its nice value
+static int task_top_level(struct task* task) {
+    if (task->nice <= 0) return 0;
+    return task->nice * TASK_LEVELS / (TASK_NICE_MAX + 1);
+}
+
+// Smaller runs first: level, then nice
+static int task_priority(struct task* task) {
+    return task->level * (TASK_NICE_MAX - TASK_NICE_MIN + 1) + task->nice - TASK_NICE_MIN;
+}
+
+// Time comparisons that survive the tick counter wrapping
+static inline bool task_time_before(uint32_t a, uint32_t b) {
+    return (int32_t)(a - b) < 0;
+}
+
+// A deadline task with a job to run and budget left
+static bool task_deadline_ready(struct task* task) {
+    return task->policy == TASK_POLICY_DEADLINE && task->state == TASK_RUNNABLE &&
+           task->dl_active && task->dl_budget > 0;
+}
+
+static struct task* task_pick_deadline() {
+    struct task* best = NULL;
+    for (struct task* task = task_head; task; task = task->next) {
+        if (task_deadline_ready(task) &&
+            (!best || task_time_before(task->dl_abs_deadline, best->dl_abs_deadline))) {
+            best = task;
+        }
+    }
+    return best;
+}
+
+// Whether `next` should take the CPU from `task` before its slice is up
+static bool task_preempts(struct task* next, struct task* task) {
+    if (next == task) return false;
+    if (task_deadline_ready(next)) {
+        return !task_deadline_ready(task) || task_time_before(next->dl_abs_deadline, task->dl_abs_deadline);
+    }
+    if (task->policy == TASK_POLICY_DEADLINE) return !task_deadline_ready(task);
+    return task_priority(next) < task_priority(task);
+}
+
+// Best runnable task: the earliest deadline, else by MLFQ order. Among
+// equals the first one after the current task wins, so they take turns;
+// the current task itself is considered last.
+static struct task* task_pick() {
+    if (!task_head) return NULL;
+
+    struct task* deadline = task_pick_deadline();
+    if (deadline) return deadline;
+
+    struct task* start = current_task && current_task->next ? current_task->next : task_head;
+    struct task* best = NULL;
+    struct task* task = start;
+    do {
+        if (task->state == TASK_RUNNABLE && task->policy == TASK_POLICY_NORMAL &&
+            (!best || task_priority(task) < task_priority(best))) {
+            best = task;
+        }
+        task = task->next ? task->next : task_head;
+    } while (task != start);
+    return best;
+}
+
+// Put the task on the kernel's page directory, so its process's can be
+// freed under it
+void task_drop_directory(struct task* task) {
+    if (task == current_task) paging_switch(kernel_directory);
+    task->directory = kernel_directory;
+}
+
 extern tss_entry_t tss_entry;
+
+// Call with interrupts off. Returns once something switches back to us.
 void task_switch(struct task* task) {
+    struct task* prev = current_task;
+    task->slice = task_level_slices[task->level];
+    if (task == prev) return;
+
     current_task = task;
     process_switch(task->process);
-    paging_switch(task->process->paging_chunk->directory_entry);
-    tss_entry.esp0 = (uint32_t)task->kstack + 16383;
-    task_return(&task->regs);
+    paging_switch(task->directory);
+    fpu_switch(task);
+    if (task->kstack) {
+        tss_entry.esp0 = (uint32_t)task->kstack + TASK_STACK_SIZE;
+        syscall_set_kernel_stack(tss_entry.esp0);
+    }
+    task_stats.switches++;
+
+    task_context_switch(&prev->kesp, task->kesp);
+    task_reap();
+}
+
+// Give up the rest of the slice. Returns 0 if nothing else wanted to run.
+int task_yield() {
+    uint32_t flags = task_save_flags();
+    struct task* next = task_pick();
+    int switched = next && next != current_task;
+    if (next) task_switch(next);
+    task_restore_flags(flags);
+    return switched;
+}
+
+// Wait for the next runnable task, halting until an interrupt makes one
+static struct task* task_pick_or_idle() {
+    struct task* next;
+    while (!(next = task_pick())) {
+        __asm__ __volatile__("sti; hlt; cli");
+    }
+    return next;
+}
+
+// Sleep until task_wake. Call with interrupts off, after checking for
+// whatever is being waited on, so a wakeup can't slip in between.
+void task_block() {
+    struct task* task = current_task;
+    if (!task) {
+        // No scheduler yet; just wait for an interrupt
+        __asm__ __volatile__("sti; hlt; cli");
+        return;
+    }
+
+    task->state = TASK_BLOCKED;
+    while (task->state == TASK_BLOCKED) {
+        task_switch(task_pick_or_idle());
+    }
+}
+
+// Safe from interrupt handlers. A task that slept on I/O comes back at
+// the top of its range, and preempts batch work on the next tick.
+void task_wake(struct task* task) {
+    if (!task || task->state != TASK_BLOCKED) return;
+    task->state = TASK_RUNNABLE;
+    task->level = task_top_level(task);
+    task_stats.wakeups++;
+}
+
+int task_set_nice(struct task* task, int nice) {
+    if (nice < TASK_NICE_MIN || nice > TASK_NICE_MAX) return -1;
+
+    uint32_t flags = task_save_flags();
+    task->nice = nice;
+    if (task->level < task_top_level(task)) {
+        task->level = task_top_level(task);
+    }
+    task_restore_flags(flags);
+    return 0;
+}
+
+// Join the deadline class, or leave it with a zero runtime. Fails with -1
+// for nonsense parameters and -2 if the CPU can't promise the time.
+int task_set_deadline(struct task* task, uint32_t runtime, uint32_t deadline, uint32_t period) {
+    if (runtime && (runtime > deadline || deadline > period || period > 0xFFFFF)) return -1;
+
+    // Utilization rounds up, so what is admitted really fits
+    uint32_t util = runtime ? (runtime * 1024 + period - 1) / period : 0;
+
+    uint32_t flags = task_save_flags();
+    uint32_t current = 0;
+    if (task->policy == TASK_POLICY_DEADLINE) {
+        current = (task->dl_runtime * 1024 + task->dl_period - 1) / task->dl_period;
+    }
+    if (task_deadline_util - current + util > TASK_DEADLINE_UTIL_MAX) {
+        task_restore_flags(flags);
+        return -2;
+    }
+    task_deadline_util = task_deadline_util - current + util;
+
+    if (!runtime) {
+        task->policy = TASK_POLICY_NORMAL;
+        task->dl_active = false;
+        if (task->dl_waiting) task->state = TASK_RUNNABLE;
+        task_restore_flags(flags);
+        return 0;
+    }
+
+    // The first job starts now
+    uint32_t now = timer_get_ticks();
+    task->policy = TASK_POLICY_DEADLINE;
+    task->dl_runtime = runtime;
+    task->dl_deadline = deadline;
+    task->dl_period = period;
+    task->dl_budget = runtime;
+    task->dl_abs_deadline = now + deadline;
+    task->dl_release = now + period;
+    task->dl_active = true;
+    task->dl_missed = false;
+    task->dl_jobs = 1;
+    task->dl_misses = 0;
+    task_restore_flags(flags);
+    return 0;
+}
+
+// End the current job and sleep until the next period starts
+void task_wait_period() {
+    uint32_t flags = task_save_flags();
+    struct task* task = current_task;
+    if (task && task->policy == TASK_POLICY_DEADLINE) {
+        task->dl_active = false;
+        task->dl_waiting = true;
+        task_block();
+        task->dl_waiting = false;
+    }
+    task_restore_flags(flags);
+}
+
+void task_exit() {
+    __asm__ __volatile__("cli");
+    struct task* task = current_task;
+    task->state = TASK_EXITED;
+    struct task* next = task_pick_or_idle();
+    task_unlink(task);
+
+    task_exited = task;
+    task_switch(next);
+    panic("task_exit: exited task resumed");
+}
+
+// Charge the running task's budget, count late jobs and start new ones
+static void task_deadline_tick(struct task* current) {
+    if (current->policy == TASK_POLICY_DEADLINE && current->dl_budget > 0) {
+        if (--current->dl_budget == 0) current->dl_active = false;
+    }
+
+    uint32_t now = timer_get_ticks();
+    for (struct task* task = task_head; task; task = task->next) {
+        if (task->policy != TASK_POLICY_DEADLINE) continue;
+
+        if (task->dl_active && !task->dl_missed && !task_time_before(now, task->dl_abs_deadline)) {
+            task->dl_missed = true;
+            task->dl_misses++;
+            task_stats.deadline_misses++;
+        }
+
+        // An unfinished job is dropped when the next one starts; it has
+        // been counted late already, since deadlines fall within the period
+        if (!task_time_before(now, task->dl_release)) {
+            task->dl_abs_deadline = task->dl_release + task->dl_deadline;
+            task->dl_release += task->dl_period;
+            task->dl_budget = task->dl_runtime;
+            task->dl_active = true;
+            task->dl_missed = false;
+            task->dl_jobs++;
+            if (task->dl_waiting) task->state = TASK_RUNNABLE;
+        }
+    }
+}
+
+// Move every task up a level, as far as its nice allows
+static void task_age() {
+    for (struct task* task = task_head; task; task = task->next) {
+        if (task->level > task_top_level(task)) task->level--;
+    }
+}
+
+static void task_save_frame(struct task* task, registers_t* frame) {
+    task->regs.edi = frame->edi;
+    task->regs.esi = frame->esi;
+    task->regs.ebp = frame->ebp;
+    task->regs.ebx = frame->ebx;
+    task->regs.edx = frame->edx;
+    task->regs.ecx = frame->ecx;
+    task->regs.eax = frame->eax;
+    task->regs.eip = frame->eip;
+    task->regs.cs = frame->cs;
+    task->regs.eflags = frame->eflags;
+    task->regs.esp = frame->useresp;
+    task->regs.ss = frame->ss;
+}
+
+// Timer interrupt. Only user mode is preempted: the heap, page cache and
+// the rest of the kernel assume one thread at a time, so kernel tasks give
+// up the CPU only when they sleep or yield.
+void task_tick(registers_t* frame) {
+    struct task* task = current_task;
+    if (!task) return;
+
+    if (--task_age_countdown == 0) {
+        task_age_countdown = TASK_AGE_TICKS;
+        task_age();
+    }
+
+    task_deadline_tick(task);
+    wait_tick(timer_get_ticks());
+
+    if ((frame->cs & 3) != 3) return;
+    task_save_frame(task, frame);
+
+    // A used-up slice costs a level; deadline tasks run out of budget
+    // instead
+    bool expired;
+    if (task->policy == TASK_POLICY_DEADLINE) {
+        expired = !task_deadline_ready(task);
+    } else {
+        expired = --task->slice == 0;
+        if (expired && task->level < TASK_LEVELS - 1) task->level++;
+    }
+
+    // Otherwise keep going unless something more important has woken up.
+    // With nothing else to run, even a throttled task keeps the CPU.
+    struct task* next = task_pick();
+    if (!next || (!expired && !task_preempts(next, task))) return;
+
+    if (next != task) task_stats.preemptions++;
+    task_switch(next);
+}
+
+void task_get_stats(struct task_stats* stats) {
+    *stats = task_stats;
 }
 
 int task_copy_string_from_user(struct task* task, void* virtual, char* phys, int max) {
     if (max <= 0) return -1;
 
-    uint32_t* old_directory = task_current()->process->paging_chunk->directory_entry;
-    paging_switch(task->process->paging_chunk->directory_entry);
+    uint32_t* old_directory = task_current()->directory;
+    paging_switch(task->directory);
 
     char* v = (char*)virtual;
     int i = 0;
@@ -113,8 +535,8 @@ int task_copy_string_from_user(struct task* task, void* virtual, char* phys, int
 }
 
 uint32_t task_get_stack_item(struct task* task, int index) {
-    uint32_t* old_directory = task_current()->process->paging_chunk->directory_entry;
-    paging_switch(task->process->paging_chunk->directory_entry);
+    uint32_t* old_directory = task_current()->directory;
+    paging_switch(task->directory);
 
     uint32_t* sp = (uint32_t*)task->regs.esp;
     uint32_t item = sp[index];
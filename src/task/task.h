@@ -2,8 +2,41 @@
 #define TASK_H
 
 #include <stdint.h>
+#include <stdbool.h>
 #include "../memory/paging/paging.h"
 #include "../cpu/gdt.h"
+#include "../cpu/isr.h"
+#include "wait.h"
+
+#define TASK_STACK_SIZE 16384
+
+// Multi-level feedback queue. Tasks start on level 0 and drop a level each
+// time they use up a slice; lower levels run only when the ones above have
+// nothing runnable, but get longer slices when they do.
+#define TASK_LEVELS 4
+#define TASK_LEVEL_SLICES { 1, 2, 4, 8 } // Ticks per slice on each level
+
+// Every this many ticks each task climbs a level, so a busy upper level
+// can't starve the ones below forever
+#define TASK_AGE_TICKS 100
+
+// A positive nice keeps a task off the top levels; any nice breaks ties
+// between tasks on the same level
+#define TASK_NICE_MIN -20
+#define TASK_NICE_MAX 19
+
+// Deadline tasks run ahead of everything else, earliest deadline first.
+// Each gets `runtime` ticks in every `period`, to be used within
+// `deadline` ticks of the period starting; together they may ask for at
+// most this much of the CPU (out of 1024), leaving the rest for the shell.
+#define TASK_DEADLINE_UTIL_MAX 972
+
+#define TASK_POLICY_NORMAL 0
+#define TASK_POLICY_DEADLINE 1
+
+#define TASK_RUNNABLE 0
+#define TASK_BLOCKED 1
+#define TASK_EXITED 2
 
 struct registers {
     uint32_t edi;
@@ -24,19 +57,75 @@ struct registers {
 struct process;
 
 struct task {
+    // User mode state, as of the last time the task entered the kernel
     struct registers regs;
     struct process* process;
     struct task* next;
     struct task* prev;
     void* user_stack;
-    void* kstack;
+    void* kstack;       // NULL for the boot context, which keeps its own
+
+    uint32_t* directory;
+    uint32_t kesp;      // Kernel stack pointer while switched out
+
+    // FPU registers while another task holds the FPU; allocated the first
+    // time the task uses it
+    void* fpu_area;
+
+    int state;
+    int policy;
+    int level;
+    int nice;
+    uint32_t slice;     // Ticks left before it is preempted
+
+    // The queue the task sleeps on, and when it stops waiting if timed
+    struct wait_queue* wait_queue;
+    struct task* wait_next;
+    struct task* timer_next;
+    uint32_t wake_at;
+    bool timed_out;
+
+    // Deadline class, in ticks. A job ends when the task calls
+    // task_wait_period or its budget runs out; it misses if the deadline
+    // passes first.
+    uint32_t dl_runtime;
+    uint32_t dl_deadline;
+    uint32_t dl_period;
+    uint32_t dl_budget;       // Runtime left in the current job
+    uint32_t dl_abs_deadline;
+    uint32_t dl_release;      // When the next job starts
+    bool dl_active;           // The current job hasn't ended
+    bool dl_missed;           // ...and has already been counted late
+    bool dl_waiting;          // Blocked in task_wait_period
+    uint32_t dl_jobs;
+    uint32_t dl_misses;
+};
+
+struct task_stats {
+    uint32_t switches;
+    uint32_t preemptions;
+    uint32_t wakeups;
+    uint32_t deadline_misses;
 };
 
+void task_init_kernel(uint32_t* directory);
 struct task* task_new(struct process* process);
+struct task* task_new_thread(void (*entry)());
 struct task* task_current();
 void task_free(struct task* task);
+void task_drop_directory(struct task* task);
+void task_exit() __attribute__((noreturn));
 void task_return(struct registers* regs);
+void task_context_switch(uint32_t* old_esp, uint32_t new_esp);
 void task_switch(struct task* task);
+int task_yield();
+void task_block();
+void task_wake(struct task* task);
+int task_set_nice(struct task* task, int nice);
+int task_set_deadline(struct task* task, uint32_t runtime, uint32_t deadline, uint32_t period);
+void task_wait_period();
+void task_tick(registers_t* frame);
+void task_get_stats(struct task_stats* stats);
 int task_copy_string_from_user(struct task* task, void* virtual, char* phys, int max);
 uint32_t task_get_stack_item(struct task* task, int index);
 
@@ -0,0 +1,173 @@
+#include "wait.h"
+#include "task.h"
+#include "../cpu/cpu.h"
+#include "../drivers/timer.h"
+#include <stddef.h>
+
+// Sleepers with a timeout, soonest first
+static struct task* wait_timers = NULL;
+
+static inline bool wait_time_before(uint32_t a, uint32_t b) {
+    return (int32_t)(a - b) < 0;
+}
+
+void wait_queue_init(struct wait_queue* queue) {
+    queue->head = NULL;
+    queue->tail = NULL;
+}
+
+static void wait_enqueue(struct wait_queue* queue, struct task* task) {
+    task->wait_queue = queue;
+    task->wait_next = NULL;
+    if (queue->tail) {
+        queue->tail->wait_next = task;
+    } else {
+        queue->head = task;
+    }
+    queue->tail = task;
+}
+
+static void wait_dequeue(struct wait_queue* queue, struct task* task) {
+    struct task* prev = NULL;
+    for (struct task* t = queue->head; t; prev = t, t = t->wait_next) {
+        if (t != task) continue;
+
+        if (prev) {
+            prev->wait_next = t->wait_next;
+        } else {
+            queue->head = t->wait_next;
+        }
+        if (queue->tail == t) queue->tail = prev;
+        break;
+    }
+    task->wait_queue = NULL;
+    task->wait_next = NULL;
+}
+
+static void wait_timer_add(struct task* task) {
+    struct task** link = &wait_timers;
+    while (*link && !wait_time_before(task->wake_at, (*link)->wake_at)) {
+        link = &(*link)->timer_next;
+    }
+    task->timer_next = *link;
+    *link = task;
+}
+
+static void wait_timer_remove(struct task* task) {
+    for (struct task** link = &wait_timers; *link; link = &(*link)->timer_next) {
+        if (*link == task) {
+            *link = task->timer_next;
+            break;
+        }
+    }
+    task->timer_next = NULL;
+}
+
+// Sleep on `queue` until woken, or for at most `ticks` if that isn't 0.
+// Returns -1 on a timeout. Call with interrupts off.
+int wait_sleep_timeout(struct wait_queue* queue, uint32_t ticks) {
+    struct task* task = task_current();
+    if (!task) {
+        // No scheduler yet; let one interrupt through and have the
+        // caller look again
+        __asm__ __volatile__("sti; hlt; cli");
+        return 0;
+    }
+
+    task->timed_out = false;
+    wait_enqueue(queue, task);
+    if (ticks) {
+        task->wake_at = timer_get_ticks() + ticks;
+        wait_timer_add(task);
+    }
+
+    task_block();
+
+    if (ticks) wait_timer_remove(task);
+    return task->timed_out ? -1 : 0;
+}
+
+void wait_sleep(struct wait_queue* queue) {
+    wait_sleep_timeout(queue, 0);
+}
+
+void wait_wake_one(struct wait_queue* queue) {
+    uint32_t flags = interrupts_save();
+    struct task* task = queue->head;
+    if (task) {
+        wait_dequeue(queue, task);
+        task_wake(task);
+    }
+    interrupts_restore(flags);
+}
+
+void wait_wake_all(struct wait_queue* queue) {
+    uint32_t flags = interrupts_save();
+    while (queue->head) {
+        struct task* task = queue->head;
+        wait_dequeue(queue, task);
+        task_wake(task);
+    }
+    interrupts_restore(flags);
+}
+
+// Timer interrupt: wake everyone whose timeout has passed
+void wait_tick(uint32_t now) {
+    while (wait_timers && !wait_time_before(now, wait_timers->wake_at)) {
+        struct task* task = wait_timers;
+        wait_timers = task->timer_next;
+        task->timer_next = NULL;
+
+        if (task->wait_queue) wait_dequeue(task->wait_queue, task);
+        task->timed_out = true;
+        task_wake(task);
+    }
+}
+
+void completion_init(struct completion* completion) {
+    completion->done = false;
+    wait_queue_init(&completion->wait);
+}
+
+void complete(struct completion* completion) {
+    completion->done = true;
+    wait_wake_all(&completion->wait);
+}
+
+// Returns -1 if `ticks` pass first (0 waits for as long as it takes)
+int wait_for_completion_timeout(struct completion* completion, uint32_t ticks) {
+    uint32_t flags = interrupts_save();
+    uint32_t end = timer_get_ticks() + ticks;
+    int res = 0;
+    while (!completion->done) {
+        uint32_t left = 0;
+        if (ticks) {
+            uint32_t now = timer_get_ticks();
+            if (!wait_time_before(now, end)) {
+                res = -1;
+                break;
+            }
+            left = end - now;
+        }
+        wait_sleep_timeout(&completion->wait, left);
+    }
+    interrupts_restore(flags);
+    return res;
+}
+
+void wait_for_completion(struct completion* completion) {
+    wait_for_completion_timeout(completion, 0);
+}
+
+void sleep_ticks(uint32_t ticks) {
+    struct wait_queue queue;
+    wait_queue_init(&queue);
+
+    uint32_t flags = interrupts_save();
+    uint32_t end = timer_get_ticks() + ticks;
+    uint32_t now;
+    while (wait_time_before(now = timer_get_ticks(), end)) {
+        wait_sleep_timeout(&queue, end - now);
+    }
+    interrupts_restore(flags);
+}
@@ -0,0 +1,36 @@
+#ifndef WAIT_H
+#define WAIT_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+struct task;
+
+// Tasks asleep until something happens. Check for the event and go to
+// sleep with interrupts off, or the wakeup can slip in between.
+struct wait_queue {
+    struct task* head;
+    struct task* tail;
+};
+
+// A one-off event; waiting after it has happened returns at once
+struct completion {
+    volatile bool done;
+    struct wait_queue wait;
+};
+
+void wait_queue_init(struct wait_queue* queue);
+void wait_sleep(struct wait_queue* queue);
+int wait_sleep_timeout(struct wait_queue* queue, uint32_t ticks);
+void wait_wake_one(struct wait_queue* queue);
+void wait_wake_all(struct wait_queue* queue);
+void wait_tick(uint32_t now);
+
+void completion_init(struct completion* completion);
+void complete(struct completion* completion);
+void wait_for_completion(struct completion* completion);
+int wait_for_completion_timeout(struct completion* completion, uint32_t ticks);
+
+void sleep_ticks(uint32_t ticks);
+
+#endif